@@ -0,0 +1,383 @@
+/*
+File: AssetLoader.hpp
+
+Description: Loads the scene's model files for init(). Every distinct model
+file is parsed and indexed (welded and vertex cache ordered) once on a small
+pool of worker threads while the GL context thread compiles the shaders; the
+context thread then only uploads the parsed data into one shared VBO and IBO,
+every asset's vertices and indices following the previous asset's, so the
+whole scene draws from one VAO.
+Vertices are packed in the interleaved vertex format passed to the
+constructor (see packTriModel() in triMesh465.hpp), and each asset's index
+buffer holds its levels of detail (see buildTriLodChain() in triLod465.hpp)
+after its full detail indices. Every asset also gets a collision BVH over its
+full detail triangles (see buildTriBvh() in triBvh465.hpp), built on the
+workers for archive assets too. Models repeated in the
+model list share one asset, and models found in the model archive in
+the same vertex format are uploaded straight from its mapping without being
+parsed.
+
+The time spent parsing and uploading each asset and its vertex cache miss
+ratio (ACMR) before and after reordering are printed by printTimings() so
+startup and vertex cache regressions show up in the console.
+*/
+
+# ifndef __INCLUDES465__
+# include "../includes465/include465.hpp"
+# define __INCLUDES465__
+# endif
+
+# include <thread>
+# include <atomic>
+# include <chrono>
+# include <string.h>
+
+class AssetLoader
+{
+
+protected:
+
+	// One distinct model file and the data parsed from it.
+	struct Asset
+	{
+		char * fileName;
+		int nIndices;							// 3 * number of triangles
+		int nVertices;							// unique vertices after welding
+		unsigned char * data;					// packed vertices and indices in the archive layout
+		const TriArchiveEntry * archiveEntry;	// set if the model is uploaded from the archive
+		float boundingRadius;
+		float positionScale;					// model matrix scale of quantized positions
+		TriLodChain lod;						// index range of each level of detail
+		TriBvh bvh;								// collision hierarchy and exact bounds of the full detail triangles
+		float acmrWelded, acmrOptimized;		// vertex cache miss ratio before and after reordering
+		int baseVertex;							// first vertex of the asset in the shared vbo once uploaded
+		int firstIndex;							// first index of the asset in the shared ibo once uploaded
+		double parseTime;						// milliseconds on a worker thread
+		double uploadTime;						// milliseconds on the context thread
+	};
+
+	static const int maxAssets = 32;
+
+	Asset asset[maxAssets];
+	int nAssets;
+	int * modelAsset;		// asset index of each model
+	int nModels;
+	int vertexFormat;		// TRI_VERTEX_FLOAT or TRI_VERTEX_QUANTIZED
+	const TriArchive * archive;
+
+	std::thread * worker;
+	int nWorkers;
+	std::atomic<int> nextAsset;	// next asset a worker should parse
+
+	static double millisecondsSince(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// Builds an archive asset's collision BVH from the positions packed in the archive.
+	void buildArchiveBvh(Asset * a)
+	{
+		const unsigned char * data = archive->base + a->archiveEntry->offset;
+		glm::vec4 * vertex = (glm::vec4 *)malloc(a->nVertices * sizeof(glm::vec4));
+
+		unpackTriPositions(vertexFormat, a->nVertices, data, a->positionScale, vertex);
+		buildTriBvh(&a->bvh, vertex, a->nVertices,
+			(const unsigned int *)(data + triArchiveVertexSize(vertexFormat, a->nVertices)), a->nIndices);
+		free(vertex);
+	}
+
+	// Worker thread body: parse assets until none are left.
+	void parseAssets()
+	{
+		for (int i = nextAsset++; i < nAssets; i = nextAsset++)
+		{
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			if (asset[i].archiveEntry != NULL)
+			{
+				buildArchiveBvh(&asset[i]);
+				asset[i].parseTime = millisecondsSince(start);
+				continue;
+			}
+
+			// A model the scene gives no triangle count for is counted first
+			if (asset[i].nIndices == 0)
+			{
+				int nTriangles = countTriModel(asset[i].fileName);
+				if (nTriangles <= 0)
+				{
+					asset[i].parseTime = millisecondsSince(start);
+					continue;
+				}
+				asset[i].nIndices = 3 * nTriangles;
+			}
+
+			int nIndices = asset[i].nIndices;
+			glm::vec4 * vertex = (glm::vec4 *)malloc(nIndices * (2 * sizeof(glm::vec4) + sizeof(glm::vec3)));
+			glm::vec4 * color = vertex + nIndices;
+			glm::vec3 * normal = (glm::vec3 *)(color + nIndices);
+			unsigned char * data = (unsigned char *)malloc((size_t)triArchiveModelSize(vertexFormat, nIndices, TRI_MAX_LODS * nIndices));
+
+			asset[i].data = data;
+			asset[i].boundingRadius = loadTriModel(asset[i].fileName, nIndices, vertex, color, normal);
+			if (asset[i].boundingRadius != -1.0f)
+			{
+				// Index into the tail of the block, then pack the vertices in front of the indices
+				unsigned int * index = (unsigned int *)(data + triArchiveVertexSize(vertexFormat, nIndices));
+				int nVertices = indexTriModel(nIndices, vertex, color, normal, index,
+					&asset[i].acmrWelded, &asset[i].acmrOptimized);
+				int nLodIndices = buildTriLodChain(index, nIndices, nVertices, vertex, color, normal, &asset[i].lod);
+				buildTriBvh(&asset[i].bvh, vertex, nVertices, index, nIndices);
+
+				asset[i].positionScale = packTriModel(vertexFormat, nVertices, vertex, color, normal, data);
+				memmove(data + triArchiveVertexSize(vertexFormat, nVertices), index, nLodIndices * sizeof(unsigned int));
+				asset[i].nVertices = nVertices;
+			}
+			free(vertex);
+			asset[i].parseTime = millisecondsSince(start);
+		}
+	}
+
+public:
+
+	/* Constructor, builds the list of distinct model files.
+	passedModelFile and passedNIndices have an entry for every model in the scene,
+	an index count of 0 is taken from the archive or counted from the *.tri file.
+	passedVertexFormat is TRI_VERTEX_FLOAT or TRI_VERTEX_QUANTIZED.
+	*/
+	AssetLoader(char * passedModelFile[], int passedNIndices[], int passedNModels, int passedVertexFormat,
+		const TriArchive * passedArchive)
+	{
+		nModels = passedNModels;
+		vertexFormat = passedVertexFormat;
+		nAssets = 0;
+		archive = passedArchive;
+		modelAsset = new int[nModels];
+		worker = NULL;
+		nWorkers = 0;
+		nextAsset = 0;
+
+		for (int i = 0; i < nModels; i++)
+		{
+			int a = 0;
+			while (a < nAssets && strcmp(asset[a].fileName, passedModelFile[i]) != 0)
+				a++;
+
+			if (a == nAssets)
+			{
+				if (nAssets == maxAssets)
+				{
+					printf("AssetLoader error: more than %d distinct model files\n", maxAssets);
+					exit(EXIT_FAILURE);
+				}
+				asset[a].fileName = passedModelFile[i];
+				asset[a].nIndices = passedNIndices[i];
+				asset[a].nVertices = 0;
+				asset[a].data = NULL;
+				asset[a].archiveEntry = findTriArchiveModel(archive, passedModelFile[i]);
+				asset[a].boundingRadius = -1.0f;
+				asset[a].positionScale = 1.0f;
+				memset(&asset[a].lod, 0, sizeof(TriLodChain));
+				asset[a].acmrWelded = asset[a].acmrOptimized = 0.0f;
+				asset[a].baseVertex = asset[a].firstIndex = 0;
+				asset[a].parseTime = 0.0;
+				asset[a].uploadTime = 0.0;
+
+				// A stale archive entry or one in another vertex format is parsed from its *.tri file instead
+				if (asset[a].archiveEntry != NULL && ((passedNIndices[i] != 0 &&
+					asset[a].archiveEntry->nIndices != (unsigned int)passedNIndices[i]) ||
+					asset[a].archiveEntry->vertexFormat != (unsigned int)vertexFormat))
+					asset[a].archiveEntry = NULL;
+				if (asset[a].archiveEntry != NULL)
+				{
+					asset[a].nIndices = asset[a].archiveEntry->nIndices;
+					asset[a].nVertices = asset[a].archiveEntry->nVertices;
+					asset[a].boundingRadius = asset[a].archiveEntry->boundingRadius;
+					asset[a].positionScale = asset[a].archiveEntry->positionScale;
+					asset[a].lod = asset[a].archiveEntry->lod;
+					asset[a].acmrWelded = asset[a].archiveEntry->acmrWelded;
+					asset[a].acmrOptimized = asset[a].archiveEntry->acmrOptimized;
+				}
+				nAssets++;
+			}
+			else if (asset[a].nIndices == 0)
+				asset[a].nIndices = passedNIndices[i];
+			else if (passedNIndices[i] != 0 && asset[a].nIndices != passedNIndices[i])
+			{
+				printf("AssetLoader error: %s listed with %d and %d indices\n",
+					passedModelFile[i], asset[a].nIndices, passedNIndices[i]);
+				exit(EXIT_FAILURE);
+			}
+			modelAsset[i] = a;
+		}
+	}
+
+	~AssetLoader()
+	{
+		wait();
+		for (int i = 0; i < nAssets; i++)
+			free(asset[i].data);
+		delete[] modelAsset;
+	}
+
+	// Starts parsing, and building the BVHs of archive assets, on the worker threads and returns immediately.
+	void start()
+	{
+		nWorkers = std::thread::hardware_concurrency();
+		if (nWorkers > nAssets)
+			nWorkers = nAssets;
+		if (nWorkers < 1)
+			return;
+
+		worker = new std::thread[nWorkers];
+		for (int i = 0; i < nWorkers; i++)
+			worker[i] = std::thread(&AssetLoader::parseAssets, this);
+	}
+
+	// Blocks until every asset has been parsed.
+	void wait()
+	{
+		for (int i = 0; i < nWorkers; i++)
+			worker[i].join();
+		delete[] worker;
+		worker = NULL;
+		nWorkers = 0;
+	}
+
+	/* Uploads every parsed asset into the shared vbo and ibo and sets up vao, on the GL context thread.
+	Draw a model's levels of detail with the index ranges getLodChain(model) returns offset by
+	getFirstIndex(model), vertex indices offset by getBaseVertex(model) and its model matrix
+	scaled by getPositionScale(model). Assets that failed to parse are left out.
+	Returns the number of assets uploaded.
+	*/
+	int upload(GLuint vao, GLuint vbo, GLuint ibo, GLuint shaderProgram,
+		GLuint vPosition, GLuint vColor, GLuint vNormal,
+		char * shaderVertex, char * shaderColor, char * shaderNormal)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		long long nVertices = 0, nIndices = 0;
+		int nUploaded = 0;
+
+		// Lay the assets out one after the other
+		for (int i = 0; i < nAssets; i++)
+		{
+			if (asset[i].boundingRadius == -1.0f)
+				continue;
+			asset[i].baseVertex = (int)nVertices;
+			asset[i].firstIndex = (int)nIndices;
+			nVertices += asset[i].nVertices;
+			nIndices += triLodChainIndices(&asset[i].lod);
+		}
+
+		// The element buffer binding is vao state, so bind the vao first
+		glBindVertexArray(vao);
+		glBindBuffer(GL_ARRAY_BUFFER, vbo);
+		glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)triArchiveVertexSize(vertexFormat, (unsigned int)nVertices), NULL, GL_STATIC_DRAW);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr)(nIndices * sizeof(unsigned int)), NULL, GL_STATIC_DRAW);
+		setPackedModelAttributes(vertexFormat, vao, vbo, ibo, shaderProgram, vPosition, vColor, vNormal,
+			shaderVertex, shaderColor, shaderNormal);
+		double layoutTime = millisecondsSince(start);
+
+		for (int i = 0; i < nAssets; i++)
+		{
+			Asset * a = &asset[i];
+			if (a->boundingRadius == -1.0f)
+				continue;
+
+			start = std::chrono::steady_clock::now();
+			const unsigned char * data = a->archiveEntry != NULL ? archive->base + a->archiveEntry->offset : a->data;
+			GLsizeiptr vertexSize = (GLsizeiptr)triArchiveVertexSize(vertexFormat, a->nVertices);
+			glBufferSubData(GL_ARRAY_BUFFER, (GLintptr)triArchiveVertexSize(vertexFormat, a->baseVertex), vertexSize, data);
+			glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, (GLintptr)a->firstIndex * sizeof(unsigned int),
+				triLodChainIndices(&a->lod) * sizeof(unsigned int), data + vertexSize);
+
+			// The GL has its own copy now
+			free(a->data);
+			a->data = NULL;
+			a->uploadTime += millisecondsSince(start) + layoutTime / nAssets;
+			nUploaded++;
+		}
+		glBindVertexArray(0);
+
+		return nUploaded;
+	}
+
+	// Returns the bounding radius of model or -1.0f if it couldn't be parsed.
+	float getBoundingRadius(int model)
+	{
+		return asset[modelAsset[model]].boundingRadius;
+	}
+
+	// Returns the model matrix scale of model's quantized positions, see packTriModel() in triMesh465.hpp.
+	float getPositionScale(int model)
+	{
+		return asset[modelAsset[model]].positionScale;
+	}
+
+	// Returns the first vertex of model in the shared vbo, valid once uploaded.
+	int getBaseVertex(int model)
+	{
+		return asset[modelAsset[model]].baseVertex;
+	}
+
+	// Returns the first index of model in the shared ibo, valid once uploaded.
+	int getFirstIndex(int model)
+	{
+		return asset[modelAsset[model]].firstIndex;
+	}
+
+	// Returns the number of distinct model files, the meshes the scene's models share.
+	int getAssetCount()
+	{
+		return nAssets;
+	}
+
+	// Returns the index of model's asset, models with the same asset are the same mesh.
+	int getAsset(int model)
+	{
+		return modelAsset[model];
+	}
+
+	// Returns the index ranges of model's levels of detail, valid once it has been parsed.
+	const TriLodChain * getLodChain(int model)
+	{
+		return &asset[modelAsset[model]].lod;
+	}
+
+	// Returns model's collision BVH and exact bounds, valid once it has been parsed.
+	const TriBvh * getBvh(int model)
+	{
+		return &asset[modelAsset[model]].bvh;
+	}
+
+	// Prints the parse and upload time and vertex cache miss ratio of every distinct asset.
+	void printTimings()
+	{
+		double parseTotal = 0.0, uploadTotal = 0.0;
+
+		long long vboBytes = 0, planarBytes = 0;
+
+		printf("%-24s %8s %8s %14s %10s %10s %s\n", "asset", "indices", "vertices", "ACMR",
+			"parse ms", "upload ms", "source");
+		for (int i = 0; i < nAssets; i++)
+		{
+			printf("%-24s %8d %8d %6.3f > %5.3f %10.3f %10.3f %s\n", asset[i].fileName, asset[i].nIndices,
+				asset[i].nVertices, asset[i].acmrWelded, asset[i].acmrOptimized,
+				asset[i].parseTime, asset[i].uploadTime, asset[i].archiveEntry != NULL ? "archive" : "tri");
+			parseTotal += asset[i].parseTime;
+			uploadTotal += asset[i].uploadTime;
+			vboBytes += (long long)triArchiveVertexSize(vertexFormat, asset[i].nVertices);
+			if (asset[i].lod.nLods > 0)
+			{
+				printf("%-24s LOD triangles (error)", "");
+				for (unsigned int l = 0; l < asset[i].lod.nLods; l++)
+					printf(" %d (%.2f)", asset[i].lod.count[l] / 3, asset[i].lod.error[l]);
+				printf("\n");
+			}
+			planarBytes += (long long)asset[i].nVertices * (2 * sizeof(glm::vec4) + sizeof(glm::vec3));
+		}
+		printf("%-24s %8s %8s %14s %10.3f %10.3f\n", "total", "", "", "", parseTotal, uploadTotal);
+		printf("%s vertices: %lld vbo bytes, %lld as planar vec4, vec4, vec3\n",
+			vertexFormat == TRI_VERTEX_QUANTIZED ? "quantized" : "float", vboBytes, planarBytes);
+	}
+};
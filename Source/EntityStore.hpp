@@ -0,0 +1,467 @@
+/*
+File: EntityStore.hpp
+
+Description: The simulation's entities as dense arrays of components. An
+entity is a number from create(); every entity has a Transform, stored at
+its number, and any entity may have a Kinematics, Pilot, MissileState,
+Collider or Shape, each kept in a ComponentArray: the components packed at the
+front of one array, and two index maps between entity and slot. A system
+walks the slots of the one or two arrays it needs from first to last, so a
+tick over many entities streams through memory instead of chasing objects.
+Removing a component moves the array's last one into its slot.
+
+A Transform is a unit quaternion and a position, not a matrix: composing
+two costs 16 multiplies instead of 64, and a quaternion renormalized every
+TRANSFORM_RENORMALIZE ticks stays a pure rotation however long the
+simulation runs, where accumulated matrices slowly skew and scale. The
+scaled model matrix is only expanded by getModelMatrix(), for drawing.
+
+Entities form a hierarchy: any entity may have a parent, and its local
+Pose is relative to its parent's, or to the world for a root. Systems set
+local poses, which marks them dirty, and updateWorld() sets the Transforms
+of the dirty entities and everything below them, walking an order that
+puts every parent before its children. An entity that doesn't move, and
+whose parent doesn't, costs one test a pass.
+
+Kinematics holds the rotation and translation a body accumulates. Orbiting
+bodies' rotation turns their translation about their parent, every other
+body turns about its own center. updateKinematics() turns each body by its
+turn and sets its local pose; the Pilot and missile systems (Warbird.hpp,
+Missile.hpp) steer their entities.
+
+An EntityHandle names an entity as it is now: retire() gives the entity a
+new generation when it is destroyed, so a handle kept from before, say a
+missile's target, no longer matches it, even once the entity is reused.
+
+Entity is a handle on one entity, the base of Warbird.
+*/
+
+# ifndef __INCLUDES465__
+# include "../includes465/include465.hpp"
+# define __INCLUDES465__
+# endif
+
+# include <glm/gtc/quaternion.hpp>
+
+# define TRANSFORM_RENORMALIZE 64	// ticks between renormalizing the rotations
+
+// reference vector oriented - depth, of a rotation
+glm::vec3 getIn(const glm::quat &q)
+{
+	return q * glm::vec3(0.0f, 0.0f, -1.0f);
+}
+
+// Dense components of type T of up to maxEntities entities, addressed by entity
+template <class T> class ComponentArray
+{
+
+protected:
+
+	T * data;			// count components, in no particular order
+	int * owner;		// entity of each slot
+	int * slot;			// slot of each entity, -1 if it has no component
+	int count;
+
+public:
+
+	ComponentArray(int maxEntities)
+	{
+		data = new T[maxEntities];
+		owner = new int[maxEntities];
+		slot = new int[maxEntities];
+		for (int e = 0; e < maxEntities; e++)
+			slot[e] = -1;
+		count = 0;
+	}
+
+	~ComponentArray()
+	{
+		delete[] data;
+		delete[] owner;
+		delete[] slot;
+	}
+
+	// Gives entity a default component, or returns the one it has.
+	T * add(int entity)
+	{
+		if (slot[entity] < 0)
+		{
+			slot[entity] = count;
+			owner[count] = entity;
+			data[count++] = T();
+		}
+		return &data[slot[entity]];
+	}
+
+	// Removes entity's component, the last one takes its slot.
+	void remove(int entity)
+	{
+		int s = slot[entity];
+		if (s < 0)
+			return;
+		count--;
+		data[s] = data[count];
+		owner[s] = owner[count];
+		slot[owner[s]] = s;
+		slot[entity] = -1;
+	}
+
+	// Returns entity's component, NULL if it has none. Valid until a component is added or removed.
+	T * get(int entity)
+	{
+		return slot[entity] < 0 ? NULL : &data[slot[entity]];
+	}
+
+	int getCount()
+	{
+		return count;
+	}
+
+	// The component in slot s, for systems walking the array
+	T & at(int s)
+	{
+		return data[s];
+	}
+
+	// The entity whose component is in slot s
+	int getEntity(int s)
+	{
+		return owner[s];
+	}
+};
+
+// An entity and its generation when the handle was taken, see EntityStore::isLive()
+struct EntityHandle
+{
+	int entity;				// -1 for no entity
+	unsigned int generation;
+};
+
+const EntityHandle noEntity = { -1, 0 };
+
+// A rotation, then a position
+struct Pose
+{
+	glm::quat rotation;
+	glm::vec3 position;
+};
+
+// Where an entity is in the world: its rotation, then its position, and its uniform model scale
+struct Transform
+{
+	glm::quat rotation;
+	glm::vec3 position;
+	float scale;
+};
+
+// A body's accumulated rotation and translation, the rotation turned by turn each tick
+struct Kinematics
+{
+	glm::quat rotation;
+	glm::vec3 translation;
+	glm::quat turn;
+	bool orbit;			// the rotation turns the translation about the origin
+};
+
+// A ship steered by keys, see Warbird.hpp
+struct Pilot
+{
+	glm::vec3 start;	// where restart() puts it
+	float speed;		// distance a move key travels
+	float turnRate;		// radians a turn key turns, about the axis of the keys held
+	int step;			// this tick's move: 1, -1 or 0
+	int pitch, yaw, roll;	// this tick's turn about each axis: 1, -1 or 0
+	bool alive;
+};
+
+// A missile in flight, see Missile.hpp
+struct MissileState
+{
+	EntityHandle target;	// what it homes on once smart, if it is still live
+	glm::vec3 previousPosition;	// before the last tick, the start of its swept segment
+	float speed;
+	int launcher;		// entity that fired it
+	int age;			// ticks since it was fired
+	bool smart;
+};
+
+// Bounding sphere radius in world units
+struct Collider
+{
+	float radius;
+};
+
+// The model an entity is drawn and collided as, only entities with a Shape are drawn
+struct Shape
+{
+	int model;
+};
+
+class EntityStore
+{
+
+protected:
+
+	int nEntities, maxEntities;
+	int ticks;			// since the last renormalize()
+	int * parent;		// of each entity, -1 for a root
+	int * order;		// the entities, every parent before its children
+	bool * dirty;		// the local pose changed since updateWorld()
+	int * placed;		// the updateWorld() pass that last set the entity's Transform
+	int pass;
+	unsigned int * generation;	// of each entity, changed by retire()
+
+	// Sorts order by depth in the hierarchy, so every parent comes before its children.
+	void sortHierarchy()
+	{
+		int * depth = new int[nEntities];
+		int maxDepth = 0;
+		for (int e = 0; e < nEntities; e++)
+		{
+			depth[e] = 0;
+			for (int p = parent[e]; p >= 0; p = parent[p])
+				depth[e]++;
+			maxDepth = glm::max(maxDepth, depth[e]);
+		}
+		int n = 0;
+		for (int d = 0; d <= maxDepth; d++)
+			for (int e = 0; e < nEntities; e++)
+				if (depth[e] == d)
+					order[n++] = e;
+		delete[] depth;
+	}
+
+public:
+
+	Transform * transform;	// of every entity, at its number
+	Pose * local;			// of every entity relative to its parent, at its number
+	ComponentArray<Kinematics> kinematics;
+	ComponentArray<Pilot> pilot;
+	ComponentArray<MissileState> missile;
+	ComponentArray<Collider> collider;
+	ComponentArray<Shape> shape;
+
+	// Constructor, for up to passedMaxEntities entities
+	EntityStore(int passedMaxEntities)
+		: kinematics(passedMaxEntities), pilot(passedMaxEntities), missile(passedMaxEntities), collider(passedMaxEntities),
+		shape(passedMaxEntities)
+	{
+		maxEntities = passedMaxEntities;
+		nEntities = 0;
+		ticks = 0;
+		pass = 0;
+		transform = new Transform[maxEntities];
+		local = new Pose[maxEntities];
+		parent = new int[maxEntities];
+		order = new int[maxEntities];
+		dirty = new bool[maxEntities];
+		placed = new int[maxEntities];
+		generation = new unsigned int[maxEntities];
+	}
+
+	~EntityStore()
+	{
+		delete[] transform;
+		delete[] local;
+		delete[] parent;
+		delete[] order;
+		delete[] dirty;
+		delete[] placed;
+		delete[] generation;
+	}
+
+	// Creates a root entity at the origin drawn at scale, returns its number or -1 if the store is full.
+	int create(float scale)
+	{
+		if (nEntities == maxEntities)
+			return -1;
+		int e = nEntities++;
+		transform[e].rotation = local[e].rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+		transform[e].position = local[e].position = glm::vec3(0.0f);
+		transform[e].scale = scale;
+		parent[e] = -1;
+		order[e] = e;	// a new entity has no children yet
+		dirty[e] = false;
+		placed[e] = -1;
+		generation[e] = 0;
+		return e;
+	}
+
+	int getMaxCount()
+	{
+		return maxEntities;
+	}
+
+	// A handle on the entity as it is now
+	EntityHandle getHandle(int entity)
+	{
+		EntityHandle handle = { entity, generation[entity] };
+		return handle;
+	}
+
+	// Whether the handle's entity hasn't been retired since the handle was taken
+	bool isLive(EntityHandle handle)
+	{
+		return handle.entity >= 0 && generation[handle.entity] == handle.generation;
+	}
+
+	// Marks the entity destroyed, its handles are no longer live.
+	void retire(int entity)
+	{
+		generation[entity]++;
+	}
+
+	/* Makes passedParent, or the world if it is -1, entity's parent; its local pose is then
+	relative to passedParent's. Returns false, changing nothing, if passedParent is below entity.
+	*/
+	bool setParent(int entity, int passedParent)
+	{
+		for (int p = passedParent; p >= 0; p = parent[p])
+			if (p == entity)
+				return false;
+		parent[entity] = passedParent;
+		dirty[entity] = true;
+		sortHierarchy();
+		return true;
+	}
+
+	int getParent(int entity)
+	{
+		return parent[entity];
+	}
+
+	// Sets the entity's pose relative to its parent, for the next updateWorld().
+	void setLocal(int entity, glm::vec3 position, glm::quat rotation)
+	{
+		local[entity].position = position;
+		local[entity].rotation = rotation;
+		dirty[entity] = true;
+	}
+
+	/* Sets the Transform of every entity whose local pose or parent's Transform changed
+	since the last pass, parents first.
+	*/
+	void updateWorld()
+	{
+		pass++;
+		for (int i = 0; i < nEntities; i++)
+		{
+			int e = order[i], p = parent[e];
+			if (!dirty[e] && (p < 0 || placed[p] != pass))
+				continue;
+			if (p < 0)
+			{
+				transform[e].rotation = local[e].rotation;
+				transform[e].position = local[e].position;
+			}
+			else
+			{
+				transform[e].rotation = transform[p].rotation * local[e].rotation;
+				transform[e].position = transform[p].position + transform[p].rotation * local[e].position;
+			}
+			dirty[e] = false;
+			placed[e] = pass;
+		}
+	}
+
+	int getCount()
+	{
+		return nEntities;
+	}
+
+	// The entity's world matrix times its scale, for drawing
+	glm::mat4 getModelMatrix(int entity)
+	{
+		const Transform & t = transform[entity];
+		glm::mat4 model = glm::mat4_cast(t.rotation) * t.scale;
+		model[3] = glm::vec4(t.position, 1.0f);
+		return model;
+	}
+
+	// A world point in the entity's model coordinates, the inverse of its model matrix
+	glm::vec3 toModel(int entity, glm::vec3 point)
+	{
+		const Transform & t = transform[entity];
+		return glm::conjugate(t.rotation) * (point - t.position) / t.scale;
+	}
+
+	// A point in the entity's unscaled coordinates in the world, as of the last updateWorld()
+	glm::vec3 toWorld(int entity, glm::vec3 point)
+	{
+		return transform[entity].position + transform[entity].rotation * point;
+	}
+
+	// Turns every body by its turn and sets its local pose from its rotation and translation, if they moved.
+	void updateKinematics()
+	{
+		for (int s = 0; s < kinematics.getCount(); s++)
+		{
+			Kinematics & k = kinematics.at(s);
+			int e = kinematics.getEntity(s);
+			k.rotation = k.rotation * k.turn;
+			glm::vec3 position = k.orbit ? k.rotation * k.translation : k.translation;
+			const glm::quat & r = local[e].rotation;
+			if (k.rotation.w != r.w || k.rotation.x != r.x || k.rotation.y != r.y || k.rotation.z != r.z
+				|| position != local[e].position)
+				setLocal(e, position, k.rotation);
+		}
+		if (++ticks == TRANSFORM_RENORMALIZE)
+			renormalize();
+	}
+
+	/* Scales every accumulated rotation back to unit length, undoing the rounding the products
+	gathered. A Transform is a product of a few local rotations, so it doesn't drift.
+	*/
+	void renormalize()
+	{
+		for (int s = 0; s < kinematics.getCount(); s++)
+			kinematics.at(s).rotation = glm::normalize(kinematics.at(s).rotation);
+		for (int e = 0; e < nEntities; e++)
+			local[e].rotation = glm::normalize(local[e].rotation);
+		ticks = 0;
+	}
+};
+
+// A handle on one entity of a store
+class Entity
+{
+
+protected:
+
+	EntityStore * store;
+	int entity;
+
+public:
+
+	Entity(EntityStore * passedStore, int passedEntity)
+	{
+		store = passedStore;
+		entity = passedEntity;
+	}
+
+	int getEntity()
+	{
+		return entity;
+	}
+
+	glm::vec3 getPosition()
+	{
+		return store->transform[entity].position;
+	}
+
+	glm::quat getRotation()
+	{
+		return store->transform[entity].rotation;
+	}
+
+	// Puts the entity at newPosition turned by newRotation relative to its parent, from the next updateWorld()
+	void place(glm::vec3 newPosition, glm::quat newRotation)
+	{
+		store->setLocal(entity, newPosition, newRotation);
+	}
+
+	glm::mat4 getModelMatrix()
+	{
+		return store->getModelMatrix(entity);
+	}
+};
@@ -0,0 +1,324 @@
+/*
+File: FrameCapture.hpp
+
+Description: Records the rendered frames to a video file without stalling
+the render loop on glReadPixels. Each frame is read into the next of
+FRAME_CAPTURE_PBOS pixel buffer objects (GL_PIXEL_PACK_BUFFER) with a fence
+after it, so the read is queued with the frame's draws and returns at once.
+A PBO is mapped only once its fence has signaled, a few frames later, and
+its pixels are copied into a spare frame of a small pool and handed to a
+writer thread, which flips, converts and writes them. The render thread
+never waits for the disk: if the writer falls behind and no spare frame is
+left, the frame is dropped and counted, unless the capture was started to
+keep every frame, as the headless build does where no frame is late.
+
+A file name ending in ".y4m" is written as YUV4MPEG2 (4:2:0, full range
+BT.601 "C420jpeg"), which ffmpeg and most players read directly; anything
+else is written as raw top-down RGB frames, one after the other.
+
+The frame size is fixed when capture starts, a window resized while
+capturing stops the capture. finish() collects the frames still in flight
+when a GL context is current, and closes the file.
+*/
+
+# ifndef __INCLUDES465__
+# include "../includes465/include465.hpp"
+# define __INCLUDES465__
+# endif
+
+# include <thread>
+# include <mutex>
+# include <condition_variable>
+# include <vector>
+# include <string.h>
+
+# define FRAME_CAPTURE_PBOS 3		// frames read back before the oldest is mapped
+# define FRAME_CAPTURE_POOL 8		// frames copied out and waiting for the writer
+
+class FrameCapture
+{
+
+protected:
+
+	FILE * file;
+	bool y4m;						// YUV4MPEG2, otherwise raw RGB
+	int width, height;
+	GLsizeiptr frameBytes;			// RGBA bytes of a frame
+	GLuint pbo[FRAME_CAPTURE_PBOS];
+	GLsync fence[FRAME_CAPTURE_PBOS];	// set after each PBO's read, 0 if it holds no frame
+	int next;						// PBO the next frame is read into
+	bool capturing;
+
+	// Writer thread and its frames, guarded by mutex
+	std::thread * writer;
+	std::mutex mutex;
+	std::condition_variable ready;		// a frame was queued or stopping set
+	std::condition_variable freed;		// a frame was written and is spare again
+	std::vector<unsigned char *> spare;	// frames free to copy into
+	std::vector<unsigned char *> queued;	// frames waiting to be written, oldest first
+	bool stopping;
+	bool keepEvery;					// wait for a spare frame instead of dropping one
+
+	unsigned char * row;			// the writer's converted output, a frame's worth
+	int written, dropped, stalls;
+
+	// Maps PBO p, copies its frame to a spare frame and queues it for the writer.
+	void collect(int p)
+	{
+		unsigned char * frame = NULL;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			if (keepEvery)
+				freed.wait(lock, [this] { return !spare.empty(); });
+			if (!spare.empty())
+			{
+				frame = spare.back();
+				spare.pop_back();
+			}
+		}
+		if (frame == NULL)
+			dropped++;
+		else
+		{
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[p]);
+			void * pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, frameBytes, GL_MAP_READ_BIT);
+			if (pixels != NULL)
+				memcpy(frame, pixels, frameBytes);
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+			std::lock_guard<std::mutex> lock(mutex);
+			if (pixels != NULL)
+				queued.push_back(frame);
+			else
+			{
+				spare.push_back(frame);
+				dropped++;
+			}
+		}
+		if (frame != NULL)
+			ready.notify_one();
+		glDeleteSync(fence[p]);
+		fence[p] = 0;
+	}
+
+	// Writes one bottom-up RGBA frame to the file.
+	void writeFrame(const unsigned char * rgba)
+	{
+		if (y4m)
+		{
+			int chromaWidth = (width + 1) / 2, chromaHeight = (height + 1) / 2;
+			unsigned char * y = row, * u = row + width * height, * v = u + chromaWidth * chromaHeight;
+			for (int r = 0; r < height; r++)
+			{
+				const unsigned char * in = rgba + (height - 1 - r) * width * 4;	// GL rows start at the bottom
+				for (int c = 0; c < width; c++, in += 4)
+					y[r * width + c] = (unsigned char)((77 * in[0] + 150 * in[1] + 29 * in[2] + 128) >> 8);
+			}
+			for (int r = 0; r < chromaHeight; r++)
+			{
+				// average each 2 x 2 block, the last row and column repeat at an odd edge
+				const unsigned char * upper = rgba + (height - 1 - 2 * r) * width * 4;
+				const unsigned char * lower = 2 * r + 1 < height ? upper - width * 4 : upper;
+				for (int c = 0; c < chromaWidth; c++)
+				{
+					int right = 2 * c + 1 < width ? 4 : 0;
+					const unsigned char * a = upper + 8 * c, * b = lower + 8 * c;
+					int red = a[0] + a[right] + b[0] + b[right];
+					int green = a[1] + a[right + 1] + b[1] + b[right + 1];
+					int blue = a[2] + a[right + 2] + b[2] + b[right + 2];
+					u[r * chromaWidth + c] = (unsigned char)glm::clamp(((-43 * red - 85 * green + 128 * blue + 512) >> 10) + 128, 0, 255);
+					v[r * chromaWidth + c] = (unsigned char)glm::clamp(((128 * red - 107 * green - 21 * blue + 512) >> 10) + 128, 0, 255);
+				}
+			}
+			fputs("FRAME\n", file);
+			fwrite(row, width * height + 2 * chromaWidth * chromaHeight, 1, file);
+		}
+		else
+		{
+			for (int r = 0; r < height; r++)
+			{
+				const unsigned char * in = rgba + (height - 1 - r) * width * 4;
+				for (int c = 0; c < width; c++, in += 4)
+					memcpy(row + 3 * (r * width + c), in, 3);
+			}
+			fwrite(row, 3 * width * height, 1, file);
+		}
+	}
+
+	// The writer thread: writes queued frames until finish() stops it and the queue is empty.
+	void write()
+	{
+		for (;;)
+		{
+			unsigned char * frame;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				ready.wait(lock, [this] { return stopping || !queued.empty(); });
+				if (queued.empty())
+					return;
+				frame = queued.front();
+				queued.erase(queued.begin());
+			}
+			writeFrame(frame);
+			written++;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				spare.push_back(frame);
+			}
+			freed.notify_one();
+		}
+	}
+
+public:
+
+	// Constructor, nothing is captured until start()
+	FrameCapture()
+	{
+		file = NULL;
+		writer = NULL;
+		row = NULL;
+		capturing = false;
+		stopping = false;
+		keepEvery = false;
+		next = 0;
+		written = dropped = stalls = 0;
+		for (int p = 0; p < FRAME_CAPTURE_PBOS; p++)
+		{
+			pbo[p] = 0;
+			fence[p] = 0;
+		}
+	}
+
+	~FrameCapture()
+	{
+		finish(false);
+	}
+
+	/* Starts capturing passedWidth x passedHeight frames at framesPerSecond to fileName,
+	returns false with a message if the file can't be created. With passedKeepEvery capture()
+	waits for the writer when it falls behind, rather than dropping frames.
+	*/
+	bool start(const char * fileName, int passedWidth, int passedHeight, int framesPerSecond, bool passedKeepEvery)
+	{
+		size_t length = strlen(fileName);
+		file = fopen(fileName, "wb");
+		if (file == NULL)
+		{
+			printf("FrameCapture: can't create %s\n", fileName);
+			return false;
+		}
+		y4m = length >= 4 && strcmp(fileName + length - 4, ".y4m") == 0;
+		width = passedWidth;
+		height = passedHeight;
+		frameBytes = (GLsizeiptr)width * height * 4;
+		if (y4m)
+			fprintf(file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", width, height, framesPerSecond);
+
+		glGenBuffers(FRAME_CAPTURE_PBOS, pbo);
+		for (int p = 0; p < FRAME_CAPTURE_PBOS; p++)
+		{
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[p]);
+			glBufferData(GL_PIXEL_PACK_BUFFER, frameBytes, NULL, GL_STREAM_READ);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		for (int f = 0; f < FRAME_CAPTURE_POOL; f++)
+			spare.push_back(new unsigned char[frameBytes]);
+		row = new unsigned char[3 * width * height];
+		stopping = false;
+		keepEvery = passedKeepEvery;
+		writer = new std::thread(&FrameCapture::write, this);
+		capturing = true;
+		printf("FrameCapture: %d x %d %s to %s\n", width, height, y4m ? "Y4M" : "raw RGB", fileName);
+		return true;
+	}
+
+	/* Reads the frame just drawn (the read buffer, width x height at the origin) into the next
+	PBO, after collecting every earlier frame whose read has finished. Call before the swap.
+	*/
+	void capture(int frameWidth, int frameHeight)
+	{
+		if (!capturing)
+			return;
+		if (frameWidth != width || frameHeight != height)
+		{
+			printf("FrameCapture: the window was resized, capture stopped\n");
+			finish(true);
+			return;
+		}
+
+		// Collect the finished reads, oldest (the next PBO's) first; the next PBO must be free even if its read isn't done
+		for (int i = 0; i < FRAME_CAPTURE_PBOS; i++)
+		{
+			int p = (next + i) % FRAME_CAPTURE_PBOS;
+			if (fence[p] == 0)
+				continue;
+			GLenum status = glClientWaitSync(fence[p], 0, 0);
+			if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED && p == next)
+			{
+				stalls++;
+				status = glClientWaitSync(fence[p], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+			}
+			if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED)
+				collect(p);
+			else if (p != next)
+				break;	// later reads can't be done before this one
+			else
+			{
+				glDeleteSync(fence[p]);	// the read failed, its PBO is read into again
+				fence[p] = 0;
+				dropped++;
+			}
+		}
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[next]);
+		glPixelStorei(GL_PACK_ALIGNMENT, 4);
+		glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, (GLvoid *)0);	// into the bound PBO
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		fence[next] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		next = (next + 1) % FRAME_CAPTURE_PBOS;
+	}
+
+	/* Stops capturing: with collect, and the GL context current, waits for and writes the frames
+	still being read back, otherwise they are lost. Then writes the queued frames and closes the file.
+	*/
+	void finish(bool collect)
+	{
+		if (!capturing)
+			return;
+		capturing = false;
+		for (int i = 0; i < FRAME_CAPTURE_PBOS; i++)
+		{
+			int p = (next + i) % FRAME_CAPTURE_PBOS;
+			if (fence[p] == 0)
+				continue;
+			if (collect && glClientWaitSync(fence[p], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) != GL_TIMEOUT_EXPIRED)
+				this->collect(p);
+			else
+				dropped++;
+		}
+		if (collect)
+			glDeleteBuffers(FRAME_CAPTURE_PBOS, pbo);
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		ready.notify_one();
+		writer->join();
+		delete writer;
+		writer = NULL;
+		fclose(file);
+		file = NULL;
+		for (size_t f = 0; f < spare.size(); f++)
+			delete[] spare[f];
+		spare.clear();
+		delete[] row;
+		row = NULL;
+		printf("FrameCapture: %d frames written, %d dropped, %d waits for a read\n", written, dropped, stalls);
+	}
+
+	bool isCapturing()
+	{
+		return capturing;
+	}
+};
@@ -0,0 +1,152 @@
+/*
+File: FrameRing.hpp
+
+Description: A buffer the CPU writes each frame's per frame data into, the
+camera and light uniform blocks and the per instance model matrices, without waiting
+on the GPU. The buffer is split into FRAME_RING_REGIONS regions used in
+turn; a glFenceSync placed after a frame's draws guards its region, so the
+CPU only blocks in begin() if it gets a whole ring ahead of the GPU.
+
+With GL 4.4 or ARB_buffer_storage the buffer is created with glBufferStorage
+and mapped once, persistently and coherently, so writing a frame is a plain
+memcpy. Without it (GL 3.3, and Mac OS X stops at 4.1) each region is mapped
+with glMapBufferRange(GL_MAP_UNSYNCHRONIZED_BIT) for the frame and unmapped
+before the draws; the fences keep that safe the same way.
+
+Every region starts on a GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT boundary so
+glBindBufferRange can bind a uniform block at its start.
+*/
+
+# ifndef __INCLUDES465__
+# include "../includes465/include465.hpp"
+# define __INCLUDES465__
+# endif
+
+# define FRAME_RING_REGIONS 3
+
+class FrameRing
+{
+
+protected:
+
+	GLuint buffer;
+	GLsizeiptr regionSize;		// bytes per region, a multiple of the uniform buffer alignment
+	bool persistent;			// mapped once with glBufferStorage
+	unsigned char * mapping;	// the whole persistent mapping, or the current region's while mapped
+	GLsync fence[FRAME_RING_REGIONS];	// set after the draws that read each region
+	int region;					// region of the current frame
+	int stalls;					// begin() calls that had to wait for the GPU
+
+public:
+
+	/* Constructor, for up to passedRegionSize bytes a frame.
+	allowPersistent false uses the glMapBufferRange path even where glBufferStorage exists.
+	*/
+	FrameRing(GLsizeiptr passedRegionSize, bool allowPersistent)
+	{
+		GLint alignment = 256;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		regionSize = (passedRegionSize + alignment - 1) / alignment * alignment;
+		persistent = allowPersistent && (GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage);
+		mapping = NULL;
+		region = 0;
+		stalls = 0;
+		for (int i = 0; i < FRAME_RING_REGIONS; i++)
+			fence[i] = 0;
+
+		glGenBuffers(1, &buffer);
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		if (persistent)
+		{
+			GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			glBufferStorage(GL_ARRAY_BUFFER, FRAME_RING_REGIONS * regionSize, NULL, flags);
+			mapping = (unsigned char *)glMapBufferRange(GL_ARRAY_BUFFER, 0, FRAME_RING_REGIONS * regionSize, flags);
+			if (mapping == NULL)
+			{
+				// Some drivers advertise buffer storage but refuse the mapping, fall back
+				printf("FrameRing: persistent mapping failed, mapping each frame\n");
+				glDeleteBuffers(1, &buffer);
+				glGenBuffers(1, &buffer);
+				glBindBuffer(GL_ARRAY_BUFFER, buffer);
+				persistent = false;
+			}
+		}
+		if (!persistent)
+			glBufferData(GL_ARRAY_BUFFER, FRAME_RING_REGIONS * regionSize, NULL, GL_STREAM_DRAW);
+		printf("FrameRing: %d x %ld bytes, %s\n", FRAME_RING_REGIONS, (long)regionSize,
+			persistent ? "persistently mapped" : "mapped each frame");
+	}
+
+	~FrameRing()
+	{
+		for (int i = 0; i < FRAME_RING_REGIONS; i++)
+			if (fence[i] != 0)
+				glDeleteSync(fence[i]);
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		if (persistent || mapping != NULL)
+			glUnmapBuffer(GL_ARRAY_BUFFER);
+		glDeleteBuffers(1, &buffer);
+	}
+
+	/* Starts a frame in the next region and returns where to write it, regionSize bytes.
+	Waits only if the GPU is still reading the region from FRAME_RING_REGIONS frames ago.
+	*/
+	void * begin()
+	{
+		region = (region + 1) % FRAME_RING_REGIONS;
+		if (fence[region] != 0)
+		{
+			GLenum status = glClientWaitSync(fence[region], 0, 0);
+			if (status == GL_TIMEOUT_EXPIRED)
+			{
+				stalls++;
+				do
+					status = glClientWaitSync(fence[region], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);	// 1 ms
+				while (status == GL_TIMEOUT_EXPIRED);
+			}
+			glDeleteSync(fence[region]);
+			fence[region] = 0;
+		}
+
+		if (persistent)
+			return mapping + region * regionSize;
+
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		mapping = (unsigned char *)glMapBufferRange(GL_ARRAY_BUFFER, region * regionSize, regionSize,
+			GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+		return mapping;
+	}
+
+	// Ends the CPU's writes, call before the draws that read the region.
+	void flush()
+	{
+		if (persistent)
+			return;	// coherent, the writes are visible to the next draw
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+		mapping = NULL;
+	}
+
+	// Ends the frame, call after the last draw that reads the region.
+	void end()
+	{
+		fence[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+
+	GLuint getBuffer()
+	{
+		return buffer;
+	}
+
+	// Returns the byte offset of the current frame's region in the buffer.
+	GLintptr getOffset()
+	{
+		return region * regionSize;
+	}
+
+	// Returns how many frames had to wait for the GPU to finish with their region.
+	int getStalls()
+	{
+		return stalls;
+	}
+};
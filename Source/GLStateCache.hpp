@@ -0,0 +1,178 @@
+/*
+File: GLStateCache.hpp
+
+Description: A shadow copy of the GL state display() changes, so a bind or
+enable that would set what is already set is dropped before it reaches the
+driver. The program, vertex array, draw indirect buffer, the 2D and cube
+map texture of each unit, depth test, depth function, depth writes and
+blending go through
+it; the counts of changes issued and avoided are kept per frame.
+
+Every change of shadowed state must go through the cache, or the cache must
+be told with invalidate(), after init() for one. GL_ARRAY_BUFFER is not
+shadowed: only uploads and vertex attribute setup bind it, and the FrameRing,
+PerfHud and the particle upload do so directly.
+*/
+
+# ifndef __INCLUDES465__
+# include "../includes465/include465.hpp"
+# define __INCLUDES465__
+# endif
+
+# define GL_STATE_TEXTURE_UNITS 4
+# define GL_STATE_UNKNOWN 0xFFFFFFFF	// shadowed value after invalidate(), never a GL name or enum
+
+class GLStateCache
+{
+
+protected:
+
+	GLuint program;
+	GLuint vao;
+	GLuint drawIndirectBuffer;
+	GLuint activeUnit;
+	GLuint texture2D[GL_STATE_TEXTURE_UNITS];
+	GLuint textureCube[GL_STATE_TEXTURE_UNITS];
+	GLuint depthTest, depthWrite, blend;	// GL_TRUE, GL_FALSE or GL_STATE_UNKNOWN
+	GLenum depthFunction;
+	GLenum blendSource, blendDestination;
+
+	int issued, avoided;				// changes of the current frame
+	int lastIssued, lastAvoided;		// of the last complete frame
+
+	// Counts a change, true if it must be issued.
+	bool change(GLuint & shadow, GLuint value)
+	{
+		if (shadow == value)
+		{
+			avoided++;
+			return false;
+		}
+		shadow = value;
+		issued++;
+		return true;
+	}
+
+	void activeTexture(GLuint unit)
+	{
+		if (change(activeUnit, unit))
+			glActiveTexture(GL_TEXTURE0 + unit);
+	}
+
+	void setCapability(GLenum capability, GLuint & shadow, bool on)
+	{
+		if (change(shadow, on ? GL_TRUE : GL_FALSE))
+		{
+			if (on)
+				glEnable(capability);
+			else
+				glDisable(capability);
+		}
+	}
+
+public:
+
+	// Constructor, nothing is known about the state yet
+	GLStateCache()
+	{
+		invalidate();
+		issued = avoided = lastIssued = lastAvoided = 0;
+	}
+
+	// Forgets every shadowed value, call after GL calls that changed state around the cache.
+	void invalidate()
+	{
+		program = vao = drawIndirectBuffer = activeUnit = GL_STATE_UNKNOWN;
+		for (int unit = 0; unit < GL_STATE_TEXTURE_UNITS; unit++)
+			texture2D[unit] = textureCube[unit] = GL_STATE_UNKNOWN;
+		depthTest = depthWrite = blend = GL_STATE_UNKNOWN;
+		depthFunction = blendSource = blendDestination = GL_STATE_UNKNOWN;
+	}
+
+	// Starts counting a new frame's changes.
+	void beginFrame()
+	{
+		lastIssued = issued;
+		lastAvoided = avoided;
+		issued = avoided = 0;
+	}
+
+	void useProgram(GLuint passedProgram)
+	{
+		if (change(program, passedProgram))
+			glUseProgram(passedProgram);
+	}
+
+	void bindVertexArray(GLuint passedVao)
+	{
+		if (change(vao, passedVao))
+			glBindVertexArray(passedVao);
+	}
+
+	void bindDrawIndirectBuffer(GLuint buffer)
+	{
+		if (change(drawIndirectBuffer, buffer))
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER, buffer);
+	}
+
+	// Binds passedTexture to target GL_TEXTURE_2D or GL_TEXTURE_CUBE_MAP of texture unit unit.
+	void bindTexture(GLuint unit, GLenum target, GLuint passedTexture)
+	{
+		GLuint & shadow = target == GL_TEXTURE_CUBE_MAP ? textureCube[unit] : texture2D[unit];
+		if (shadow == passedTexture)
+		{
+			avoided++;
+			return;
+		}
+		activeTexture(unit);
+		change(shadow, passedTexture);
+		glBindTexture(target, passedTexture);
+	}
+
+	void setDepthTest(bool on)
+	{
+		setCapability(GL_DEPTH_TEST, depthTest, on);
+	}
+
+	void depthFunc(GLenum function)
+	{
+		if (change(depthFunction, function))
+			glDepthFunc(function);
+	}
+
+	void setDepthMask(bool on)
+	{
+		if (change(depthWrite, on ? GL_TRUE : GL_FALSE))
+			glDepthMask(on ? GL_TRUE : GL_FALSE);
+	}
+
+	void setBlend(bool on)
+	{
+		setCapability(GL_BLEND, blend, on);
+	}
+
+	void blendFunc(GLenum source, GLenum destination)
+	{
+		if (blendSource == source && blendDestination == destination)
+		{
+			avoided++;
+			return;
+		}
+		blendSource = source;
+		blendDestination = destination;
+		issued++;
+		glBlendFunc(source, destination);
+	}
+
+	// Returns the state changes the last complete frame issued.
+	int getIssued()
+	{
+		return lastIssued;
+	}
+
+	// Returns the state changes the last complete frame dropped as redundant.
+	int getAvoided()
+	{
+		return lastAvoided;
+	}
+};
@@ -0,0 +1,17 @@
+/* 
+HudFragment.glsl
+
+Fragment shader for the performance HUD, the glyph atlas is a single
+channel coverage mask that scales the quad's alpha for blending.
+*/
+
+# version 330 core
+
+in vec2 texCoord;
+in vec4 color;
+uniform sampler2D Glyphs;
+out vec4 fragColor;
+
+void main() {
+  fragColor = vec4(color.rgb, color.a * texture(Glyphs, texCoord).r);
+  }
@@ -0,0 +1,23 @@
+/* 
+HudVertex.glsl
+
+Vertex shader for the performance HUD, see PerfHud.hpp.  Glyph and
+backdrop quads are given in window pixels from the top left, with their
+texture coordinates in the glyph atlas and their color.
+*/
+
+# version 330 core
+
+in vec2 vPosition;
+in vec2 vTexCoord;
+in vec4 vColor;
+uniform vec2 Viewport;   // window width and height in pixels
+
+out vec2 texCoord;
+out vec4 color;
+
+void main() {
+  texCoord = vTexCoord;
+  color = vColor;
+  gl_Position = vec4(2.0 * vPosition.x / Viewport.x - 1.0, 1.0 - 2.0 * vPosition.y / Viewport.y, 0.0, 1.0);
+  }
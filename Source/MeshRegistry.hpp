@@ -0,0 +1,262 @@
+/*
+File: MeshRegistry.hpp
+
+Description: Draws the entities of a frame from one shared VAO with one
+glMultiDrawElementsIndirect per shader program. Every distinct mesh (one
+AssetLoader asset) lives in the same VBO and IBO and is registered once with
+its base vertex, first index and levels of detail. During display() every
+entity queues its program, mesh, level, view distance and model matrix with
+add(); write() sorts their keys (see RenderQueue.hpp) by program and then
+front to back, copies the model matrices in that order straight into the
+frame's instance memory (a FrameRing region, see FrameRing.hpp) and writes
+one indirect draw command per run of instances of the same program, mesh and
+level next to them, and draw() submits them program by program through the
+GLStateCache.
+
+The programs are variants of one vertex shader (see loadShaderVariants() in
+shader465.hpp) with the same fixed attribute locations, so they share the VAO.
+
+The model matrices reach the vertex shader as a per instance mat4 attribute
+(glVertexAttribDivisor 1, four consecutive attribute locations). A command's
+baseInstance is the index of its group's first matrix, so the instanced
+attribute fetch finds each object's transform without a draw ID.
+
+Multi-draw indirect with base instances needs GL 4.3 (or ARB_multi_draw_indirect
+and ARB_base_instance); Mac OS X stops at 4.1. Without it draw() walks the
+same commands with glDrawElementsInstancedBaseVertex, re-pointing the
+instance attribute at each command's first matrix, still on the one VAO.
+*/
+
+# ifndef __INCLUDES465__
+# include "../includes465/include465.hpp"
+# define __INCLUDES465__
+# endif
+
+# include <string.h>
+
+// A GL_DRAW_INDIRECT_BUFFER command of glMultiDrawElementsIndirect
+struct DrawElementsCommand
+{
+	GLuint count;			// indices
+	GLuint instanceCount;
+	GLuint firstIndex;		// in indices, not bytes
+	GLint baseVertex;
+	GLuint baseInstance;	// first model matrix of the command's instances
+};
+
+class MeshRegistry
+{
+
+protected:
+
+	// One registered mesh
+	struct Mesh
+	{
+		int baseVertex;			// first vertex in the shared VBO
+		int firstIndex;			// first index in the shared IBO
+		TriLodChain lod;		// index range of each level of detail, from firstIndex
+	};
+
+	Mesh * mesh;
+	int nMeshes;
+	GLuint * program;			// shader program of each program index
+	int nPrograms;
+	int * programCommands;		// commands of each program in the last write(), nPrograms entries
+	GLuint vao;					// shared VAO with the vertex attributes and the element buffer
+	GLStateCache * state;
+	GLint instanceLocation;		// first of the 4 locations of the per instance model matrix
+	bool multiDrawIndirect;		// glMultiDrawElementsIndirect with base instances is used
+
+	int maxInstances;
+	RenderQueue * queue;		// a key per instance queued since the last write()
+	glm::mat4 * instanceMatrix;	// model matrix of each queued instance, by item number
+
+	DrawElementsCommand * command;	// commands of the last write(), kept for the fallback
+	int nCommands;
+	int triangles;				// triangles of the last write()'s commands
+
+public:
+
+	/* Constructor, for the passedNPrograms shader programs of passedProgram, up to passedNMeshes meshes
+	in passedVao's buffers and passedMaxInstances instances a frame between view distances nearZ and
+	farZ. instanceAttribute is the vertex shader's per instance mat4 model matrix, at the same location
+	in every program. allowIndirect false uses the per command draws even where multi-draw indirect exists.
+	*/
+	MeshRegistry(const GLuint * passedProgram, int passedNPrograms, char * instanceAttribute, GLuint passedVao,
+		int passedNMeshes, int passedMaxInstances, float nearZ, float farZ, bool allowIndirect, GLStateCache * passedState)
+	{
+		nPrograms = passedNPrograms;
+		program = new GLuint[nPrograms];
+		memcpy(program, passedProgram, nPrograms * sizeof(GLuint));
+		programCommands = new int[nPrograms];
+		memset(programCommands, 0, nPrograms * sizeof(int));
+		nMeshes = passedNMeshes;
+		vao = passedVao;
+		state = passedState;
+		maxInstances = passedMaxInstances;
+		nCommands = 0;
+		triangles = 0;
+		mesh = new Mesh[nMeshes];
+		memset(mesh, 0, nMeshes * sizeof(Mesh));
+		queue = new RenderQueue(maxInstances, nearZ, farZ);
+		instanceMatrix = new glm::mat4[maxInstances];
+		command = new DrawElementsCommand[getMaxCommands()];
+
+		instanceLocation = glGetAttribLocation(program[0], instanceAttribute);
+		multiDrawIndirect = allowIndirect &&
+			(GLEW_VERSION_4_3 || (GLEW_ARB_multi_draw_indirect && GLEW_ARB_base_instance));
+		printf("MeshRegistry: %s\n", multiDrawIndirect ? "multi-draw indirect" : "one draw per command");
+	}
+
+	~MeshRegistry()
+	{
+		delete[] program;
+		delete[] programCommands;
+		delete[] mesh;
+		delete queue;
+		delete[] instanceMatrix;
+		delete[] command;
+	}
+
+	// Returns the most commands write() can write, one per instance if no neighbours share one.
+	int getMaxCommands()
+	{
+		return maxInstances;
+	}
+
+	/* Sets vao's per instance model matrix attribute to the mat4s in buffer from offset bytes.
+	The mat4 is 4 vec4 attributes, one column each, advancing once per instance.
+	*/
+	void bindInstances(GLuint vao, GLuint buffer, GLintptr offset)
+	{
+		state->bindVertexArray(vao);
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		for (int column = 0; column < 4; column++)
+		{
+			glEnableVertexAttribArray(instanceLocation + column);
+			glVertexAttribPointer(instanceLocation + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+				BUFFER_OFFSET(offset + column * sizeof(glm::vec4)));
+			glVertexAttribDivisor(instanceLocation + column, 1);
+		}
+	}
+
+	// Registers mesh index meshIndex at baseVertex and firstIndex of the shared buffers, with the index ranges of lod.
+	void setMesh(int meshIndex, int baseVertex, int firstIndex, const TriLodChain * lod)
+	{
+		mesh[meshIndex].baseVertex = baseVertex;
+		mesh[meshIndex].firstIndex = firstIndex;
+		mesh[meshIndex].lod = *lod;
+	}
+
+	/* Queues one instance of level lod of meshIndex drawn by program programIndex at view distance
+	depth with its model matrix for the next write().
+	*/
+	void add(int programIndex, int meshIndex, int lod, float depth, const glm::mat4 & modelMatrix)
+	{
+		int item = queue->getCount();
+		if (!queue->submit(queue->makeKey(RENDER_PASS_OPAQUE, programIndex, meshIndex, lod, depth, item)))
+		{
+			printf("MeshRegistry error: more than %d instances in a frame\n", maxInstances);
+			return;
+		}
+		instanceMatrix[item] = modelMatrix;
+	}
+
+	/* Writes the queued model matrices to instance, sorted by program and front to back, and the
+	draw commands for them to commands, for the following draw(). instance has room for
+	maxInstances matrices and commands for getMaxCommands() commands.
+	*/
+	void write(glm::mat4 * instance, DrawElementsCommand * commands)
+	{
+		queue->sort();
+		const uint64_t * key = queue->getKeys();
+		int nInstances = queue->getCount();
+
+		// One command per run of sorted instances with the same program, mesh and level
+		nCommands = 0;
+		triangles = 0;
+		memset(programCommands, 0, nPrograms * sizeof(int));
+		for (int i = 0; i < nInstances; i++)
+		{
+			instance[i] = instanceMatrix[RenderQueue::getItem(key[i])];
+			if (i > 0 && RenderQueue::sameDraw(key[i], key[i - 1]))
+			{
+				command[nCommands - 1].instanceCount++;
+				continue;
+			}
+
+			Mesh * m = &mesh[RenderQueue::getMesh(key[i])];
+			int lod = RenderQueue::getLod(key[i]);
+			DrawElementsCommand * c = &command[nCommands++];
+			c->count = m->lod.count[lod];
+			c->instanceCount = 1;
+			c->firstIndex = m->firstIndex + m->lod.start[lod];
+			c->baseVertex = m->baseVertex;
+			c->baseInstance = i;
+			programCommands[RenderQueue::getProgram(key[i])]++;
+		}
+		for (int i = 0; i < nCommands; i++)
+			triangles += command[i].instanceCount * command[i].count / 3;
+		queue->clear();
+		memcpy(commands, command, nCommands * sizeof(DrawElementsCommand));
+	}
+
+	/* Draws the instances and commands of the last write(), now at instanceOffset and
+	commandOffset bytes in buffer, switching to each program that has commands. The
+	programs' camera must be set. Returns the number of triangles drawn.
+	*/
+	int draw(GLuint buffer, GLintptr instanceOffset, GLintptr commandOffset)
+	{
+		if (nCommands == 0)
+			return 0;
+
+		int first = 0;	// first command of program p
+		if (multiDrawIndirect)
+		{
+			// baseInstance advances the instance attribute to each command's first matrix
+			bindInstances(vao, buffer, instanceOffset);
+			state->bindDrawIndirectBuffer(buffer);
+			for (int p = 0; p < nPrograms; first += programCommands[p++])
+			{
+				if (programCommands[p] == 0)
+					continue;
+				state->useProgram(program[p]);
+				glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+					BUFFER_OFFSET(commandOffset + first * sizeof(DrawElementsCommand)), programCommands[p], 0);
+			}
+		}
+		else
+			for (int p = 0; p < nPrograms; first += programCommands[p++])
+			{
+				if (programCommands[p] == 0)
+					continue;
+				state->useProgram(program[p]);
+				for (int i = first; i < first + programCommands[p]; i++)
+				{
+					DrawElementsCommand * c = &command[i];
+					bindInstances(vao, buffer, instanceOffset + c->baseInstance * sizeof(glm::mat4));
+					glDrawElementsInstancedBaseVertex(GL_TRIANGLES, c->count, GL_UNSIGNED_INT,
+						BUFFER_OFFSET(c->firstIndex * sizeof(unsigned int)), c->instanceCount, c->baseVertex);
+				}
+			}
+		return triangles;
+	}
+
+	// Returns the number of GL draw calls the last draw() issued.
+	int getDrawCalls()
+	{
+		if (!multiDrawIndirect)
+			return nCommands;
+		int calls = 0;
+		for (int p = 0; p < nPrograms; p++)
+			if (programCommands[p] > 0)
+				calls++;
+		return calls;
+	}
+
+	// Returns the number of draw commands of the last write().
+	int getCommands()
+	{
+		return nCommands;
+	}
+};
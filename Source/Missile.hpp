@@ -1,7 +1,24 @@
 /*
 File: Missile.hpp
 
-Description: Class that handles the intitialization and updates of a missile.
+Description: The missiles in flight, a pool of MISSILE_POOL entities made
+with the scene. fire() takes a missile off a free list and gives it a
+MissileState, destroy() takes the MissileState away and puts the missile
+back on the list: both are a few stores, with nothing allocated, and as
+many missiles fly at once as the pool holds. The MissileState array then
+lists exactly the missiles in flight, which update() flies: straight ahead
+at their speed, turning towards their target once they are smart, until
+they hit something or their lifetime runs out.
+
+A missile's target is an EntityHandle, read through the store every tick,
+so it homes on where the target is now. Once the target is destroyed its
+handle is no longer live and the missile flies on straight. A destroyed
+missile is retired too, so a handle on it never finds the missile that
+reuses its entity.
+
+A Launcher is a ship or silo with its rack, the scene's missile it fires:
+the pool's missiles fly that model at its speed. fireSalvo() fires up to
+salvo missiles side by side, then the launcher reloads for reload ticks.
 */
 
 # ifndef __INCLUDES465__
@@ -9,152 +26,172 @@ Description: Class that handles the intitialization and updates of a missile.
 # define __INCLUDES465__
 # endif
 
-# include <glm/gtc/quaternion.hpp> 
-# include <glm/gtx/quaternion.hpp>
+# define MISSILE_POOL 256	// missiles that can fly at once
 
-class Missile : public Object3D
+// A ship or silo that fires its rack's missile in salvos
+struct Launcher
+{
+	int entity;			// the ship or silo
+	int rack;			// its missile in the scene, drawn on it while it has missiles left
+	glm::vec3 rackOffset;	// where the rack is in the launcher's coordinates
+	float speed;		// of its missiles, distance a tick
+	int missiles;		// left to fire
+	int salvo;			// fired at once
+	int reload;			// ticks from one salvo to the next
+	int cooldown;		// ticks until it can fire again
+};
+
+class MissilePool
 {
 
 // Variables:
-private:
-
-	float speed;
-	float AORDirection;
-	int updateFrameCount;
-	float detectionRadius = 5000.0f; // or 25?
-	bool smart;		// Flag to check if the missile becomes smart
-	bool targetLocked; // Flag for if a target was locked
-	bool fired; // Flag to check if the missle has fired
-	glm::vec3 translationAmount;	// the x,y,z position the object will be translated by
-	glm::vec3 direction;
-	glm::vec3 AOR;
-	glm::vec3 targetVector;
-	glm::vec3 distance;
-	glm::vec3 missileVector;
-	glm::mat4 targetMatrixLocation;
-	glm::mat4 missileLocation;
-
-	const int missleLifetime = 2000;
-	const int missileActivationTimer = 200;
-
-	// Creates an identity quaternion (no rotation)
-	glm::quat MyQuaternion;
+protected:
 
-// Constructor and functions:
-public:
-
-	Missile(float modelSize, float modelBoundingRadius, float passedMissleSpeed)
-		: Object3D(modelSize, modelBoundingRadius)
-	{
-		smart = false; // the missle isn't initially smart.
-		targetLocked = false; // the missle doesn't have a target until it becomes smart.
-		fired = false; // The missile hasn't been fired yet.
-		updateFrameCount = 0;
-		AORDirection = 0;
-		speed = passedMissleSpeed; 
-	}
+	static const int missleLifetime = 2000;
 
-	/* Handles "removing" the missile from the 3D scene */
-	void destroy() 
-	{
-		smart = false;
-		fired = false;
-		targetLocked = false;
-		updateFrameCount = 0;
-		setTranslationMatrix(identity);
-		setOrientationMatrix(translationMatrix);
-	}
+	EntityStore * store;
+	int first;						// entity of the pool's first missile
+	int nextFree[MISSILE_POOL];		// the free list through the pool's missiles, -1 ends it
+	int freeHead;
+	int activation;					// ticks before a missile is smart
 
-	int getUpdateFrameCount()
-	{
-		return updateFrameCount;
-	}
+// Constructor and functions:
+public:
 
-	glm::vec3 getTargetLocation()
+	// Constructor, the pool has no missiles until create()
+	MissilePool()
 	{
-		return targetVector;
+		store = NULL;
+		first = -1;
+		freeHead = -1;
+		activation = 0;
 	}
 
-	glm::vec3 getDirection()
+	/* Creates the pool's missiles in passedStore, all free; they become smart
+	passedActivation ticks after they are fired. Returns false if the store is full.
+	*/
+	bool create(EntityStore * passedStore, int passedActivation)
 	{
-		return direction;
+		store = passedStore;
+		activation = passedActivation;
+		for (int m = 0; m < MISSILE_POOL; m++)
+		{
+			int entity = store->create(1.0f);
+			if (entity < 0)
+				return false;
+			if (m == 0)
+				first = entity;
+			nextFree[m] = m + 1 < MISSILE_POOL ? m + 1 : -1;
+		}
+		freeHead = 0;
+		return true;
 	}
 
-	float getSpeed()
+	// The pool's m'th missile
+	int getEntity(int m)
 	{
-		return speed;
+		return first + m;
 	}
 
-	/* Checks the "smart" state of the missle */
-	bool isSmart()
+	// Whether entity is one of the pool's missiles in flight
+	bool isFlying(int entity)
 	{
-		return smart;
+		return entity >= first && entity < first + MISSILE_POOL && store->missile.get(entity) != NULL;
 	}
 
-	bool isTargetLocked()
+	/* Fires a missile of launcher's rack from position turned by rotation, homing on target once
+	smart. Returns a handle on it, noEntity if every missile is flying.
+	*/
+	EntityHandle fire(const Launcher & launcher, glm::vec3 position, glm::quat rotation, EntityHandle target)
 	{
-		return targetLocked;
+		if (freeHead < 0)
+			return noEntity;
+		int entity = first + freeHead;
+		freeHead = nextFree[freeHead];
+
+		MissileState * m = store->missile.add(entity);
+		m->target = target;
+		m->previousPosition = position;
+		m->speed = launcher.speed;
+		m->launcher = launcher.entity;
+		m->age = 0;
+		m->smart = false; // the missle isn't initially smart.
+		store->shape.add(entity)->model = launcher.rack;
+		store->collider.add(entity)->radius = store->collider.get(launcher.rack)->radius;
+		store->transform[entity].scale = store->transform[launcher.rack].scale;
+		store->setLocal(entity, position, rotation);
+		return store->getHandle(entity);
 	}
 
-	bool hasFired()
+	/* Fires a salvo from launcher's rack at target, spacing apart side by side, if it has
+	reloaded and has missiles left. Returns the missiles fired.
+	*/
+	int fireSalvo(Launcher & launcher, EntityHandle target, float spacing)
 	{
+		if (launcher.cooldown > 0)
+			return 0;
+		const Transform & t = store->transform[launcher.entity];
+		int salvo = glm::min(launcher.salvo, launcher.missiles), fired = 0;
+		for (int i = 0; i < salvo; i++)
+		{
+			glm::vec3 offset = launcher.rackOffset + glm::vec3((i - 0.5f * (salvo - 1)) * spacing, 0.0f, 0.0f);
+			if (fire(launcher, t.position + t.rotation * offset, t.rotation, target).entity < 0)
+				break;
+			fired++;
+		}
+		launcher.missiles -= fired;
+		if (fired > 0)
+			launcher.cooldown = launcher.reload;
 		return fired;
 	}
 
-	void fireMissile()
-	{
-		fired = true;
-	}
-
-	void activateSmart()
+	/* Handles "removing" the missile from the 3D scene: it is no longer drawn,
+	handles on it are no longer live and it is free to fire again.
+	*/
+	void destroy(int entity)
 	{
-		smart = true;
+		if (!isFlying(entity))
+			return;
+		store->missile.remove(entity);
+		store->shape.remove(entity);
+		store->retire(entity);
+		nextFree[entity - first] = freeHead;
+		freeHead = entity - first;
 	}
 
-	void setDirection(glm::vec3 passedInDirection)
-	{
-		direction = passedInDirection;
-	}
-
-	glm::mat4 getTargetMatrixLocation()
-	{
-		return targetMatrixLocation;
-	}
-
-	void setTargetLocation(glm::mat4 newLocation) 
-	{
-		targetMatrixLocation = newLocation;
-		targetLocked = true;
-	}
-
-	void update() 
+	// The missile system: one tick of every missile's flight
+	void update()
 	{
+		// The last first, destroying a missile moves the last one into its slot
+		for (int s = store->missile.getCount() - 1; s >= 0; s--)
+		{
+			MissileState & m = store->missile.at(s);
+			int entity = store->missile.getEntity(s);
+			Pose t = store->local[entity];	// a missile is a root, its local pose is where it is
+			m.previousPosition = t.position;
 
-		// Initialy the missile does not rotate or translate
-		rotationMatrix = identity;
-		translationMatrix = identity;
+			// The missile becomes smart once it is clear of its launcher
+			if (m.age > activation)
+				m.smart = true;
 
-		// If the missile has fired, start moving the missile and check its lifespan
-		if (fired == true)
-		{
 			// Keep Count of the Number of Updates
-			updateFrameCount = updateFrameCount + 1;
-
-			// The distance the missile will travel
-			distance = glm::vec3(0, 0, -speed);
-			translationMatrix = glm::translate(identity, distance);
+			m.age = m.age + 1;
 
 			// If the Missile exceeds its lifespan, destroy it
-			if (updateFrameCount > missleLifetime) 
+			if (m.age > missleLifetime)
 			{
-				destroy();
+				destroy(entity);
+				continue;
 			}
 
-			// The Missile will only attempt to reorient itself if it has a target and is smart
-			if (smart && targetLocked) 
+			// The missile travels its speed ahead, before it turns
+			glm::vec3 missileVector = getIn(t.rotation); // Gets the direction the missile is going.
+			t.position += missileVector * m.speed;
+
+			// The Missile will only attempt to reorient itself if it is smart and its target is still there
+			if (m.smart && store->isLive(m.target))
 			{
-				targetVector = getPosition(targetMatrixLocation) - getPosition(orientationMatrix); // Gets the distance the target is from the missile
-				missileVector = getIn(orientationMatrix); // Gets the direction the missile is going.
+				glm::vec3 targetVector = store->transform[m.target.entity].position - m.previousPosition; // Gets the distance the target is from the missile
 
 				// Normalize the vectors
 				targetVector = glm::normalize(targetVector);
@@ -164,10 +201,9 @@ public:
 				if (!(colinear(missileVector, targetVector, 0.1)))
 				{
 					// The rotation axis the missile will be rotating about
-					AOR = glm::cross(missileVector, targetVector);
-					AOR = glm::normalize(AOR);
-					
-					AORDirection = AOR.x + AOR.y + AOR.z;
+					glm::vec3 AOR = glm::normalize(glm::cross(missileVector, targetVector));
+					float AORDirection = AOR.x + AOR.y + AOR.z;
+					float rotationAmount;
 
 					if (AORDirection <= 0)
 					{
@@ -178,25 +214,11 @@ public:
 						rotationAmount = 2 * PI + glm::acos(glm::dot(targetVector, missileVector));;
 					}
 
-					rotationAxis = AOR;
-
-					// Conversion from Euler angles (in radians) to Quaternion
-					//MyQuaternion = glm::quat(rotationAxis);
-
-					MyQuaternion = glm::angleAxis(rotationAmount, rotationAxis);
-
-					rotationAxis = glm::axis(MyQuaternion);
-
-					rotationAmount = glm::angle(MyQuaternion);
-
-					// Only rotate the Missile only a 4th of the rotation amount, 
-					// this allows for smoother rotations in the simulation.
-					rotationMatrix = glm::rotate(identity, rotationAmount, rotationAxis);
+					// Turn the missile about AOR, in its own coordinates
+					t.rotation = t.rotation * glm::angleAxis(rotationAmount, AOR);
 				}
 			}
+			store->setLocal(entity, t.position, t.rotation);
 		}
-
-		// Update the orientation matrix of the missile
-		orientationMatrix = orientationMatrix * translationMatrix * rotationMatrix;
 	}
-};
\ No newline at end of file
+};
@@ -0,0 +1,36 @@
+/* 
+ParticleFragment.glsl
+
+Fragment shader for the particles, a round sprite fading to its edge.
+Exhaust cools from yellow to smoke, an explosion from white through
+orange to red, debris glows and dims.  Drawn with additive blending.
+*/
+
+# version 330 core
+
+in float kind;
+in float age;
+
+out vec4 fragColor;
+
+void main() {
+  vec2 offset = gl_PointCoord * 2.0 - 1.0;
+  float falloff = 1.0 - dot(offset, offset);
+  if (falloff <= 0.0) discard;
+  vec3 color;
+  float alpha;
+  if (kind < 0.5) {
+    color = mix(vec3(1.0, 0.8, 0.4), vec3(0.35, 0.35, 0.4), age);
+    alpha = 0.3 * (1.0 - age);
+    }
+  else if (kind < 1.5) {
+    color = age < 0.3 ? mix(vec3(1.0, 0.95, 0.8), vec3(1.0, 0.55, 0.1), age / 0.3)
+      : mix(vec3(1.0, 0.55, 0.1), vec3(0.6, 0.1, 0.02), (age - 0.3) / 0.7);
+    alpha = 0.12 * (1.0 - age);   // thousands overlap in the core
+    }
+  else {
+    color = vec3(1.0, 0.6, 0.3);
+    alpha = 0.8 * (1.0 - age * age);
+    }
+  fragColor = vec4(color, alpha * falloff);
+  }
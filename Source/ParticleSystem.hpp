@@ -0,0 +1,376 @@
+/*
+File: ParticleSystem.hpp
+
+Description: Missile exhaust, explosions and debris as up to PARTICLE_MAX
+point particles, simulated once per tick on the simulation thread.
+
+The particles are kept as a structure of arrays, one float array per field,
+so update() streams through each field once and integrates 8 particles per
+instruction with AVX2 where the CPU has it (checked at run time, the build
+needs no flags), 4 with SSE2, else one at a time. A particle whose age
+reaches its life is removed by moving the last particle into its place, so
+the live particles are always the first nParticles entries and the order
+changes only where one died.
+
+Particles come from emitters. An emitter spawns at most its rate of
+particles a tick, spread along the path it moved since the last tick, until
+its budget of particles is spent; an attached emitter (a missile's exhaust)
+has no budget and is moved and stopped by its owner, a burst (an explosion)
+frees itself once its budget is spent. When the arrays are full new
+particles are not spawned, the ones alive are never cut short.
+
+write() packs each particle into a vec4 for drawing: its world position and
+its kind plus the spent fraction of its life, which ParticleVertex.glsl and
+ParticleFragment.glsl turn into a point sprite's size and color. Spawning
+uses its own xorshift generator with a fixed seed, so the headless build
+draws the same particles every run.
+*/
+
+# ifndef __INCLUDES465__
+# include "../includes465/include465.hpp"
+# define __INCLUDES465__
+# endif
+
+# include <string.h>
+
+# if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+# include <immintrin.h>
+# define PARTICLE_AVX2			// compiled for AVX2 with a target attribute, used if the CPU has it
+# endif
+# ifdef __SSE2__
+# include <emmintrin.h>
+# endif
+
+# define PARTICLE_MAX 131072
+# define PARTICLE_MAX_EMITTERS 64
+
+// Kinds, the integer part of a packed particle's w
+# define PARTICLE_EXHAUST 0
+# define PARTICLE_EXPLOSION 1
+# define PARTICLE_DEBRIS 2
+
+class ParticleSystem
+{
+
+protected:
+
+	struct Emitter
+	{
+		bool active;
+		bool attached;			// moved and stopped by its owner, no budget
+		int kind;
+		glm::vec3 position, previousPosition;	// spawns along the path between them
+		glm::vec3 velocity;		// every particle's starting velocity
+		float spread;			// plus up to this much in a random direction
+		float drag;				// velocity kept each tick
+		float life;				// ticks a particle lives, give or take a quarter
+		int rate;				// particles spawned a tick at most
+		int budget;				// particles left to spawn by a burst
+	};
+
+	// One array per field, nParticles live entries in each
+	float * x, * y, * z;
+	float * vx, * vy, * vz;
+	float * drag;
+	float * age, * life;
+	float * kind;
+	int nParticles;
+	int * dead;					// particles that died this tick, ascending
+
+	Emitter emitter[PARTICLE_MAX_EMITTERS];
+	unsigned int random;		// xorshift state
+	bool avx2;
+
+	// Next random number in [0, 1)
+	float nextRandom()
+	{
+		random ^= random << 13;
+		random ^= random >> 17;
+		random ^= random << 5;
+		return (random >> 8) * (1.0f / 16777216.0f);
+	}
+
+	// A random vector in the unit ball
+	glm::vec3 randomInBall()
+	{
+		glm::vec3 v;
+		do
+			v = glm::vec3(nextRandom(), nextRandom(), nextRandom()) * 2.0f - 1.0f;
+		while (glm::dot(v, v) > 1.0f);
+		return v;
+	}
+
+# ifdef PARTICLE_AVX2
+	// Integrates particles [0, n) 8 at a time, returns where it stopped; lists the dead in dead[].
+	__attribute__((target("avx2,fma")))
+	int integrateAvx2(int n, int & nDead)
+	{
+		const __m256 one = _mm256_set1_ps(1.0f);
+		int i = 0;
+		for (; i + 8 <= n; i += 8)
+		{
+			__m256 velocityX = _mm256_loadu_ps(vx + i), velocityY = _mm256_loadu_ps(vy + i), velocityZ = _mm256_loadu_ps(vz + i);
+			__m256 keep = _mm256_loadu_ps(drag + i);
+			_mm256_storeu_ps(x + i, _mm256_add_ps(_mm256_loadu_ps(x + i), velocityX));
+			_mm256_storeu_ps(y + i, _mm256_add_ps(_mm256_loadu_ps(y + i), velocityY));
+			_mm256_storeu_ps(z + i, _mm256_add_ps(_mm256_loadu_ps(z + i), velocityZ));
+			_mm256_storeu_ps(vx + i, _mm256_mul_ps(velocityX, keep));
+			_mm256_storeu_ps(vy + i, _mm256_mul_ps(velocityY, keep));
+			_mm256_storeu_ps(vz + i, _mm256_mul_ps(velocityZ, keep));
+			__m256 older = _mm256_add_ps(_mm256_loadu_ps(age + i), one);
+			_mm256_storeu_ps(age + i, older);
+			int mask = _mm256_movemask_ps(_mm256_cmp_ps(older, _mm256_loadu_ps(life + i), _CMP_GE_OQ));
+			while (mask != 0)
+			{
+				dead[nDead++] = i + __builtin_ctz(mask);
+				mask &= mask - 1;
+			}
+		}
+		return i;
+	}
+# endif
+
+	// Integrates particles [0, n) with SSE2 where it stops, then one at a time; lists the dead in dead[].
+	void integrate(int first, int n, int & nDead)
+	{
+		int i = first;
+# ifdef __SSE2__
+		const __m128 one = _mm_set1_ps(1.0f);
+		for (; i + 4 <= n; i += 4)
+		{
+			__m128 velocityX = _mm_loadu_ps(vx + i), velocityY = _mm_loadu_ps(vy + i), velocityZ = _mm_loadu_ps(vz + i);
+			__m128 keep = _mm_loadu_ps(drag + i);
+			_mm_storeu_ps(x + i, _mm_add_ps(_mm_loadu_ps(x + i), velocityX));
+			_mm_storeu_ps(y + i, _mm_add_ps(_mm_loadu_ps(y + i), velocityY));
+			_mm_storeu_ps(z + i, _mm_add_ps(_mm_loadu_ps(z + i), velocityZ));
+			_mm_storeu_ps(vx + i, _mm_mul_ps(velocityX, keep));
+			_mm_storeu_ps(vy + i, _mm_mul_ps(velocityY, keep));
+			_mm_storeu_ps(vz + i, _mm_mul_ps(velocityZ, keep));
+			__m128 older = _mm_add_ps(_mm_loadu_ps(age + i), one);
+			_mm_storeu_ps(age + i, older);
+			int mask = _mm_movemask_ps(_mm_cmpge_ps(older, _mm_loadu_ps(life + i)));
+			while (mask != 0)
+			{
+				dead[nDead++] = i + __builtin_ctz(mask);
+				mask &= mask - 1;
+			}
+		}
+# endif
+		for (; i < n; i++)
+		{
+			x[i] += vx[i];
+			y[i] += vy[i];
+			z[i] += vz[i];
+			vx[i] *= drag[i];
+			vy[i] *= drag[i];
+			vz[i] *= drag[i];
+			age[i] += 1.0f;
+			if (age[i] >= life[i])
+				dead[nDead++] = i;
+		}
+	}
+
+	// Moves particle from into slot to
+	void move(int from, int to)
+	{
+		x[to] = x[from];
+		y[to] = y[from];
+		z[to] = z[from];
+		vx[to] = vx[from];
+		vy[to] = vy[from];
+		vz[to] = vz[from];
+		drag[to] = drag[from];
+		age[to] = age[from];
+		life[to] = life[from];
+		kind[to] = kind[from];
+	}
+
+	// Spawns up to count particles of emitter e, returns how many
+	int spawn(Emitter & e, int count)
+	{
+		count = glm::min(count, PARTICLE_MAX - nParticles);
+		for (int s = 0; s < count; s++)
+		{
+			int i = nParticles++;
+			glm::vec3 position = glm::mix(e.previousPosition, e.position, nextRandom());
+			glm::vec3 velocity = e.velocity + randomInBall() * e.spread;
+			x[i] = position.x;
+			y[i] = position.y;
+			z[i] = position.z;
+			vx[i] = velocity.x;
+			vy[i] = velocity.y;
+			vz[i] = velocity.z;
+			drag[i] = e.drag;
+			age[i] = 0.0f;
+			life[i] = e.life * (0.75f + 0.5f * nextRandom());
+			kind[i] = (float)e.kind;
+		}
+		return count;
+	}
+
+	// Claims a free emitter, -1 if all are in use
+	int claim()
+	{
+		for (int e = 0; e < PARTICLE_MAX_EMITTERS; e++)
+			if (!emitter[e].active)
+			{
+				emitter[e] = Emitter(); // value initialized, every field zero
+				emitter[e].active = true;
+				return e;
+			}
+		return -1;
+	}
+
+public:
+
+	// Constructor, no particles and no emitters
+	ParticleSystem()
+	{
+		float ** field[] = { &x, &y, &z, &vx, &vy, &vz, &drag, &age, &life, &kind };
+		for (int f = 0; f < (int)(sizeof(field) / sizeof(field[0])); f++)
+			*field[f] = new float[PARTICLE_MAX];
+		dead = new int[PARTICLE_MAX];
+		clear();
+# ifdef PARTICLE_AVX2
+		__builtin_cpu_init();	// a global's constructor may run before the runtime's own call
+		avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+# else
+		avx2 = false;
+# endif
+	}
+
+	~ParticleSystem()
+	{
+		float * field[] = { x, y, z, vx, vy, vz, drag, age, life, kind };
+		for (int f = 0; f < (int)(sizeof(field) / sizeof(field[0])); f++)
+			delete[] field[f];
+		delete[] dead;
+	}
+
+	// Removes every particle and emitter, and restarts the random sequence
+	void clear()
+	{
+		nParticles = 0;
+		for (int e = 0; e < PARTICLE_MAX_EMITTERS; e++)
+			emitter[e].active = false;
+		random = 2463534242u;
+	}
+
+	/* Starts an emitter its owner moves with moveEmitter() and ends with stopEmitter(): each tick
+	it spawns rate particles of kind living life ticks, with the velocity moveEmitter() gives it plus
+	up to spread in a random direction, slowed by drag. Returns the emitter, -1 if none is free.
+	*/
+	int attachEmitter(int passedKind, glm::vec3 position, int rate, float spread, float passedDrag, float passedLife)
+	{
+		int e = claim();
+		if (e < 0)
+			return -1;
+		emitter[e].attached = true;
+		emitter[e].kind = passedKind;
+		emitter[e].position = emitter[e].previousPosition = position;
+		emitter[e].rate = rate;
+		emitter[e].spread = spread;
+		emitter[e].drag = passedDrag;
+		emitter[e].life = passedLife;
+		return e;
+	}
+
+	// Moves attached emitter e, its next particles spawn along the way and start at velocity
+	void moveEmitter(int e, glm::vec3 position, glm::vec3 velocity)
+	{
+		emitter[e].position = position;
+		emitter[e].velocity = velocity;
+	}
+
+	void stopEmitter(int e)
+	{
+		emitter[e].active = false;
+	}
+
+	/* Spawns budget particles of kind at position over the next ticks, rate a tick, moving at
+	velocity plus up to spread in a random direction. Returns false if no emitter is free.
+	*/
+	bool burst(int passedKind, glm::vec3 position, glm::vec3 velocity, int budget, int rate, float spread,
+		float passedDrag, float passedLife)
+	{
+		int e = claim();
+		if (e < 0)
+			return false;
+		emitter[e].kind = passedKind;
+		emitter[e].position = emitter[e].previousPosition = position;
+		emitter[e].velocity = velocity;
+		emitter[e].budget = budget;
+		emitter[e].rate = rate;
+		emitter[e].spread = spread;
+		emitter[e].drag = passedDrag;
+		emitter[e].life = passedLife;
+		return true;
+	}
+
+	// One tick: moves and ages every particle, removes the dead, then lets every emitter spawn.
+	void update()
+	{
+		int nDead = 0, i = 0;
+# ifdef PARTICLE_AVX2
+		if (avx2)
+			i = integrateAvx2(nParticles, nDead);
+# endif
+		integrate(i, nParticles, nDead);
+
+		// Highest first, then every particle after the one removed is alive and may fill its place
+		for (int d = nDead - 1; d >= 0; d--)
+			move(--nParticles, dead[d]);
+
+		for (int e = 0; e < PARTICLE_MAX_EMITTERS; e++)
+		{
+			Emitter & em = emitter[e];
+			if (!em.active)
+				continue;
+			if (em.attached)
+				spawn(em, em.rate);
+			else
+			{
+				em.budget -= spawn(em, glm::min(em.rate, em.budget));
+				if (em.budget <= 0 || nParticles == PARTICLE_MAX)
+					em.active = false;	// a burst that can't spawn now would be late later
+			}
+			em.previousPosition = em.position;
+		}
+	}
+
+	/* Packs every particle into out[]: its position, and its kind plus the spent fraction of its
+	life in w. Returns the number of particles.
+	*/
+	int write(glm::vec4 * out)
+	{
+		float * packed = (float *)out;
+		int i = 0;
+# ifdef __SSE2__
+		const __m128 almostOne = _mm_set1_ps(0.999f);
+		for (; i + 4 <= nParticles; i += 4)
+		{
+			__m128 spent = _mm_min_ps(_mm_div_ps(_mm_loadu_ps(age + i), _mm_loadu_ps(life + i)), almostOne);
+			__m128 px = _mm_loadu_ps(x + i), py = _mm_loadu_ps(y + i), pz = _mm_loadu_ps(z + i);
+			__m128 pw = _mm_add_ps(_mm_loadu_ps(kind + i), spent);
+			_MM_TRANSPOSE4_PS(px, py, pz, pw);	// four fields of four particles to four particles
+			_mm_storeu_ps(packed + 4 * i, px);
+			_mm_storeu_ps(packed + 4 * i + 4, py);
+			_mm_storeu_ps(packed + 4 * i + 8, pz);
+			_mm_storeu_ps(packed + 4 * i + 12, pw);
+		}
+# endif
+		for (; i < nParticles; i++)
+			out[i] = glm::vec4(x[i], y[i], z[i], kind[i] + glm::min(age[i] / life[i], 0.999f));
+		return nParticles;
+	}
+
+	int getCount()
+	{
+		return nParticles;
+	}
+
+	bool usesAvx2()
+	{
+		return avx2;
+	}
+};
@@ -0,0 +1,36 @@
+/* 
+ParticleVertex.glsl
+
+Vertex shader for the particles, see ParticleSystem.hpp.  Each point is
+a particle's world position with its kind plus the spent fraction of its
+life in w.  The kind and age set the sprite's world size, which shrinks
+with distance like a model's:  PointScale is the projection's [1][1] times
+half the window height in pixels.
+*/
+
+# version 330 core
+
+in vec4 vParticle;
+
+// written once per frame into a FrameRing region, see FrameRing.hpp
+layout(std140) uniform Camera {
+  mat4 ViewMatrix;
+  mat4 ProjectionMatrix;
+  };
+
+uniform float PointScale;
+
+out float kind;
+out float age;
+
+void main() {
+  kind = floor(vParticle.w);
+  age = vParticle.w - kind;
+  float size;
+  if (kind < 0.5) size = 6.0 + 18.0 * age;         // exhaust puffs spread out
+  else if (kind < 1.5) size = 40.0 + 80.0 * age;   // the fireball grows
+  else size = 8.0;                                 // debris
+  vec4 eye = ViewMatrix * vec4(vParticle.xyz, 1.0);
+  gl_Position = ProjectionMatrix * eye;
+  gl_PointSize = max(size * PointScale / max(-eye.z, 1.0), 1.0);
+  }
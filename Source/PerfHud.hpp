@@ -0,0 +1,383 @@
+/*
+File: PerfHud.hpp
+
+Description: A performance overlay drawn over the frame: a table of the
+rolling p50, p95 and p99 of the frame time, of CPU phase times and of GPU
+pass times, in milliseconds over the last HUD_SAMPLES samples of each.
+
+CPU phases are timed by the caller and passed to addSample(). GPU passes
+are timed with GL_TIME_ELAPSED queries between beginPass() and endPass().
+The queries are double buffered: a frame reads the results of the queries
+issued two frames before, only if they are available, so reading them never
+stalls the CPU on the GPU. A result that isn't ready yet is dropped.
+
+The text is drawn from a glyph atlas, a single channel texture holding a
+3 x 5 texel font for ASCII 32 ... 95 (lower case prints as upper case),
+built at construction. All glyph quads and a backdrop quad are in one
+vertex buffer drawn with one glDrawArrays, rebuilt only when the table is
+refreshed every HUD_REFRESH_MS milliseconds so the numbers stay readable.
+The program is HudVertex.glsl and HudFragment.glsl, its state changes go
+through the frame's GLStateCache.
+*/
+
+# ifndef __INCLUDES465__
+# include "../includes465/include465.hpp"
+# define __INCLUDES465__
+# endif
+
+# include <chrono>
+# include <algorithm>
+# include <string.h>
+# include <ctype.h>
+
+# define HUD_SAMPLES 240		// rolling window of each series
+# define HUD_MAX_SERIES 16
+# define HUD_QUERY_SETS 2		// frames of GPU queries in flight
+# define HUD_MAX_CHARS 1024
+# define HUD_REFRESH_MS 250
+# define HUD_SCALE 2			// window pixels per glyph texel
+
+// 3 x 5 glyphs of ASCII 32 ... 95, one octal digit per row from the top, bit 2 is the left column
+static const unsigned short hudFont[64] = {
+	000000, 022202, 055000, 057575, 000000, 051245, 000000, 022000,	//   ! " # $ % & '
+	012221, 042224, 005250, 002720, 000024, 000700, 000002, 011244,	// ( ) * + , - . /
+	075557, 026227, 071747, 071717, 055711, 074717, 074757, 071111,	// 0 1 2 3 4 5 6 7
+	075757, 075717, 002020, 002024, 012421, 007070, 042124, 071202,	// 8 9 : ; < = > ?
+	075747, 025755, 065656, 034443, 065556, 074647, 074644, 034553,	// @ A B C D E F G
+	055755, 072227, 011152, 055655, 044447, 057755, 065555, 025552,	// H I J K L M N O
+	065644, 025563, 065655, 034216, 072222, 055557, 055552, 055775,	// P Q R S T U V W
+	055255, 055222, 071247, 032223, 044211, 062226, 025000, 000007	// X Y Z [ \ ] ^ _
+};
+
+class PerfHud
+{
+
+protected:
+
+	// One timed series, a CPU phase or a GPU pass
+	struct Series
+	{
+		char name[16];
+		bool gpu;
+		float sample[HUD_SAMPLES];	// ring of the latest samples in milliseconds
+		int next;					// where the next sample goes
+		int count;					// samples in the ring
+		GLuint query[HUD_QUERY_SETS];
+		bool issued[HUD_QUERY_SETS];	// query was used in that set and its result not read
+	};
+
+	struct Vertex
+	{
+		GLfloat x, y;				// window pixels from the top left
+		GLfloat u, v;				// glyph atlas coordinates
+		GLubyte color[4];
+	};
+
+	Series series[HUD_MAX_SERIES];
+	int nSeries;
+	int frameSeries;				// time between beginFrame() calls
+	int querySet;					// query set of the current frame
+	int activePass;					// series of the open GL_TIME_ELAPSED query, or -1
+	int droppedQueries;				// GPU results that weren't ready when their query was reused
+
+	GLuint program, vao, vbo, atlas;
+	GLStateCache * state;
+	GLint viewportLocation;
+	int viewportWidth, viewportHeight;	// the Viewport uniform's value, it is only set when it changes
+	int atlasWidth, atlasHeight;
+	Vertex * vertex;
+	int nVertices;
+	bool visible;
+	bool haveLastFrame;
+	std::chrono::steady_clock::time_point lastFrame, lastRefresh;
+
+	// Appends a quad of w x h pixels at x, y showing the atlas texels from u0, v0 to u1, v1.
+	void addQuad(float x, float y, float w, float h, float u0, float v0, float u1, float v1, const GLubyte color[4])
+	{
+		if (nVertices + 6 > 6 * HUD_MAX_CHARS)
+			return;
+		const float cornerX[4] = { x, x + w, x + w, x }, cornerY[4] = { y, y, y + h, y + h };
+		const float cornerU[4] = { u0, u1, u1, u0 }, cornerV[4] = { v0, v0, v1, v1 };
+		static const int order[6] = { 0, 1, 2, 2, 3, 0 };
+		for (int i = 0; i < 6; i++)
+		{
+			Vertex & corner = vertex[nVertices++];
+			corner.x = cornerX[order[i]];
+			corner.y = cornerY[order[i]];
+			corner.u = cornerU[order[i]];
+			corner.v = cornerV[order[i]];
+			memcpy(corner.color, color, 4);
+		}
+	}
+
+	// Appends the glyphs of text from x, y, returns the x after it.
+	float addText(float x, float y, const char * text, const GLubyte color[4])
+	{
+		float cellWidth = 4.0f / atlasWidth, cellHeight = 6.0f / atlasHeight;
+		for (; *text != '\0'; text++, x += 4 * HUD_SCALE)
+		{
+			int c = toupper((unsigned char)*text);
+			if (c <= ' ' || c > '_')
+				continue;
+			int glyph = c - ' ';
+			float u = (glyph % 16) * cellWidth, v = (glyph / 16) * cellHeight;
+			addQuad(x, y, 3 * HUD_SCALE, 5 * HUD_SCALE, u, v, u + 3.0f / atlasWidth, v + 5.0f / atlasHeight, color);
+		}
+		return x;
+	}
+
+	// Rebuilds the table's quads from the current percentiles.
+	void buildText()
+	{
+		static const GLubyte backdrop[4] = { 0, 0, 0, 160 };
+		static const GLubyte heading[4] = { 255, 220, 80, 255 };
+		static const GLubyte white[4] = { 255, 255, 255, 255 };
+		const float lineHeight = 7 * HUD_SCALE, margin = 4 * HUD_SCALE;
+		char line[64];
+
+		// The backdrop samples the atlas's solid cell, after the 64 glyphs
+		nVertices = 0;
+		float solidU = 1.5f / atlasWidth, solidV = (4 * 6 + 1.5f) / atlasHeight;
+		float width = 2 * margin + 36 * 4 * HUD_SCALE, height = 2 * margin + (nSeries + 1) * lineHeight;
+		addQuad(0, 0, width, height, solidU, solidV, solidU, solidV, backdrop);
+
+		float y = margin;
+		sprintf(line, "%-14s %6s %6s %6s", "MS", "P50", "P95", "P99");
+		addText(margin, y, line, heading);
+		for (int s = 0; s < nSeries; s++)
+		{
+			y += lineHeight;
+			sprintf(line, "%-3s %-10s %6.2f %6.2f %6.2f", s == frameSeries ? "" : series[s].gpu ? "GPU" : "CPU",
+				series[s].name, percentile(s, 0.50f), percentile(s, 0.95f), percentile(s, 0.99f));
+			addText(margin, y, line, white);
+		}
+
+		glBindBuffer(GL_ARRAY_BUFFER, vbo);
+		glBufferData(GL_ARRAY_BUFFER, nVertices * sizeof(Vertex), vertex, GL_STREAM_DRAW);
+	}
+
+	// Reads the results of the queries issued in querySet's previous use, if they are ready.
+	void readQueries()
+	{
+		for (int s = 0; s < nSeries; s++)
+		{
+			if (!series[s].gpu || !series[s].issued[querySet])
+				continue;
+			GLint available = 0;
+			glGetQueryObjectiv(series[s].query[querySet], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (available)
+			{
+				GLuint64 elapsed = 0;
+				glGetQueryObjectui64v(series[s].query[querySet], GL_QUERY_RESULT, &elapsed);
+				addSample(s, elapsed / 1000000.0f);
+			}
+			else
+				droppedQueries++;
+			series[s].issued[querySet] = false;
+		}
+	}
+
+public:
+
+	/* Constructor, hudProgram is HudVertex.glsl and HudFragment.glsl linked.
+	Builds the glyph atlas and the vertex array, the frame time is the first series.
+	*/
+	PerfHud(GLuint hudProgram, GLStateCache * passedState)
+	{
+		program = hudProgram;
+		state = passedState;
+		viewportWidth = viewportHeight = 0;
+		nSeries = 0;
+		querySet = 0;
+		activePass = -1;
+		droppedQueries = 0;
+		nVertices = 0;
+		visible = true;
+		haveLastFrame = false;
+		vertex = new Vertex[6 * HUD_MAX_CHARS];
+		frameSeries = addCpuPhase("FRAME");
+
+		// Glyph atlas: 16 x 5 cells of 4 x 6 texels, 64 glyphs then one solid cell
+		atlasWidth = 16 * 4;
+		atlasHeight = 5 * 6;
+		GLubyte * texel = new GLubyte[atlasWidth * atlasHeight];
+		memset(texel, 0, atlasWidth * atlasHeight);
+		for (int glyph = 0; glyph < 64; glyph++)
+			for (int row = 0; row < 5; row++)
+				for (int column = 0; column < 3; column++)
+					if ((hudFont[glyph] >> (3 * (4 - row) + 2 - column)) & 1)
+						texel[((glyph / 16) * 6 + row) * atlasWidth + (glyph % 16) * 4 + column] = 255;
+		for (int row = 0; row < 6; row++)
+			memset(texel + (4 * 6 + row) * atlasWidth, 255, 4);
+
+		glGenTextures(1, &atlas);
+		glBindTexture(GL_TEXTURE_2D, atlas);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, atlasWidth, atlasHeight, 0, GL_RED, GL_UNSIGNED_BYTE, texel);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		delete[] texel;
+
+		glGenVertexArrays(1, &vao);
+		glBindVertexArray(vao);
+		glGenBuffers(1, &vbo);
+		glBindBuffer(GL_ARRAY_BUFFER, vbo);
+		GLint position = glGetAttribLocation(program, "vPosition");
+		GLint texCoord = glGetAttribLocation(program, "vTexCoord");
+		GLint color = glGetAttribLocation(program, "vColor");
+		glVertexAttribPointer(position, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), BUFFER_OFFSET(0));
+		glEnableVertexAttribArray(position);
+		glVertexAttribPointer(texCoord, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), BUFFER_OFFSET(2 * sizeof(GLfloat)));
+		glEnableVertexAttribArray(texCoord);
+		glVertexAttribPointer(color, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), BUFFER_OFFSET(4 * sizeof(GLfloat)));
+		glEnableVertexAttribArray(color);
+		glBindVertexArray(0);
+
+		glUseProgram(program);
+		glUniform1i(glGetUniformLocation(program, "Glyphs"), 0);	// texture unit 0
+		viewportLocation = glGetUniformLocation(program, "Viewport");
+	}
+
+	~PerfHud()
+	{
+		for (int s = 0; s < nSeries; s++)
+			if (series[s].gpu)
+				glDeleteQueries(HUD_QUERY_SETS, series[s].query);
+		glDeleteTextures(1, &atlas);
+		glDeleteBuffers(1, &vbo);
+		glDeleteVertexArrays(1, &vao);
+		delete[] vertex;
+	}
+
+	// Adds a CPU phase timed by the caller, returns its series for addSample().
+	int addCpuPhase(const char * name)
+	{
+		if (nSeries == HUD_MAX_SERIES)
+			return -1;
+		Series * s = &series[nSeries];
+		strncpy(s->name, name, sizeof(s->name) - 1);
+		s->name[sizeof(s->name) - 1] = '\0';
+		s->gpu = false;
+		s->next = s->count = 0;
+		return nSeries++;
+	}
+
+	// Adds a GPU pass timed between beginPass() and endPass(), returns its series.
+	int addGpuPass(const char * name)
+	{
+		int s = addCpuPhase(name);
+		if (s < 0)
+			return -1;
+		series[s].gpu = true;
+		glGenQueries(HUD_QUERY_SETS, series[s].query);
+		for (int i = 0; i < HUD_QUERY_SETS; i++)
+			series[s].issued[i] = false;
+		return s;
+	}
+
+	// Records one sample of milliseconds in series s.
+	void addSample(int s, float milliseconds)
+	{
+		if (s < 0)
+			return;
+		series[s].sample[series[s].next] = milliseconds;
+		series[s].next = (series[s].next + 1) % HUD_SAMPLES;
+		if (series[s].count < HUD_SAMPLES)
+			series[s].count++;
+	}
+
+	// Returns the fraction p percentile of series s's samples, 0 if it has none.
+	float percentile(int s, float p)
+	{
+		float sorted[HUD_SAMPLES];
+		int n = series[s].count;
+		if (n == 0)
+			return 0.0f;
+		memcpy(sorted, series[s].sample, n * sizeof(float));
+		int k = (int)(p * (n - 1) + 0.5f);
+		std::nth_element(sorted, sorted + k, sorted + n);
+		return sorted[k];
+	}
+
+	// Starts a frame: records the time since the last one and collects the GPU times ready by now.
+	void beginFrame()
+	{
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		if (haveLastFrame)
+			addSample(frameSeries, std::chrono::duration<float, std::milli>(now - lastFrame).count());
+		lastFrame = now;
+		haveLastFrame = true;
+
+		querySet = (querySet + 1) % HUD_QUERY_SETS;
+		readQueries();
+	}
+
+	// Starts timing GPU pass s, passes can't nest.
+	void beginPass(int s)
+	{
+		if (!visible || s < 0 || activePass >= 0)
+			return;
+		glBeginQuery(GL_TIME_ELAPSED, series[s].query[querySet]);
+		activePass = s;
+	}
+
+	// Ends the GPU pass started by beginPass().
+	void endPass()
+	{
+		if (activePass < 0)
+			return;
+		glEndQuery(GL_TIME_ELAPSED);
+		series[activePass].issued[querySet] = true;
+		activePass = -1;
+	}
+
+	/* Draws the table over the frame in a width x height window, blended and without depth test.
+	Leaves the HUD program in use, blending on and depth testing off.
+	*/
+	void draw(int width, int height)
+	{
+		if (!visible)
+			return;
+
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		if (nVertices == 0 || std::chrono::duration<float, std::milli>(now - lastRefresh).count() >= HUD_REFRESH_MS)
+		{
+			buildText();
+			lastRefresh = now;
+		}
+
+		state->setDepthTest(false);
+		state->setBlend(true);
+		state->blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		state->useProgram(program);
+		if (width != viewportWidth || height != viewportHeight)
+		{
+			glUniform2f(viewportLocation, (GLfloat)width, (GLfloat)height);
+			viewportWidth = width;
+			viewportHeight = height;
+		}
+		state->bindTexture(0, GL_TEXTURE_2D, atlas);
+		state->bindVertexArray(vao);
+		glDrawArrays(GL_TRIANGLES, 0, nVertices);
+	}
+
+	void setVisible(bool show)
+	{
+		visible = show;
+	}
+
+	bool isVisible()
+	{
+		return visible;
+	}
+
+	// Returns how many GPU pass results weren't ready when their query was reused.
+	int getDroppedQueries()
+	{
+		return droppedQueries;
+	}
+};
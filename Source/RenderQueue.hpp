@@ -0,0 +1,164 @@
+/*
+File: RenderQueue.hpp
+
+Description: The draws of a frame as 64 bit sort keys. A key holds, from
+the most significant bits down, the draw's pass, shader program, depth,
+mesh and level of detail, and in its low 32 bits the number of the item it
+stands for. Sorting the keys orders the draws by pass, then by program so
+each program is used once, then front to back so the nearest surfaces (the
+large planets) fill the depth buffer before what they hide is shaded, and
+lastly by mesh and level so equal neighbours can share one draw command.
+
+The depth is the log of the view distance between the near and far planes
+in 12 bits, coarse enough that instances of one mesh at about the same depth
+still sort together. sort() is an LSD radix sort, 8 bits a pass, that skips
+the bytes every key shares.
+*/
+
+# ifndef __INCLUDES465__
+# include "../includes465/include465.hpp"
+# define __INCLUDES465__
+# endif
+
+# include <stdint.h>
+# include <string.h>
+# include <math.h>
+
+// Key fields, shift and width in bits
+# define RENDER_KEY_PASS_SHIFT 62
+# define RENDER_KEY_PROGRAM_SHIFT 58
+# define RENDER_KEY_DEPTH_SHIFT 46
+# define RENDER_KEY_MESH_SHIFT 34
+# define RENDER_KEY_LOD_SHIFT 32
+# define RENDER_KEY_DEPTH_BITS 12
+# define RENDER_KEY_MESH_BITS 12
+# define RENDER_KEY_ITEM_MASK 0xFFFFFFFFULL
+# define RENDER_KEY_DRAW_MASK (~RENDER_KEY_ITEM_MASK & ~(((1ULL << RENDER_KEY_DEPTH_BITS) - 1) << RENDER_KEY_DEPTH_SHIFT))
+
+// Passes, in drawing order
+# define RENDER_PASS_OPAQUE 0
+
+class RenderQueue
+{
+
+protected:
+
+	uint64_t * key;
+	uint64_t * scratch;		// the radix sort's other buffer
+	int maxItems;
+	int nItems;
+	float logNear, depthScale;	// depth key = (log(distance) - logNear) * depthScale
+
+public:
+
+	// Constructor, for up to passedMaxItems draws a frame between nearZ and farZ
+	RenderQueue(int passedMaxItems, float nearZ, float farZ)
+	{
+		maxItems = passedMaxItems;
+		nItems = 0;
+		key = new uint64_t[maxItems];
+		scratch = new uint64_t[maxItems];
+		setDepthRange(nearZ, farZ);
+	}
+
+	~RenderQueue()
+	{
+		delete[] key;
+		delete[] scratch;
+	}
+
+	// Sets the view distances the depth keys span.
+	void setDepthRange(float nearZ, float farZ)
+	{
+		logNear = logf(nearZ);
+		depthScale = ((1 << RENDER_KEY_DEPTH_BITS) - 1) / (logf(farZ) - logNear);
+	}
+
+	// Returns the key of item in pass with program, mesh and level lod at view distance depth.
+	uint64_t makeKey(int pass, int program, int mesh, int lod, float depth, unsigned int item)
+	{
+		int depthKey = (int)((logf(glm::max(depth, 1e-6f)) - logNear) * depthScale);
+		depthKey = glm::clamp(depthKey, 0, (1 << RENDER_KEY_DEPTH_BITS) - 1);
+		return (uint64_t)pass << RENDER_KEY_PASS_SHIFT | (uint64_t)program << RENDER_KEY_PROGRAM_SHIFT
+			| (uint64_t)depthKey << RENDER_KEY_DEPTH_SHIFT | (uint64_t)mesh << RENDER_KEY_MESH_SHIFT
+			| (uint64_t)lod << RENDER_KEY_LOD_SHIFT | item;
+	}
+
+	// Queues a key, false if the queue is full.
+	bool submit(uint64_t passedKey)
+	{
+		if (nItems == maxItems)
+			return false;
+		key[nItems++] = passedKey;
+		return true;
+	}
+
+	// Empties the queue for the next frame.
+	void clear()
+	{
+		nItems = 0;
+	}
+
+	// Sorts the queued keys in ascending order.
+	void sort()
+	{
+		uint64_t same = ~0ULL, first = nItems > 0 ? key[0] : 0;
+		for (int i = 1; i < nItems; i++)
+			same &= ~(key[i] ^ first);	// bits every key shares with the first
+
+		for (int shift = 0; shift < 64; shift += 8)
+		{
+			if (((same >> shift) & 0xFF) == 0xFF)
+				continue;	// this byte is the same in every key, the pass wouldn't move anything
+			int count[257];
+			memset(count, 0, sizeof(count));
+			for (int i = 0; i < nItems; i++)
+				count[((key[i] >> shift) & 0xFF) + 1]++;
+			for (int b = 0; b < 256; b++)
+				count[b + 1] += count[b];
+			for (int i = 0; i < nItems; i++)
+				scratch[count[(key[i] >> shift) & 0xFF]++] = key[i];
+			uint64_t * swap = key;
+			key = scratch;
+			scratch = swap;
+		}
+	}
+
+	int getCount()
+	{
+		return nItems;
+	}
+
+	// Returns the queued keys, sorted after sort().
+	const uint64_t * getKeys()
+	{
+		return key;
+	}
+
+	// The item number of a key
+	static unsigned int getItem(uint64_t passedKey)
+	{
+		return (unsigned int)(passedKey & RENDER_KEY_ITEM_MASK);
+	}
+
+	// True if two keys draw the same program, mesh and level in the same pass
+	static bool sameDraw(uint64_t a, uint64_t b)
+	{
+		return ((a ^ b) & RENDER_KEY_DRAW_MASK) == 0;
+	}
+
+	static int getProgram(uint64_t passedKey)
+	{
+		return (int)((passedKey >> RENDER_KEY_PROGRAM_SHIFT) & 0xF);
+	}
+
+	static int getMesh(uint64_t passedKey)
+	{
+		return (int)((passedKey >> RENDER_KEY_MESH_SHIFT) & ((1 << RENDER_KEY_MESH_BITS) - 1));
+	}
+
+	static int getLod(uint64_t passedKey)
+	{
+		return (int)((passedKey >> RENDER_KEY_LOD_SHIFT) & 0x3);
+	}
+};
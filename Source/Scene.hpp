@@ -0,0 +1,385 @@
+/*
+File: Scene.hpp
+
+Description: The entities of a simulation, loaded from a scene file instead
+of being compiled in. Every entity is a star, planet, moon, ship, missile
+silo or missile with its model file, size, position and rotation, and
+optionally a parent it moves with, a launcher that fires it, a missile
+budget and a speed. Entities are stored in one contiguous array in file
+order, and a parent or launcher must be declared before the entities that
+name it, so every reference is resolved while the file is read in one pass.
+
+A scene has two forms. The text form is for authoring: one entity per line,
+'#' starts a comment,
+
+	kind name model.tri size x y z rotation [key value]...
+
+where kind is star, planet, moon, ship, silo or missile, rotation is in
+radians per update, and the optional keys are
+
+	parent name		the entity a planet or moon orbits, or a silo stands on
+	launcher name	the ship or silo that fires a missile
+	missiles n		missile budget of a ship or silo
+	speed s			distance a missile moves per update
+	triangles n		triangle count of the model, counted by scene2bin if absent
+
+A silo's x y z is its offset from its parent. An entity moves with its
+parent and everything above it, and a silo with a rotation turns in place
+on its parent. The binary form written by scene2bin is a SceneFileHeader
+followed by the SceneEntity array, read with one fread, and has the
+triangle count of every model filled in.
+*/
+
+# ifndef __INCLUDES465__
+# include "../includes465/include465.hpp"
+# define __INCLUDES465__
+# endif
+
+# include <string.h>
+
+# define SCENE_MAGIC "SCENE465"
+# define SCENE_VERSION 1
+# define SCENE_NAME_SIZE 32
+
+// Entity kinds, the planetary bodies come first
+enum SceneKind { SCENE_STAR, SCENE_PLANET, SCENE_MOON, SCENE_SHIP, SCENE_SILO, SCENE_MISSILE, SCENE_KINDS };
+
+// One entity, the record layout of the binary form
+struct SceneEntity
+{
+	char name[SCENE_NAME_SIZE];
+	char modelFile[SCENE_NAME_SIZE];
+	int kind;				// SceneKind
+	int parent;				// index of the entity it orbits or stands on, or -1
+	int launcher;			// index of the ship or silo that fires this missile, or -1
+	int nIndices;			// 3 * triangles of modelFile, 0 if not counted yet
+	int missiles;			// missile budget of a ship or silo
+	float size;				// bounding radius in world units
+	float rotation;			// radians per update
+	float speed;			// missile speed per update
+	float position[3];		// world position, a silo's offset from its parent
+};
+
+struct SceneFileHeader
+{
+	char magic[8];			// SCENE_MAGIC without its '\0'
+	unsigned int version;	// SCENE_VERSION
+	unsigned int nEntities;
+};
+
+class Scene
+{
+
+protected:
+
+	int capacity;			// entities allocated
+
+	static const char * kindName(int kind)
+	{
+		static const char * names[SCENE_KINDS] = { "star", "planet", "moon", "ship", "silo", "missile" };
+		return kind >= 0 && kind < SCENE_KINDS ? names[kind] : "unknown";
+	}
+
+	// Index of the entity named name among the first nEntities, or -1.
+	int find(const char * name)
+	{
+		for (int i = 0; i < nEntities; i++)
+			if (strcmp(entity[i].name, name) == 0)
+				return i;
+		return -1;
+	}
+
+	// Checks the references and values every loader has to agree on.
+	bool validate(const char * fileName)
+	{
+		for (int i = 0; i < nEntities; i++)
+		{
+			SceneEntity * e = &entity[i];
+			const char * error = NULL;
+
+			if (e->kind < 0 || e->kind >= SCENE_KINDS)
+				error = "has an unknown kind";
+			else if (e->size <= 0.0f)
+				error = "has no size";
+			else if (e->parent < -1 || e->parent >= i || e->launcher < -1 || e->launcher >= i)
+				error = "names an entity not declared before it";
+			else if ((e->kind == SCENE_MOON || e->kind == SCENE_SILO) && e->parent < 0)
+				error = "needs a parent";
+			else if (e->kind == SCENE_MISSILE && (e->launcher < 0 ||
+				(entity[e->launcher].kind != SCENE_SHIP && entity[e->launcher].kind != SCENE_SILO)))
+				error = "needs a ship or silo launcher";
+			else if (e->parent >= 0 && !isBody(e->parent))
+				error = "has a parent that isn't a star, planet or moon";
+
+			if (error != NULL)
+			{
+				printf("Scene error: %s %s %s %s\n", fileName, kindName(e->kind), e->name, error);
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Room for one more entity, the array grows by doubling so it stays contiguous.
+	SceneEntity * append()
+	{
+		if (nEntities == capacity)
+		{
+			capacity = capacity == 0 ? 16 : 2 * capacity;
+			entity = (SceneEntity *)realloc(entity, capacity * sizeof(SceneEntity));
+		}
+		SceneEntity * e = &entity[nEntities++];
+		memset(e, 0, sizeof(SceneEntity));
+		e->parent = e->launcher = -1;
+		return e;
+	}
+
+	bool loadText(FILE * fileIn, const char * fileName)
+	{
+		char line[256];
+		int lineNumber = 0;
+
+		while (fgets(line, sizeof(line), fileIn) != NULL)
+		{
+			lineNumber++;
+			char * comment = strchr(line, '#');
+			if (comment != NULL)
+				*comment = '\0';
+
+			char * token = strtok(line, " \t\r\n");
+			if (token == NULL)
+				continue;
+
+			SceneEntity * e = append();
+			const char * error = NULL;
+
+			e->kind = SCENE_KINDS;
+			for (int k = 0; k < SCENE_KINDS; k++)
+				if (strcmp(token, kindName(k)) == 0)
+					e->kind = k;
+
+			char * name = strtok(NULL, " \t\r\n");
+			char * model = strtok(NULL, " \t\r\n");
+			float value[5];
+			int nValues = 0;
+			for (char * v; nValues < 5 && (v = strtok(NULL, " \t\r\n")) != NULL; nValues++)
+				value[nValues] = (float)atof(v);
+
+			if (e->kind == SCENE_KINDS)
+				error = "unknown kind";
+			else if (nValues < 5)
+				error = "expected kind name model size x y z rotation";
+			else if (strlen(name) >= SCENE_NAME_SIZE || strlen(model) >= SCENE_NAME_SIZE)
+				error = "name or model file too long";
+			else if (find(name) >= 0)
+				error = "duplicate name";
+
+			if (error == NULL)
+			{
+				strcpy(e->name, name);
+				strcpy(e->modelFile, model);
+				e->size = value[0];
+				e->position[0] = value[1];
+				e->position[1] = value[2];
+				e->position[2] = value[3];
+				e->rotation = value[4];
+			}
+
+			// Optional key value pairs, references resolve against the entities read so far
+			for (char * key; error == NULL && (key = strtok(NULL, " \t\r\n")) != NULL; )
+			{
+				char * v = strtok(NULL, " \t\r\n");
+				if (v == NULL)
+					error = "key without a value";
+				else if (strcmp(key, "parent") == 0 || strcmp(key, "launcher") == 0)
+				{
+					int reference = find(v);
+					if (reference < 0 || reference == nEntities - 1)
+						error = "names an entity not declared before it";
+					else if (key[0] == 'p')
+						e->parent = reference;
+					else
+						e->launcher = reference;
+				}
+				else if (strcmp(key, "missiles") == 0)
+					e->missiles = atoi(v);
+				else if (strcmp(key, "speed") == 0)
+					e->speed = (float)atof(v);
+				else if (strcmp(key, "triangles") == 0)
+					e->nIndices = 3 * atoi(v);
+				else
+					error = "unknown key";
+			}
+
+			if (error != NULL)
+			{
+				printf("Scene error: %s line %d: %s\n", fileName, lineNumber, error);
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool loadBinary(FILE * fileIn, const char * fileName)
+	{
+		SceneFileHeader header;
+
+		if (fread(&header, sizeof(header), 1, fileIn) != 1 || header.version != SCENE_VERSION)
+		{
+			printf("Scene error: %s is not a version %d scene\n", fileName, SCENE_VERSION);
+			return false;
+		}
+
+		capacity = nEntities = header.nEntities;
+		entity = (SceneEntity *)malloc(capacity * sizeof(SceneEntity));
+		if (fread(entity, sizeof(SceneEntity), nEntities, fileIn) != (size_t)nEntities)
+		{
+			printf("Scene error: %s is truncated\n", fileName);
+			return false;
+		}
+		for (int i = 0; i < nEntities; i++)
+		{
+			entity[i].name[SCENE_NAME_SIZE - 1] = '\0';
+			entity[i].modelFile[SCENE_NAME_SIZE - 1] = '\0';
+		}
+		return true;
+	}
+
+public:
+
+	SceneEntity * entity;	// nEntities entities in file order
+	int nEntities;
+
+	// Constructor, an empty scene
+	Scene()
+	{
+		entity = NULL;
+		nEntities = capacity = 0;
+	}
+
+	~Scene()
+	{
+		free(entity);
+	}
+
+	/* Loads a text or binary scene, the form is told apart by SCENE_MAGIC.
+	Returns false and leaves the scene empty if the file can't be read or is invalid.
+	*/
+	bool load(const char * fileName)
+	{
+		FILE * fileIn = fopen(fileName, "rb");
+		char magic[8];
+		bool loaded;
+
+		free(entity);
+		entity = NULL;
+		nEntities = capacity = 0;
+		if (fileIn == NULL)
+		{
+			printf("Scene error: can't open %s\n", fileName);
+			return false;
+		}
+
+		if (fread(magic, 1, sizeof(magic), fileIn) == sizeof(magic) && memcmp(magic, SCENE_MAGIC, sizeof(magic)) == 0)
+		{
+			rewind(fileIn);
+			loaded = loadBinary(fileIn, fileName);
+		}
+		else
+		{
+			rewind(fileIn);
+			loaded = loadText(fileIn, fileName);
+		}
+		fclose(fileIn);
+
+		if (!loaded || !validate(fileName))
+		{
+			free(entity);
+			entity = NULL;
+			nEntities = capacity = 0;
+			return false;
+		}
+		return true;
+	}
+
+	// Writes the binary form, returns false on error.
+	bool writeBinary(const char * fileName)
+	{
+		SceneFileHeader header;
+		FILE * fileOut = fopen(fileName, "wb");
+
+		if (fileOut == NULL)
+		{
+			printf("Scene error: can't create %s\n", fileName);
+			return false;
+		}
+		memcpy(header.magic, SCENE_MAGIC, sizeof(header.magic));
+		header.version = SCENE_VERSION;
+		header.nEntities = nEntities;
+		bool written = fwrite(&header, sizeof(header), 1, fileOut) == 1 &&
+			fwrite(entity, sizeof(SceneEntity), nEntities, fileOut) == (size_t)nEntities;
+		fclose(fileOut);
+		return written;
+	}
+
+	// Counts the triangles of every model without a count, each model file is read once. Returns false on error.
+	bool countTriangles()
+	{
+		for (int i = 0; i < nEntities; i++)
+		{
+			if (entity[i].nIndices > 0)
+				continue;
+
+			int j = 0;
+			while (j < i && strcmp(entity[j].modelFile, entity[i].modelFile) != 0)
+				j++;
+			if (j < i)
+				entity[i].nIndices = entity[j].nIndices;
+			else
+			{
+				int nTriangles = countTriModel(entity[i].modelFile);
+				if (nTriangles <= 0)
+					return false;
+				entity[i].nIndices = 3 * nTriangles;
+			}
+		}
+		return true;
+	}
+
+	// True for stars, planets and moons.
+	bool isBody(int index)
+	{
+		return entity[index].kind <= SCENE_MOON;
+	}
+
+	// Index of the nth (from 0) entity of kind, or -1.
+	int findKind(int kind, int n)
+	{
+		for (int i = 0; i < nEntities; i++)
+			if (entity[i].kind == kind && n-- == 0)
+				return i;
+		return -1;
+	}
+
+	// Index of the first missile launched by the entity at index launcher, or -1.
+	int findMissile(int launcher)
+	{
+		for (int i = 0; i < nEntities; i++)
+			if (entity[i].kind == SCENE_MISSILE && entity[i].launcher == launcher)
+				return i;
+		return -1;
+	}
+
+	// Prints one line per entity.
+	void print()
+	{
+		printf("%-16s %-8s %-20s %8s %9s %8s %-16s\n", "entity", "kind", "model", "size", "triangles", "missiles", "parent/launcher");
+		for (int i = 0; i < nEntities; i++)
+		{
+			int reference = entity[i].parent >= 0 ? entity[i].parent : entity[i].launcher;
+			printf("%-16s %-8s %-20s %8.1f %9d %8d %-16s\n", entity[i].name, kindName(entity[i].kind),
+				entity[i].modelFile, entity[i].size, entity[i].nIndices / 3, entity[i].missiles,
+				reference >= 0 ? entity[reference].name : "");
+		}
+	}
+};
@@ -3,6 +3,17 @@ SimpleFragment.glsl
 
 Fragment shader with color input and output.
 
+With LIT defined (see SimpleVertex.glsl) the color is lit by the star's
+diffuse term over a constant ambient and by the point lights of the
+fragment's cluster, otherwise it is drawn as is.  The choice is made when
+the variant is compiled, no fragment branches on it.
+
+The point lights are listed per cluster of the view frustum by
+assignClusterLights(...) in cluster465.hpp, which also sets out the
+Clusters and LightIndices blocks;  CLUSTER_X, CLUSTER_Y, CLUSTER_Z,
+CLUSTER_COUNT, CLUSTER_MAX_LIGHTS and CLUSTER_MAX_INDICES are defined
+with the LIT variant from the same constants.
+
 Mike Barnes
 8/16/2014
 */
@@ -10,8 +21,48 @@ Mike Barnes
 # version 330 core
 
 in vec4 color;
+# ifdef LIT
+in vec3 normal;
+in vec3 toLight;
+in vec3 eyePosition;
+
+// written once per frame into a FrameRing region, see FrameRing.hpp
+layout(std140) uniform Lights {
+  vec4 LightSphere[CLUSTER_MAX_LIGHTS];  // eye space center and radius of influence
+  vec4 LightColor[CLUSTER_MAX_LIGHTS];
+  };
+layout(std140) uniform Clusters {
+  vec4 ClusterScale;  // tiles per pixel in x and y, slices per unit of log depth, log of the near distance
+  uvec4 ClusterCell[CLUSTER_COUNT / 4];  // first entry << 16 | number of entries
+  };
+layout(std140) uniform LightIndices {
+  uvec4 LightIndex[CLUSTER_MAX_INDICES / 8];  // 16 bit light numbers
+  };
+
+const float ambient = 0.25;
+# endif
 out vec4 fragColor;
 
 void main() {
+# ifdef LIT
+  vec3 n = normalize(normal);
+  vec3 light = vec3(ambient + (1.0 - ambient) * max(dot(n, normalize(toLight)), 0.0));
+
+  // only the point lights listed in this fragment's cluster can reach it
+  ivec3 c = clamp(ivec3(vec3(gl_FragCoord.xy * ClusterScale.xy, (log(-eyePosition.z) - ClusterScale.w) * ClusterScale.z)),
+    ivec3(0), ivec3(CLUSTER_X - 1, CLUSTER_Y - 1, CLUSTER_Z - 1));
+  int i = (c.z * CLUSTER_Y + c.y) * CLUSTER_X + c.x;
+  uint cell = ClusterCell[i >> 2][i & 3];
+  uint first = cell >> 16u;
+  for (uint e = first; e < first + (cell & 0xFFFFu); e++) {
+    uint l = (LightIndex[e >> 3u][(e >> 1u) & 3u] >> ((e & 1u) * 16u)) & 0xFFFFu;
+    vec3 toPoint = LightSphere[l].xyz - eyePosition;
+    float d = length(toPoint);
+    float falloff = clamp(1.0 - d * d / (LightSphere[l].w * LightSphere[l].w), 0.0, 1.0);
+    light += LightColor[l].rgb * (falloff * falloff * max(dot(n, toPoint / d), 0.0));
+    }
+  fragColor = vec4(color.rgb * light, color.a);
+# else
   fragColor = color;
-  }
\ No newline at end of file
+# endif
+  }
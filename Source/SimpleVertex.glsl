@@ -1,8 +1,23 @@
 /* 
 SimpleVertex.glsl
 
-Vertex shader with position, color, normal and ModelViewProject
-input and color output.
+Vertex shader with position, color, normal and per instance model
+matrix input and color output.
+
+Model vertices are packed by packTriModel(...) in triMesh465.hpp:
+vPosition is 3 floats or normalized shorts (w reads as 1), vColor is
+normalized RGBA8 and vNormal is an octahedral encoded unit normal in
+2 normalized shorts.
+
+vModelMatrix is a per instance attribute (see MeshRegistry.hpp) so all
+the entities sharing a mesh are drawn with one instanced draw.  The
+attribute locations are fixed so every variant of this shader reads the
+same VAO.
+
+Compiled as two variants by loadShaderVariants(...) in shader465.hpp:
+with LIT defined the eye space normal, position and direction to the
+star are passed on for SimpleFragment.glsl's lighting, without it only
+the color is (the star that is the light).
 
 Mike Barnes
 8/17/2013
@@ -10,14 +25,40 @@ Mike Barnes
 
 # version 330 core
 
-in vec4 vPosition;
-in vec4 vColor;
-in vec3 vNormal;  // not used
+layout(location = 0) in vec4 vPosition;
+layout(location = 1) in vec4 vColor;
+layout(location = 2) in vec2 vNormal;  // octahedral encoded
+layout(location = 3) in mat4 vModelMatrix;  // per instance, includes the mesh's position scale, locations 3 - 6
 
-uniform mat4 ModelViewProjection;  // = projection * view * model
+// written once per frame into a FrameRing region, see FrameRing.hpp
+layout(std140) uniform Camera {
+  mat4 ViewMatrix;
+  mat4 ProjectionMatrix;
+  vec4 LightPosition;  // world space, the star's center
+  };
 out vec4 color;
+# ifdef LIT
+out vec3 normal;  // eye space
+out vec3 toLight;  // eye space, from the vertex to the star
+out vec3 eyePosition;
+
+// inverse of packOctahedral(...)
+vec3 octahedralDecode(vec2 e) {
+  vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+  if (n.z < 0.0)
+    n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+  return normalize(n);
+  }
+# endif
 
 void main() {
+  mat4 modelView = ViewMatrix * vModelMatrix;
+  vec4 position = modelView * vPosition;
   color = vColor;
-  gl_Position = ModelViewProjection * vPosition;
-  }
\ No newline at end of file
+# ifdef LIT
+  normal = normalize(mat3(modelView) * octahedralDecode(vNormal));  // models are scaled uniformly
+  toLight = (ViewMatrix * LightPosition).xyz - position.xyz;
+  eyePosition = position.xyz;
+# endif
+  gl_Position = ProjectionMatrix * position;
+  }
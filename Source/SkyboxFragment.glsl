@@ -0,0 +1,16 @@
+/* 
+SkyboxFragment.glsl
+
+Fragment shader for the cube map skybox, samples the sky in the
+direction from the eye.
+*/
+
+# version 330 core
+
+in vec3 direction;
+uniform samplerCube Sky;
+out vec4 fragColor;
+
+void main() {
+  fragColor = texture(Sky, direction);
+  }
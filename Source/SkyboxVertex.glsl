@@ -0,0 +1,26 @@
+/* 
+SkyboxVertex.glsl
+
+Vertex shader for the cube map skybox, a unit cube around the eye.
+Only the camera's rotation is applied so the sky never gets closer, and
+gl_Position.z = w puts every sky fragment at the far plane:  drawn last
+with GL_LEQUAL, the depth test rejects it wherever a model was drawn.
+*/
+
+# version 330 core
+
+in vec3 vPosition;
+
+// written once per frame into a FrameRing region, see FrameRing.hpp
+layout(std140) uniform Camera {
+  mat4 ViewMatrix;
+  mat4 ProjectionMatrix;
+  };
+
+out vec3 direction;
+
+void main() {
+  direction = vPosition;
+  vec4 position = ProjectionMatrix * vec4(mat3(ViewMatrix) * vPosition, 1.0);
+  gl_Position = position.xyww;
+  }
@@ -2,8 +2,39 @@
 Phase 2: The Warbird's camera, movement, and warp capabilities, gravity, missle sites,
 and intelligens-semita missles are added to the simulation in this phase.
 
-465 utility include files: texture.hpp, glmUtils465.hpp, shader465.hpp, triModel465.hpp
-Header files: Object3D.hpp
+465 utility include files: texture.hpp, glmUtils465.hpp, shader465.hpp, triModel465.hpp, triArchive465.hpp
+Header files: EntityStore.hpp, Warbird.hpp, Missile.hpp, AssetLoader.hpp, Scene.hpp, MeshRegistry.hpp,
+FrameRing.hpp, TripleBuffer.hpp, PerfHud.hpp
+
+The simulation runs on its own thread, one update() per time quantum, and
+publishes a WorldSnapshot of everything display() needs after every tick
+through a lock-free triple buffer. The GLUT thread only draws the latest
+snapshot, so a slow frame never delays a tick and a slow tick never delays a
+frame. Keys that change the simulation are queued for its next tick.
+
+The bodies, ship, missile silos and missiles are read from a scene file
+(warbird.scene by default, see Scene.hpp), so scenario variants run without
+rebuilding.
+
+The sky is a cube map loaded from skyPositiveX.raw ... skyNegativeZ.raw
+(512 x 512, 24bpp, see loadRawCubeMap() in texture.hpp); without them the
+sky is the clear color.
+
+Command line options:
+-scene file     load another text or binary (scene2bin) scene
+-float          upload full precision model vertices instead of quantized ones
+-nopersistent   map the frame ring each frame even where glBufferStorage exists
+-nomdi          draw each indirect command on its own even where multi-draw indirect exists
+-capture file   record every frame to file through a ring of pixel buffers, as YUV4MPEG2 if
+                the name ends in .y4m (ffmpeg -i file.y4m file.mp4), else as raw RGB frames
+
+Headless build (make SourceHeadless, defines __Headless__): no window or GPU,
+an EGL context renders into a framebuffer object on Mesa's llvmpipe, one
+simulation tick per frame on the main thread so every run draws the same
+frames, and the frame times are printed at the end.
+-frames n       render n frames, 1000 by default
+-dump n         write frame n to frameN.ppm, may be given up to 16 times
+-hud            draw the performance HUD, off by default so the frames are the same every run
 
 User commands:
 'v' cycles to the next camera
@@ -24,9 +55,12 @@ User commands:
 'ctrl left' ship "rolls" left
 'ctrl right' ship "rolls" right
 'r' restarts the game
+'h' shows or hides the performance HUD
 */
 
+# ifndef __Headless__
 # define __Mac__
+# endif
 using namespace std;
 
 
@@ -36,120 +70,137 @@ using namespace std;
 # include <stdio.h> 
 # include <time.h>
 # include "../includes465/include465.hpp"
-# include "Object3D.hpp"
+# include "EntityStore.hpp"
 # include "Warbird.hpp"
 # include "Missile.hpp"
-
-
-// Model and camera indexes:
-const int
-RUBERINDEX = 0,
-UNUMINDEX = 1,
-DUOINDEX = 2,
-PRIMUSINDEX = 3,
-SECUNDUSINDEX = 4,
-SHIPINDEX = 5,
-UNUMMISSLESILOINDEX = 6,
-DUOMISSLESILOINDEX = 7,
-SHIPMISSILEINDEX = 8,
-UNUMMISSILEINDEX = 9,
-DUOMISSILEINDEX = 10,
-FRONTCAMERAINDEX = 0, TOPCAMERAINDEX = 1, SHIPCAMERAINDEX = 2, UNUMCAMERAINDEX = 3, DUOCAMERAINDEX = 4;
-
-// Model Information
-const int nModels = 11;  // number of models in this scene
-GLuint vPosition[nModels], vColor[nModels], vNormal[nModels];   // vPosition, vColor, vNormal handles for models
-char * modelFile[nModels] = {
-	"ruber.tri",
-	"unum.tri",
-	"MountainPlanet.tri",
-	"primus.tri",
-	"secundus.tri",
-	"warbird.tri",
-	"MissileSite.tri",
-	"MissileSite.tri",
-	"Missile.tri",
-	"Missile.tri", 
-	"Missile.tri"
-};//modelFile
-int nVertices[nModels] = { 
-	264 * 3, // ruber
-	312 * 3, // unum
-	264 * 3, // duo
-	264 * 3, // primus
-	264 * 3, // secundus
-	2568 * 3, // warbird
-	720 * 3, // Primus missileSilo
-	720 * 3, // Secundus missileSilo
-	282 * 3, // ship missile
-	282 * 3, // Unum missile
-	282 * 3  // Duo missile 
-};//nVertices --> vertex count
-float modelBR[nModels]; // model's bounding radius
-GLuint VAO[nModels];      // Vertex Array Objects
+# include "AssetLoader.hpp"
+# include "Scene.hpp"
+# include "RenderQueue.hpp"
+# include "GLStateCache.hpp"
+# include "MeshRegistry.hpp"
+# include "FrameRing.hpp"
+# include "TripleBuffer.hpp"
+# include "ParticleSystem.hpp"
+# include "PerfHud.hpp"
+# include "FrameCapture.hpp"
+# include <thread>
+# include <mutex>
+# include <vector>
+
+
+// Camera indexes:
+const int FRONTCAMERAINDEX = 0, TOPCAMERAINDEX = 1, SHIPCAMERAINDEX = 2, UNUMCAMERAINDEX = 3, DUOCAMERAINDEX = 4;
+
+// The scene, one model per entity. "-scene file" on the command line selects another one.
+char * sceneFile = "warbird.scene";
+Scene scene;
+
+// Model indexes of the entities the game rules refer to, found in the scene by findSceneRoles()
+int RUBERINDEX, UNUMINDEX, DUOINDEX, SHIPINDEX,
+UNUMMISSLESILOINDEX, DUOMISSLESILOINDEX,
+SHIPMISSILEINDEX, UNUMMISSILEINDEX, DUOMISSILEINDEX;
+
+// Model Information, every array has nModels entries and is allocated in loadScene()
+int nModels;  // number of models in this scene
+int nEntities; // the models and the missile pool, the arrays of entities and drawn instances have this many entries
+GLuint * vPosition, * vColor, * vNormal;   // vPosition, vColor, vNormal handles for models
+char ** modelFile; // model file of each entity
+int * nVertices; //nVertices --> index count, 3 per triangle (the welded vertex count is smaller), 0 if the scene has no count
+float * modelBR; // model's bounding radius
+float * positionScale; // quantized positions are stored divided by this, see packTriModel()
+glm::mat4 * positionScaleMatrix; // scales the packed positions back to model coordinates
+int vertexFormat = TRI_VERTEX_QUANTIZED; // "-float" on the command line selects TRI_VERTEX_FLOAT
+TriLodChain * modelLod; // index ranges of each model's levels of detail
+TriBvh * modelBvh; // collision hierarchy of each model's triangles, set in init()
+int * modelLodLevel; // level each entity was drawn at last frame, selectTriLod() needs it for hysteresis
+int trianglesDrawn = 0; // triangles drawn by the last display()
+char * modelArchiveFile = "models.bin"; // built from the *.tri files by tri2bin, optional
+// Meshes, one per distinct model file, all in one VBO and IBO and drawn with one multi-draw indirect
+int nMeshes;
+int * modelMesh; // mesh of each model
+MeshRegistry * meshRegistry; // queues and draws the instances of every mesh, created in init()
+bool multiDrawIndirect = true; // "-nomdi" on the command line clears it
+int drawCalls = 0; // draws issued by the last display()
+GLStateCache glState; // every bind and enable of display(), drops the redundant ones
+float * modelRadius; // bounding sphere radius of each model in world units, its collider's
+float * sphereX, * sphereY, * sphereZ, * sphereRadius; // bounding spheres of the drawn instances, for culling
+int * visibleInstance; // instances inside the view frustum, from cullSpheres()
+int visibleCount = 0, culledCount = 0; // instances drawn and culled by the last display()
+GLuint sceneVao;   // Vertex Array Object of every mesh
 //shader
-GLuint shaderProgram;
-char * vertexShaderFile = "simpleVertex.glsl";
-char * fragmentShaderFile = "simpleFragment.glsl";
-GLuint MVP;  // ModelViewProjection matrix handle
-// model, view, projection matrices and values to create modelMatrix.
-glm::mat4 modelMatrix[nModels]; // set in display()
+// Model program variants of SimpleVertex.glsl and SimpleFragment.glsl: lit, and emissive for the star that is the light
+const int LITPROGRAM = 0, EMISSIVEPROGRAM = 1, MODELPROGRAMS = 2;
+GLuint modelProgram[MODELPROGRAMS];
+int * modelProgramIndex; // program variant of each model
+char * vertexShaderFile = "SimpleVertex.glsl";
+char * fragmentShaderFile = "SimpleFragment.glsl";
+char * shaderCacheDirectory = "shadercache"; // linked program binaries, "-noshadercache" on the command line compiles every run
+// The Camera uniform block of SimpleVertex.glsl in std140 layout, the model matrix is per instance
+struct CameraBlock
+{
+	glm::mat4 viewMatrix;
+	glm::mat4 projectionMatrix;
+	glm::vec4 lightPosition; // world space, the star's center
+};
+// The Lights and Clusters uniform blocks of SimpleFragment.glsl's LIT variant, LightIndices is clusterLightIndex[]
+struct LightBlock
+{
+	glm::vec4 sphere[CLUSTER_MAX_LIGHTS]; // eye space center and radius of influence
+	glm::vec4 color[CLUSTER_MAX_LIGHTS];
+};
+struct ClusterBlock
+{
+	glm::vec4 scale; // from clusterScale()
+	GLuint cell[CLUSTER_COUNT]; // first entry << 16 | number of entries
+};
+const GLuint cameraBinding = 0; // uniform buffer binding point of the Camera block
+const GLuint lightBinding = 1, clusterBinding = 2, lightIndexBinding = 3; // and of the LIT program's light blocks
+// Byte offsets in a frame ring region, each uniform block on the uniform buffer alignment, set in init()
+GLintptr lightOffset, clusterOffset, lightIndexOffset, instanceOffset, commandOffset;
+FrameRing * frameRing; // each frame's camera block, instance matrices and draw commands, created in init()
+bool persistentMapping = true; // "-nopersistent" on the command line clears it
+int frameRingStalls = 0; // frames that waited for the GPU, printed when it grows
+/* Clustered lighting: the star lights everything, every missile in flight is a point light listed in the clusters it reaches */
+const float nearDistance = 1.0f, farDistance = 100000.0f; // of the projection
+const float missileLightRadius = 800.0f;
+const glm::vec4 missileLightColor(1.0f, 0.55f, 0.2f, 0.0f);
+float lightX[CLUSTER_MAX_LIGHTS], lightY[CLUSTER_MAX_LIGHTS], lightZ[CLUSTER_MAX_LIGHTS], lightRadius[CLUSTER_MAX_LIGHTS]; // eye space
+ClusterBlock clusters; // built by assignClusterLights() each frame and copied into the frame ring
+GLuint clusterLightIndex[CLUSTER_MAX_INDICES / 2];
+int lightCount = 0, lightEntries = 0; // lights and cluster list entries of the last display()
+/* Particles: exhaust behind every missile in flight, an explosion and debris wherever a collision destroys something */
+ParticleSystem particles; // simulated on the simulation thread, display() draws the snapshot's copy
+int missileEmitter[MISSILE_POOL]; // exhaust of each missile of the pool, -1 when it isn't flying
+float particleTime; // the last tick's, on the simulation thread
+// In world units and ticks: exhaust trails each missile at rate particles a tick, an explosion bursts over 3 ticks
+const int exhaustRate = 80;
+const float exhaustSpread = 1.5f, exhaustDrag = 0.97f, exhaustLife = 240.0f;
+const int explosionParticles = 15000, debrisParticles = 5000;
+const float explosionSpread = 30.0f, explosionDrag = 0.93f, explosionLife = 120.0f;
+const float debrisSpread = 12.0f, debrisDrag = 0.998f, debrisLife = 600.0f;
+GLuint particleProgram, particleVao, particleBuffer; // the buffer is orphaned and refilled every frame
+GLint particlePointScale; // PointScale uniform location
+float particlePointScaleSet = 0.0f; // value PointScale was last set to
+int particlesDrawn = 0; // by the last display()
+char * particleVertexShaderFile = "ParticleVertex.glsl";
+char * particleFragmentShaderFile = "ParticleFragment.glsl";
+// view and projection matrices
 glm::mat4 viewMatrix;
 glm::mat4 projectionMatrix; // set in reshape()
-glm::mat4 ModelViewProjectionMatrix; // set in display();
 
 //vectors and values for look at
 glm::vec3 eye, at, up;
 
-float modelSize[nModels] = {
-	2000.0f, // ruber
-	200.0f,  // unum
-	400.0f,  // duo
-	100.0f,  // primus
-	150.0f,  // secundus
-	100.0f,  // warbird
-	100.0f,  // Primus missileSilo ///////////////////////////////////////////////////
-	100.0f,  // Secundus missileSilo /////////////////////////////////////////////////
-	25.0f,   // ship missile
-	25.0f,   // Unum missile
-	25.0f,   // Duo missile
-}; //modelSize, size of model
-   // The rotation amount (in radians) of each object
-float rotationAmount[nModels] = { //checked
-	0.0f,		// Ruber
-	0.004f,		// Unum
-	0.002f,		// Duo
-	0.002f,		// Primus
-	0.004f,		// Secundus
-	0.02f,		// Warbird
-	0.0f,		// Primus Missile Site
-	0.0f,		// Secundus Missile Site
-	0.0f,		// Missile
-	0.0f,		// Unum Missile
-	0.0f		// Duo Missile
-}; //rotationAmount
-glm::vec3 scale[nModels]; // set in init()
-glm::mat4 translationMatrix[nModels];	
-glm::vec3 translatePosition[nModels] = { 
-	glm::vec3(0,0,0), // ruber
-	glm::vec3(4000, 0, 0), // unum
-	glm::vec3(9000, 0, 0), // duo
-	glm::vec3(11000, 0, 0), // primus
-	glm::vec3(13000,0,0), // secundus
-	glm::vec3(15000, 0, 0), // warbird
-	glm::vec3(14500, 0, 0), // Primus Missile Site
-	glm::vec3(7250,0,0), // Secundus Missile Site////////////////////////////???
-	glm::vec3(4900,1000,4850),  // missle/////////////////???
-	glm::vec3(0,0,0),  // Unum missle/////////////////////???
-	glm::vec3(0,0,0)  // Duo missle///////////////////////???
-}; //translatePosition 
-Object3D * object3D[nModels];
-GLuint buffer[nModels];   // Vertex Buffer Objects
+float * modelSize; // size of model
+float * rotationAmount; // The rotation amount (in radians) of each object
+glm::vec3 * translatePosition; // a silo's position is its offset from the body it stands on
+EntityStore * entities; // one entity per model, the entity is the model's index, created in init()
+GLuint sceneBuffer;   // Vertex Buffer Object of every mesh
+GLuint sceneIndexBuffer;   // Element Buffer Object of every mesh
 
 //Vectors and Cameras
 glm::vec3 upVector(0.0f, 1.0f, 0.0f);
 glm::vec3 topVector(1.0f, 0.0f, 0.0f);
-glm::mat4 mainCamera;
 glm::mat4 frontCamera;
 glm::mat4 topCamera;
 glm::mat4 shipCamera;
@@ -160,9 +211,8 @@ glm::vec3 topCamEyePosition(0.0f, 20000.0f, 0.0f);
 glm::vec3 shipCamEyePosition(0.0f, 300.0f, 1000.0f);
 glm::vec3 planetCamEyePosition(-4000.0f, 0.0f, -4000.0f);
 char * cameraNames[5] = { "Front Camera", "Top Camera", "Ship Camera", "Unum Camera", "Duo Camera" };
-int currentCamera = 0;
-//int maxCameras = 5;
-int maxCameras = sizeof(cameraNames);
+std::atomic<int> currentCamera(0); // set by the keys on the GLUT thread and by collisions on the simulation thread
+const int maxCameras = sizeof(cameraNames) / sizeof(cameraNames[0]);
 glm::vec3 shipPosition;
 glm::vec3 camPosition;
 
@@ -173,13 +223,12 @@ float eyeDistance;
 glm::mat4 identityMatrix(1.0f); // initialized identity matrix.
 float unumGravityVector = 1.11f;//////////////////??????????????????????????
 float duoGravityVector = 5.63f;//////////////////??????????????????????????
-glm::mat4 transformMatrix[nModels];
 glm::vec3 rotationalAxis(0.0f, 1.0f, 0.0f);
 
+int windowWidth = 800, windowHeight = 600; // set in reshape(), used for projected model sizes and the HUD
 int timerDelay = 25, frameCount = 0; // A delay of 5 milliseconds is 200 updates / second // changed from delay of 5
 int timeQuantumState = 0;
 double currentTime, lastTime, timeInterval;
-bool idleTimerFlag = false;  // interval or idle timer ?
 bool wireFrame = false; //initially show surfaces
 //Gravities
 bool gravityState = 0;
@@ -195,7 +244,6 @@ const int maxWarpSpots = 3;
 glm::vec3 warpPosition(1000, 0.0f,-3000);
 
 /* Ship Global variables */
-glm::mat4 shipOrientationMatrix;
 glm::vec3 shipUp(0.0f, 1.0f, 0.0f);
 glm::vec3 shipRight(1.0f , 0.0f, 0.0f);
 glm::vec3 shipLookingAt(0.0f, 0.0f, -1.0f); //////////////////??????????????????????????
@@ -204,36 +252,25 @@ int shipSpeedState = 0;
 int totalSpeeds = 3;
 Warbird * warbird;
 float shipSpeed[3] = { 10.0f, 50.0f, 200.0f }; //(min, average, max)
-int shipMissiles = 9;
 
-// Ship Missle Variables 
-float shipMissleSpeed = 10;
-Missile * shipMissile;
-Object3D * shipMissileTarget;
+// Missiles: the warbird and each site fire salvos from one pool, as many fly at once as it holds
+MissilePool missilePool; // created in init()
+enum { SHIPLAUNCHER, UNUMLAUNCHER, DUOLAUNCHER, LAUNCHERS };
+Launcher launcher[LAUNCHERS]; // set up in loadScene(), missile budgets set from the scene by resetMissileCounts()
+const int shipSalvo = 1, siloSalvo = 2; // missiles fired at once
+const int shipReload = 30, siloReload = 600; // ticks from one salvo to the next
+const float salvoSpacing = 40.0f; // between the missiles of a salvo
+const glm::vec3 shipRackOffset(-33, 0, -30); // the warbird's missile rides beside it
 
 // General Missile Variables 
-glm::mat4 missileLocation;
-glm::mat4 targetLocation;
-float length;
-float unumLength;
-float duoLength;
-glm::vec3 targetPositionVector;
-glm::vec3 missilePositionVector;
 const int missileActivationTimer = 200; //missile doesn't detect for 200 updates
-const int missleLifetime = 2000; //lives for 2000 frames
 float detectionRadius = 10000.0f; // or 25?
 
 // Missle Site Variables
-int unumMissiles = 5;
-int duoMissiles = 5;
-float siteMissleSpeed = 5;
-Missile * unumMissile;
-Missile * duoMissile;
 bool unumMissileSiloAlive = true;
 bool duoMissileSiloAlive = true;
 
 // Collision Variables 
-glm::vec3 objectPosition;
 glm::mat4 objectOrientationMatrix;
 
 // Cadet, timer variables, update rate is based on time quantum (TQ)
@@ -251,103 +288,280 @@ int timerIndex = 0;
 int gameState = 0;
 bool hasRestarted = false;
 const int start = 0, win = 1, lose = 2;
-char titleStr[175];
+char titleStr[320];
 char fpsStr[15];
+char triangleStr[128];
 char baseStr[45] = "Warbird Simulator: {v, x, s, t, f, g, w, r} ";
-char warbirdMissleCount[14] = "| Warbird 9";
-char unumMissleCount[11] = " | Unum 5";
-char duoMissleCount[15] = " | Duo 5";
+char warbirdMissleCount[24];
+char unumMissleCount[24];
+char duoMissleCount[24];
 char cameraStr[30] = "| View: Front Camera ";
 char * timerStr[4] = { " | U/S 200 ", " | U/S 25 ", " | U/S 10 ", " | U/S 2 " };
 char winGameStr[29] = "Cadet passes flight training";
 char loseGameStr[31] = "Cadet resigns from War College";
+int shownGameState = start; // game state the window title shows
 
-/* Vertex Buffer and Array Objects */
-GLuint textIBO;
-GLuint textBuf;
-GLuint textVao;
-
-/* Variables that reference texture information
-   in the vertex and fragment shader programs*/
-GLuint TexturePosition;
-GLuint vTextCoord;
-GLuint IsTexture;
-GLuint texture;
-GLuint Texture;
-glm::mat4 modelViewMatrix;
-GLuint NormalMatrix;
-GLuint ModelViewMatrix;
-glm::mat3 normalMatrix;
-glm::mat4 modelViewProjectionMatrix;
-
-/* Square information used to draw the Square texture Box for the program */
-
-/* Default rotation and translation matrices for th texture*/
-glm::mat4 squareRotation = glm::mat4();
-glm::mat4 translateSquare = glm::mat4();
-
-const int numberOfSquares = 6;
-float squareRotationAmount = 0.0f;	// default rotation amount
-
-/*The order the vertices will be drawn*/
-static const unsigned int indices[] = {
-	0, 1, 2,
-	2, 3, 0
+/* The state display() draws, written by the simulation thread after every tick */
+struct WorldSnapshot
+{
+	glm::mat4 * modelMatrix; // of each drawn instance, the entity's orientation times its scale
+	int * drawEntity, * drawModel; // entity and model of each drawn instance
+	int nDrawn;
+	glm::mat4 camera[5]; // view matrix of each camera index
+	glm::vec4 lightPosition; // world space, the star's center
+	glm::vec3 * light; // world position of each missile in flight, CLUSTER_MAX_LIGHTS entries
+	int nLights;
+	glm::vec4 * particle; // position, kind + spent life of each particle, PARTICLE_MAX entries
+	int nParticles;
+	int gameState, timerIndex;
+	int shipMissiles, unumMissiles, duoMissiles;
+	long tick; // ticks simulated so far
+	float updateTime, missileTime, collisionTime, particleTime; // milliseconds the tick spent in update(), handleMissiles(), collisionCheck() and on particles
 };
+TripleBuffer<WorldSnapshot> snapshots;
+std::thread * simulationThread = NULL;
+std::atomic<bool> simulationRunning(false);
 
-/*The texture coordinates and order */
-static const GLfloat textCoords[] = {
-	0.0f, 1.0f,
-	1.0f, 1.0f,
-	1.0f, 0.0f,
-	0.0f, 0.0f,
+/* Keys that change the simulation, queued by the GLUT callbacks for the next tick */
+struct KeyEvent
+{
+	int key;
+	bool special; // a GLUT_KEY_* from handleSpecialKeypress()
+	bool ctrl;
 };
-
-/*Locations of the vertices*/
-static const GLfloat squareVertices[16] = {
-	-50000.0f, -50000.0f, 0.0f, 1.0f,	// BL
-	50000.0f, -50000.0f, 0.0f, 1.0f,	// BR
-	50000.0f, 50000.0f, 0.0f, 1.0f,		// TR
-	-50000.0f, 50000.0f, 0.0f, 1.0f		// TL
+std::mutex keyMutex;
+std::vector<KeyEvent> keyQueue;
+
+/* Performance HUD: rolling percentiles of the frame time, CPU phases and GPU passes */
+PerfHud * perfHud;
+GLuint hudProgram;
+char * hudVertexShaderFile = "HudVertex.glsl";
+char * hudFragmentShaderFile = "HudFragment.glsl";
+int hudUpdate, hudMissiles, hudCollisions, hudParticles, hudLights, hudCapture, hudDisplay, hudSwap; // CPU phase series
+int hudScenePass, hudSkyPass, hudParticlePass, hudHudPass; // GPU pass series
+long hudTick = -1; // tick whose phase times the HUD has, each drawn tick adds its times once
+long simulationTick = 0;
+float updateTime, missileTime, collisionTime; // the last tick's phase times, on the simulation thread
+# ifdef __Headless__
+bool showHud = false; // "-hud" on the command line, the HUD's numbers differ from run to run
+# else
+bool showHud = true; // 'h' toggles it
+# endif
+
+/* Frame capture: "-capture file" on the command line reads each frame back without waiting for it */
+FrameCapture frameCapture;
+char * captureFile = NULL;
+int captureRate = 60; // frames per second written in the Y4M header
+
+# ifdef __Headless__
+HeadlessTarget headless; // EGL context and framebuffer drawn into instead of a window
+int headlessFrames = 1000; // "-frames n" on the command line
+int dumpFrame[16]; // "-dump n" on the command line writes frame n
+int nDumpFrames = 0;
+# endif
+
+/* Skybox: a cube around the eye drawn last at the far plane, sampled from a cube map */
+GLuint skyboxProgram;
+char * skyboxVertexShaderFile = "SkyboxVertex.glsl";
+char * skyboxFragmentShaderFile = "SkyboxFragment.glsl";
+GLuint skyboxVao, skyboxBuffer, skyboxIndexBuffer;
+GLuint skyboxTexture; // 0 if a face couldn't be loaded, then the clear color is the sky
+const char * skyboxFile[6] = { // +x, -x, +y, -y, +z, -z faces, 24bpp *.raw
+	"skyPositiveX.raw", "skyNegativeX.raw",
+	"skyPositiveY.raw", "skyNegativeY.raw",
+	"skyPositiveZ.raw", "skyNegativeZ.raw"
+};
+const int skyboxSize = 512; // texels along a face's edge
+
+/* Corner i of the cube is at x, y, z = -1 or 1 from bits 0, 1, 2 of i */
+static const GLfloat skyboxVertices[8 * 3] = {
+	-1.0f, -1.0f, -1.0f,	1.0f, -1.0f, -1.0f,
+	-1.0f, 1.0f, -1.0f,		1.0f, 1.0f, -1.0f,
+	-1.0f, -1.0f, 1.0f,		1.0f, -1.0f, 1.0f,
+	-1.0f, 1.0f, 1.0f,		1.0f, 1.0f, 1.0f
 };
 
-/* Locations of each plane */
-glm::vec3 squareTranslationAmounts[6] = {
-	glm::vec3(0.0f, 0.0f, -50000.0f),
-	glm::vec3(0.0f, 0.0f, 50000.0f),
-	glm::vec3(0.0f, -50000.0f, 0.0f),
-	glm::vec3(0.0f, 50000.0f, 0.0f),
-	glm::vec3(-50000.0f, 0.0f, 0.0f),
-	glm::vec3(50000.0f, 0.0f, 0.0f)
+/* Two triangles per face:  -x, +x, -y, +y, -z, +z */
+static const unsigned int skyboxIndices[36] = {
+	0, 2, 6, 6, 4, 0,
+	1, 5, 7, 7, 3, 1,
+	0, 4, 5, 5, 1, 0,
+	2, 3, 7, 7, 6, 2,
+	0, 1, 3, 3, 2, 0,
+	4, 6, 7, 7, 5, 4
 };
 
-/* What axis to rotate each plane on */
-glm::vec3 squareRotationAxis[6] = {
-	glm::vec3(0.0f, 1.0f, 0.0f),
-	glm::vec3(0.0f, 1.0f, 0.0f),
-	glm::vec3(1.0f, 0.0f, 0.0f),
-	glm::vec3(1.0f, 0.0f, 0.0f),
-	glm::vec3(0.0f, 1.0f, 0.0f),
-	glm::vec3(0.0f, 1.0f, 0.0f),
+// Milliseconds since start, for the HUD's CPU phase times.
+float millisecondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
 
-};
+// Sets the missile budgets from the scene and reloads every launcher, at start and on restart.
+void resetMissileCounts()
+{
+	for (int l = 0; l < LAUNCHERS; l++)
+	{
+		launcher[l].missiles = scene.entity[launcher[l].entity].missiles;
+		launcher[l].cooldown = 0;
+	}
+}
 
-// To maximize efficiency, operations that only need to be called once are called in init().
-void init()
+// Sets up entity to fire rack's missile from rackOffset in salvos of salvo, reload ticks apart
+void setLauncher(Launcher * l, int entity, int rack, glm::vec3 rackOffset, int salvo, int reload)
+{
+	l->entity = entity;
+	l->rack = rack;
+	l->rackOffset = rackOffset;
+	l->speed = scene.entity[rack].speed;
+	l->salvo = salvo;
+	l->reload = reload;
+	l->missiles = 0;
+	l->cooldown = 0;
+}
+
+/*
+	Finds the entities the game rules refer to: the first star, the first two planets
+	(Unum and Duo), the first ship (the warbird), the first two silos and the missile
+	each of the ship and the silos launches. Any other entity is only drawn and collided with.
+*/
+bool findSceneRoles()
 {
-	// Load the shader programs
-	shaderProgram = loadShaders(vertexShaderFile, fragmentShaderFile);//check
-	glUseProgram(shaderProgram);//check
+	RUBERINDEX = scene.findKind(SCENE_STAR, 0);
+	UNUMINDEX = scene.findKind(SCENE_PLANET, 0);
+	DUOINDEX = scene.findKind(SCENE_PLANET, 1);
+	SHIPINDEX = scene.findKind(SCENE_SHIP, 0);
+	UNUMMISSLESILOINDEX = scene.findKind(SCENE_SILO, 0);
+	DUOMISSLESILOINDEX = scene.findKind(SCENE_SILO, 1);
+	if (RUBERINDEX < 0 || UNUMINDEX < 0 || DUOINDEX < 0 || SHIPINDEX < 0 || UNUMMISSLESILOINDEX < 0 || DUOMISSLESILOINDEX < 0)
+	{
+		printf("%s needs a star, two planets, a ship and two silos\n", sceneFile);
+		return false;
+	}
+
+	SHIPMISSILEINDEX = scene.findMissile(SHIPINDEX);
+	UNUMMISSILEINDEX = scene.findMissile(UNUMMISSLESILOINDEX);
+	DUOMISSILEINDEX = scene.findMissile(DUOMISSLESILOINDEX);
+	if (SHIPMISSILEINDEX < 0 || UNUMMISSILEINDEX < 0 || DUOMISSILEINDEX < 0)
+	{
+		printf("%s needs a missile launched by the ship and by each silo\n", sceneFile);
+		return false;
+	}
+	return true;
+}
 
-	// Generate VAOs and VBOs
-	glGenVertexArrays(nModels, VAO);
-	glGenBuffers(nModels, buffer);
+// Loads sceneFile and allocates and fills the model arrays, one entry per entity.
+bool loadScene()
+{
+	if (!scene.load(sceneFile) || !findSceneRoles())
+		return false;
+
+	nModels = scene.nEntities;
+	nEntities = nModels + MISSILE_POOL;
+	vPosition = new GLuint[nModels];
+	vColor = new GLuint[nModels];
+	vNormal = new GLuint[nModels];
+	modelFile = new char *[nModels];
+	nVertices = new int[nModels];
+	modelBR = new float[nModels];
+	positionScale = new float[nModels];
+	positionScaleMatrix = new glm::mat4[nModels];
+	modelLod = new TriLodChain[nModels];
+	modelBvh = new TriBvh[nModels];
+	modelLodLevel = new int[nEntities];
+	modelProgramIndex = new int[nModels];
+	modelMesh = new int[nModels];
+	modelRadius = new float[nModels];
+	sphereX = new float[nEntities];
+	sphereY = new float[nEntities];
+	sphereZ = new float[nEntities];
+	sphereRadius = new float[nEntities];
+	visibleInstance = new int[nEntities];
+	modelSize = new float[nModels];
+	rotationAmount = new float[nModels];
+	translatePosition = new glm::vec3[nModels];
+	for (int i = 0; i < 3; i++)
+	{
+		snapshots.getSlot(i)->modelMatrix = new glm::mat4[nEntities];
+		snapshots.getSlot(i)->drawEntity = new int[nEntities];
+		snapshots.getSlot(i)->drawModel = new int[nEntities];
+		snapshots.getSlot(i)->nDrawn = 0;
+		snapshots.getSlot(i)->light = new glm::vec3[CLUSTER_MAX_LIGHTS];
+		snapshots.getSlot(i)->nLights = 0;
+		snapshots.getSlot(i)->particle = new glm::vec4[PARTICLE_MAX];
+		snapshots.getSlot(i)->nParticles = 0;
+	}
 
-	// Load the buffers from the model files, generate VAOs and VBOs
 	for (int i = 0; i < nModels; i++)
 	{
-		modelBR[i] = loadModelBuffer(modelFile[i], nVertices[i], VAO[i], buffer[i], shaderProgram,
-			vPosition[i], vColor[i], vNormal[i], "vPosition", "vColor", "vNormal");
+		SceneEntity * e = &scene.entity[i];
+		modelFile[i] = e->modelFile;
+		nVertices[i] = e->nIndices;
+		modelSize[i] = e->size;
+		rotationAmount[i] = e->rotation;
+		translatePosition[i] = glm::vec3(e->position[0], e->position[1], e->position[2]);
+	}
+
+	// The warbird's missile rides beside it, a site's inside it
+	setLauncher(&launcher[SHIPLAUNCHER], SHIPINDEX, SHIPMISSILEINDEX, shipRackOffset, shipSalvo, shipReload);
+	setLauncher(&launcher[UNUMLAUNCHER], UNUMMISSLESILOINDEX, UNUMMISSILEINDEX, glm::vec3(0.0f), siloSalvo, siloReload);
+	setLauncher(&launcher[DUOLAUNCHER], DUOMISSLESILOINDEX, DUOMISSILEINDEX, glm::vec3(0.0f), siloSalvo, siloReload);
+	resetMissileCounts();
+	printf("loaded %d entities from %s\n", nModels, sceneFile);
+	return true;
+}
+
+// To maximize efficiency, operations that only need to be called once are called in init().
+void init()
+{
+	std::chrono::steady_clock::time_point initStart = std::chrono::steady_clock::now();
+
+	// Prefer the precompiled model archive, any model missing from it is parsed from its *.tri file
+	TriArchive modelArchive;
+	openTriArchive(modelArchiveFile, &modelArchive);
+
+	// Parse every distinct model file on worker threads while the shaders compile
+	AssetLoader assetLoader(modelFile, nVertices, nModels, vertexFormat, &modelArchive);
+	assetLoader.start();
+
+	// Load every shader program in one batch, the driver may compile them in parallel
+	char litDefines[256]; // the cluster grid's constants, see cluster465.hpp
+	snprintf(litDefines, sizeof(litDefines), "#define LIT\n#define CLUSTER_X %d\n#define CLUSTER_Y %d\n#define CLUSTER_Z %d\n"
+		"#define CLUSTER_COUNT %d\n#define CLUSTER_MAX_LIGHTS %d\n#define CLUSTER_MAX_INDICES %d\n",
+		CLUSTER_X, CLUSTER_Y, CLUSTER_Z, CLUSTER_COUNT, CLUSTER_MAX_LIGHTS, CLUSTER_MAX_INDICES);
+	ShaderVariant shaderVariant[] = {
+		{ vertexShaderFile, fragmentShaderFile, litDefines },			// LITPROGRAM
+		{ vertexShaderFile, fragmentShaderFile, "" },					// EMISSIVEPROGRAM
+		{ skyboxVertexShaderFile, skyboxFragmentShaderFile, "" },
+		{ hudVertexShaderFile, hudFragmentShaderFile, "" },
+		{ particleVertexShaderFile, particleFragmentShaderFile, "" } };
+	loadShaderVariants(shaderVariant, sizeof(shaderVariant) / sizeof(shaderVariant[0]), shaderCacheDirectory);
+	for (int p = 0; p < MODELPROGRAMS; p++)
+		modelProgram[p] = shaderVariant[p].program;
+	skyboxProgram = shaderVariant[MODELPROGRAMS].program;
+	hudProgram = shaderVariant[MODELPROGRAMS + 1].program;
+	particleProgram = shaderVariant[MODELPROGRAMS + 2].program;
+
+	// Generate the VAO, VBO and IBO every mesh shares
+	nMeshes = assetLoader.getAssetCount();
+	glGenVertexArrays(1, &sceneVao);
+	glGenBuffers(1, &sceneBuffer);
+	glGenBuffers(1, &sceneIndexBuffer);
+	meshRegistry = new MeshRegistry(modelProgram, MODELPROGRAMS, "vModelMatrix", sceneVao, nMeshes, nEntities,
+		nearDistance, farDistance, multiDrawIndirect, &glState);
+
+	assetLoader.wait();
+
+	// Upload the parsed models one after the other into the shared VBO and IBO and set up the VAO
+	assetLoader.upload(sceneVao, sceneBuffer, sceneIndexBuffer, modelProgram[LITPROGRAM],
+		vPosition[0], vColor[0], vNormal[0], "vPosition", "vColor", "vNormal");
+
+	entities = new EntityStore(nEntities);
+	for (int i = 0; i < nModels; i++)
+	{
+		int mesh = modelMesh[i] = assetLoader.getAsset(i);
+		modelBR[i] = assetLoader.getBoundingRadius(i);
+		positionScale[i] = assetLoader.getPositionScale(i);
 
 		if (modelBR[i] == -1.0f)
 		{
@@ -359,13 +573,46 @@ void init()
 			printf("loaded %s model with %7.2f bounding radius \n", modelFile[i], modelBR[i]);
 		}
 
-		// set scale for models given bounding radius  
-		scale[i] = glm::vec3(modelSize[i] / modelBR[i]);
+		// Each model is an entity drawn as it, scaled to its size given its bounding radius
+		entities->create(modelSize[i] / modelBR[i]);
+		entities->shape.add(i)->model = i;
+		positionScaleMatrix[i] = glm::scale(identityMatrix, glm::vec3(positionScale[i]));
+		modelLod[i] = *assetLoader.getLodChain(i);
+		meshRegistry->setMesh(mesh, assetLoader.getBaseVertex(i), assetLoader.getFirstIndex(i), &modelLod[i]);
+		modelBvh[i] = *assetLoader.getBvh(i);
+		modelRadius[i] = entities->collider.add(i)->radius = modelBvh[i].radius * entities->transform[i].scale;
+		modelProgramIndex[i] = scene.entity[i].kind == SCENE_STAR ? EMISSIVEPROGRAM : LITPROGRAM;
 	}
 
-	MVP = glGetUniformLocation(shaderProgram, "ModelViewProjection");
-	ModelViewMatrix = glGetUniformLocation(shaderProgram, "ModelViewMatrix");
-	NormalMatrix = glGetUniformLocation(shaderProgram, "NormalMatrix");
+	// Then the missiles, free until a launcher fires them
+	missilePool.create(entities, missileActivationTimer);
+	for (int e = 0; e < nEntities; e++)
+		modelLodLevel[e] = 0;
+	for (int m = 0; m < MISSILE_POOL; m++)
+		missileEmitter[m] = -1;
+
+	// The VBOs hold their own copies, the mapping is no longer needed
+	closeTriArchive(&modelArchive);
+
+	assetLoader.printTimings();
+	printf("assets and shaders loaded in %.3f ms\n",
+		std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - initStart).count());
+
+	for (int p = 0; p < MODELPROGRAMS; p++)
+		glUniformBlockBinding(modelProgram[p], glGetUniformBlockIndex(modelProgram[p], "Camera"), cameraBinding);
+	glUniformBlockBinding(modelProgram[LITPROGRAM], glGetUniformBlockIndex(modelProgram[LITPROGRAM], "Lights"), lightBinding);
+	glUniformBlockBinding(modelProgram[LITPROGRAM], glGetUniformBlockIndex(modelProgram[LITPROGRAM], "Clusters"), clusterBinding);
+	glUniformBlockBinding(modelProgram[LITPROGRAM], glGetUniformBlockIndex(modelProgram[LITPROGRAM], "LightIndices"), lightIndexBinding);
+
+	// A frame ring region holds the camera, lights and cluster blocks, then the instance matrices and draw commands
+	GLint alignment = 256;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	lightOffset = (sizeof(CameraBlock) + alignment - 1) / alignment * alignment;
+	clusterOffset = (lightOffset + sizeof(LightBlock) + alignment - 1) / alignment * alignment;
+	lightIndexOffset = (clusterOffset + sizeof(ClusterBlock) + alignment - 1) / alignment * alignment;
+	instanceOffset = lightIndexOffset + sizeof(clusterLightIndex);
+	commandOffset = instanceOffset + nEntities * sizeof(glm::mat4);
+	frameRing = new FrameRing(commandOffset + meshRegistry->getMaxCommands() * sizeof(DrawElementsCommand), persistentMapping);
 
 
 
@@ -397,69 +644,99 @@ void init()
 		translatePosition[SHIPINDEX],           // look at position
 		upVector); // up vect0r
 
-	mainCamera = frontCamera;
-
 	// set render state values
 	glEnable(GL_DEPTH_TEST);
 	glClearColor(0.7f, 0.7f, 0.7f, 1.0f); // Establishes what color the window will be cleared to.
 
-	// Create and set attributes for all 3D objects:
+	/* Every entity with a parent moves with it: a planet or moon starts at its offset from its
+	parent and orbits it, a silo stands at its offset. A body with a rotation turns at that rate,
+	the others never move and cost nothing a tick. The ship and missiles are steered.
+	*/
 	for (int i = 0; i < nModels; i++)
 	{
-		object3D[i] = new Object3D(modelSize[i], modelBR[i]);
-		object3D[i]->setTranslationMatrix(translatePosition[i]);
-		object3D[i]->setRotationAmount(rotationAmount[i]);
+		int parent = scene.entity[i].parent;
+		bool orbits = scene.entity[i].kind == SCENE_PLANET || scene.entity[i].kind == SCENE_MOON;
+		glm::vec3 offset = translatePosition[i];
+		if (parent >= 0)
+		{
+			entities->setParent(i, parent);
+			if (scene.entity[i].kind != SCENE_SILO)
+				offset -= translatePosition[parent];
+		}
+		entities->setLocal(i, offset, glm::quat(1.0f, 0.0f, 0.0f, 0.0f));
+		if (rotationAmount[i] == 0.0f || scene.entity[i].kind == SCENE_SHIP || scene.entity[i].kind == SCENE_MISSILE)
+			continue;
+		Kinematics * k = entities->kinematics.add(i);
+		k->rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+		k->translation = offset;
+		k->turn = glm::angleAxis(rotationAmount[i], glm::vec3(0, 1, 0));
+		k->orbit = orbits;
+	}
 
-		// Set the planet flags:
-		if (i == UNUMINDEX || i == DUOINDEX)
-			object3D[i]->setOrbit();
+	// Each launcher's missile rides on it, until it has fired them all
+	for (int l = 0; l < LAUNCHERS; l++)
+	{
+		entities->setParent(launcher[l].rack, launcher[l].entity);
+		entities->setLocal(launcher[l].rack, launcher[l].rackOffset, glm::quat(1.0f, 0.0f, 0.0f, 0.0f));
 	}
 
 	// Create the warbird:
-	warbird = new Warbird(modelSize[SHIPINDEX], modelBR[SHIPINDEX], translatePosition[SHIPINDEX]);
-	warbird->setTranslationMatrix(translatePosition[SHIPINDEX]);
-	warbird->setRotationAmount(rotationAmount[SHIPINDEX]);
-	warbird->setPosition(translatePosition[SHIPINDEX]);
-
-	// Create the ship missle:
-	shipMissile = new Missile(modelSize[SHIPMISSILEINDEX], modelBR[SHIPMISSILEINDEX], shipMissleSpeed);
-
-	// Create the Unum Missile:
-	unumMissile = new Missile(modelSize[UNUMMISSILEINDEX], modelBR[UNUMMISSILEINDEX], siteMissleSpeed);
-
-	// Create the Duo Missile:
-	duoMissile = new Missile(modelSize[DUOMISSILEINDEX], modelBR[DUOMISSILEINDEX], siteMissleSpeed);
-
-	// set up the indices buffer
-	glGenBuffers(1, &textIBO);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, textIBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
-
-	// set up the vertex attributes
-	glGenVertexArrays(1, &textVao);
-	glBindVertexArray(textVao);
-
-	//  initialize a buffer object
-	glGenBuffers(1, &textBuf);
-	glBindBuffer(GL_ARRAY_BUFFER, textBuf);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(squareVertices) + sizeof(textCoords), NULL, GL_STATIC_DRAW);
-	glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(squareVertices), squareVertices);
-	glBufferSubData(GL_ARRAY_BUFFER, sizeof(squareVertices), sizeof(textCoords), textCoords);
-
-	// set up vertex arrays
-	TexturePosition = glGetAttribLocation(shaderProgram, "vPosition");
-	glVertexAttribPointer(TexturePosition, 4, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(0));
-	glEnableVertexAttribArray(TexturePosition);
-
-	vTextCoord = glGetAttribLocation(shaderProgram, "vTextCoord");
-	glVertexAttribPointer(vTextCoord, 2, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(sizeof(squareVertices)));
-	glEnableVertexAttribArray(vTextCoord);
-
-	// Set the intial texture indicator to false
-	// This variable indicates when the texture is being drawn
-	IsTexture = glGetUniformLocation(shaderProgram, "IsTexture");
-	glUniform1ui(IsTexture, false);
-
+	warbird = new Warbird(entities, SHIPINDEX, translatePosition[SHIPINDEX], rotationAmount[SHIPINDEX]);
+
+	// Set up the skybox, its program shares the Camera block of the frame ring
+	glUniformBlockBinding(skyboxProgram, glGetUniformBlockIndex(skyboxProgram, "Camera"), cameraBinding);
+	glUseProgram(skyboxProgram);
+	glUniform1i(glGetUniformLocation(skyboxProgram, "Sky"), 0); // texture unit 0
+	skyboxTexture = loadRawCubeMap(skyboxFile, skyboxSize);
+	if (skyboxTexture == 0)
+		printf("skybox faces not loaded, the sky is the clear color\n");
+
+	glGenVertexArrays(1, &skyboxVao);
+	glBindVertexArray(skyboxVao);
+	glGenBuffers(1, &skyboxBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, skyboxBuffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(skyboxVertices), skyboxVertices, GL_STATIC_DRAW);
+	glGenBuffers(1, &skyboxIndexBuffer); // after skyboxVao is bound so no model's element buffer is replaced
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, skyboxIndexBuffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(skyboxIndices), skyboxIndices, GL_STATIC_DRAW);
+	GLuint skyboxPosition = glGetAttribLocation(skyboxProgram, "vPosition");
+	glVertexAttribPointer(skyboxPosition, 3, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(0));
+	glEnableVertexAttribArray(skyboxPosition);
+	glBindVertexArray(0);
+
+	// Set up the particles, point sprites sized by the vertex shader
+	glUniformBlockBinding(particleProgram, glGetUniformBlockIndex(particleProgram, "Camera"), cameraBinding);
+	particlePointScale = glGetUniformLocation(particleProgram, "PointScale");
+	glGenVertexArrays(1, &particleVao);
+	glBindVertexArray(particleVao);
+	glGenBuffers(1, &particleBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, particleBuffer);
+	glBufferData(GL_ARRAY_BUFFER, PARTICLE_MAX * sizeof(glm::vec4), NULL, GL_STREAM_DRAW);
+	GLuint particleAttribute = glGetAttribLocation(particleProgram, "vParticle");
+	glVertexAttribPointer(particleAttribute, 4, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(0));
+	glEnableVertexAttribArray(particleAttribute);
+	glBindVertexArray(0);
+	glEnable(GL_PROGRAM_POINT_SIZE);
+	printf("particles: up to %d, integrated with %s\n", PARTICLE_MAX, particles.usesAvx2() ? "AVX2" : "SSE2 or scalar code");
+
+	// Set up the performance HUD, its series in the order of its table
+	perfHud = new PerfHud(hudProgram, &glState);
+	hudUpdate = perfHud->addCpuPhase("UPDATE");
+	hudMissiles = perfHud->addCpuPhase("MISSILES");
+	hudCollisions = perfHud->addCpuPhase("COLLISIONS");
+	hudParticles = perfHud->addCpuPhase("PARTICLES");
+	hudLights = perfHud->addCpuPhase("LIGHTS");
+	hudCapture = perfHud->addCpuPhase("CAPTURE");
+	hudDisplay = perfHud->addCpuPhase("DISPLAY");
+	hudSwap = perfHud->addCpuPhase("SWAP");
+	hudScenePass = perfHud->addGpuPass("SCENE");
+	hudSkyPass = perfHud->addGpuPass("SKY");
+	hudParticlePass = perfHud->addGpuPass("PARTICLES");
+	hudHudPass = perfHud->addGpuPass("HUD");
+	perfHud->setVisible(showHud);
+
+	// init() changed state directly, the cache starts from nothing known
+	glState.invalidate();
 
 	//get ellapsed time
 	lastTime = glutGet(GLUT_ELAPSED_TIME);
@@ -477,20 +754,28 @@ void reshape(int width, int height)
 	float FOVY = glm::radians(60.0f);
 
 	glViewport(0, 0, width, height);
-	projectionMatrix = glm::perspective(FOVY, aspectRatio, 1.0f, 100000.0f);
+	windowWidth = width;
+	windowHeight = height;
+	projectionMatrix = glm::perspective(FOVY, aspectRatio, nearDistance, farDistance);
 	printf("reshape: FOVY = %5.2f, width = %4d height = %4d aspect = %5.2f \n",
 		FOVY, width, height, aspectRatio);
 }
 
-// update and display animation state in window title
-void updateTitle()
+// update and display animation state of world in window title
+void updateTitle(const WorldSnapshot * world)
 {
+	sprintf(warbirdMissleCount, "| Warbird %d", world->shipMissiles);
+	sprintf(unumMissleCount, " | Unum %d", world->unumMissiles);
+	sprintf(duoMissleCount, " | Duo %d", world->duoMissiles);
+	sprintf(cameraStr, "| View: %s", cameraNames[currentCamera]);
+
 	strcpy(titleStr, baseStr);
 	strcat(titleStr, warbirdMissleCount);
 	strcat(titleStr, unumMissleCount);
 	strcat(titleStr, duoMissleCount);
-	strcat(titleStr, timerStr[timerIndex]);
+	strcat(titleStr, timerStr[world->timerIndex]);
 	strcat(titleStr, fpsStr);
+	strcat(titleStr, triangleStr);
 	strcat(titleStr, cameraStr);
 	glutSetWindowTitle(titleStr);
 }
@@ -498,40 +783,20 @@ void updateTitle()
 // Method to handle the logic for when the ship fires a missle.
 void fireShipMissile()
 {
-	if(shipMissile->hasFired() == false)
-	{
-		if (shipMissiles > 0)
-		{
-			// Set the orientation of the missile
-			shipMissile->setTranslationMatrix(warbird->getTranslationMatrix());
-			shipMissile->setRotationMatrix(warbird->getRotationMatrix());
-			shipMissile->setDirection(getIn(warbird->getRotationMatrix()));
-
-			shipMissile->fireMissile();
-			shipMissiles--;
-
-			// Update title string for missle count
-			strcpy(warbirdMissleCount, "| Warbird ");
-			strcat(warbirdMissleCount, std::to_string(shipMissiles).c_str());
-		}
-	}
-	
+	// Its missiles find a target once they are smart, see handleMissiles()
+	missilePool.fireSalvo(launcher[SHIPLAUNCHER], noEntity, salvoSpacing);
 }
 
-// Handle the lose game state
+// Handle the lose game state, display() shows it in the title
 void gameLose()
 {
 	gameState = lose;
-	strcpy(titleStr, loseGameStr);
-	glutSetWindowTitle(titleStr);
 }
 
-// Handle the win game state
+// Handle the win game state, display() shows it in the title
 void gameWin()
 {
 	gameState = win;
-	strcpy(titleStr, winGameStr);
-	glutSetWindowTitle(titleStr);
 	if (hasRestarted == false)
 	{
 		hasRestarted = true;
@@ -550,6 +815,9 @@ void gravitySwitch()
 */
 void display()
 {
+	std::chrono::steady_clock::time_point displayStart = std::chrono::steady_clock::now();
+	perfHud->beginFrame();
+	glState.beginFrame();
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); // Actually clears the window to color specified in glClearColor().
 
 /* 
@@ -557,137 +825,154 @@ void display()
 	attributes will be issued to the graphics pipeline. 
 */
 
-// Associate shader variables with vertex arrays:
-	for (int index = 0; index < nModels; index++)
+	// Draw the latest tick the simulation published, its state is left alone while it runs on
+	const WorldSnapshot * world = snapshots.read();
+	if (world->tick != hudTick)
 	{
-		switch (index)
-		{
-		case UNUMINDEX: // If it's planet Unum (planet closest to Ruber with no moons):
-			transformMatrix[index] = object3D[index]->getOrientationMatrix();
-
-			// Update Unum's Camera:
-			unumCamera = glm::lookAt(getPosition(glm::translate(transformMatrix[index], planetCamEyePosition)), getPosition(transformMatrix[index]), upVector);
-			if (currentCamera == UNUMCAMERAINDEX) // Update Unum's Camera:
-				mainCamera = unumCamera;
-			break;
-
-		case DUOINDEX: // If it's planet Duo (planest farthest from Ruber with moons Secundus and Primus):
-
-			transformMatrix[index] = object3D[index]->getOrientationMatrix();
-
-			// Update Duo's Camera:
-			duoCamera = glm::lookAt(getPosition(glm::translate(transformMatrix[index], planetCamEyePosition)), getPosition(object3D[index]->getOrientationMatrix()), upVector);
-			if (currentCamera == DUOCAMERAINDEX)
-				mainCamera = duoCamera;
-			break;
-
-		case PRIMUSINDEX: // If its Primus, one of the moons, orbit around planet Duo.
-			transformMatrix[index] = transformMatrix[DUOINDEX] * object3D[index]->getRotationMatrix() * glm::translate(identityMatrix, (translatePosition[index] - translatePosition[DUOINDEX]));
-			object3D[index]->setOrientationMatrix(transformMatrix[index]);
-
-			// For Debugging:
-			//showMat4("rotation", moonRotationMatrix);
-			//showMat4("transform", transformMatrix[index]);
-			break;
-
-		case SECUNDUSINDEX: // If its Secundus, one of the moons, orbit around planet Duo.
-			transformMatrix[SECUNDUSINDEX] = transformMatrix[DUOINDEX] * object3D[index]->getRotationMatrix() * glm::translate(identityMatrix, (translatePosition[SECUNDUSINDEX] - translatePosition[DUOINDEX]));
-			object3D[index]->setOrientationMatrix(transformMatrix[index]);
-
-			break;
+		hudTick = world->tick;
+		perfHud->addSample(hudUpdate, world->updateTime);
+		perfHud->addSample(hudMissiles, world->missileTime);
+		perfHud->addSample(hudCollisions, world->collisionTime);
+		perfHud->addSample(hudParticles, world->particleTime);
+	}
 
-		case SHIPINDEX:
-			object3D[SHIPINDEX]->setTranslationMatrix(warbird->getTranslationMatrix());
-			object3D[SHIPINDEX]->setRotationMatrix(warbird->getRotationMatrix());
-			object3D[SHIPINDEX]->setRotationAmount(warbird->getRotationAmount());
-			object3D[SHIPINDEX]->setOrientationMatrix(warbird->getOrientationMatrix());
-
-			modelMatrix[index] = object3D[index]->getModelMatrix();
-			shipOrientationMatrix = object3D[index]->getOrientationMatrix();
-
-			// Update Ship's Camera:
-			camPosition = getPosition(glm::translate(object3D[index]->getModelMatrix(), shipCamEyePosition));
-			shipPosition = getPosition(shipOrientationMatrix);
-			shipCamera = glm::lookAt(camPosition, glm::vec3(shipPosition.x, shipPosition.y, shipPosition.z), upVector);
-			if (currentCamera == SHIPCAMERAINDEX) //If we're on ship camera
-				mainCamera = shipCamera;
-			break;
+	// Bounding spheres of the drawn instances for culling, the models are centered on their origins
+	for (int instance = 0; instance < world->nDrawn; instance++)
+	{
+		sphereX[instance] = world->modelMatrix[instance][3][0];
+		sphereY[instance] = world->modelMatrix[instance][3][1];
+		sphereZ[instance] = world->modelMatrix[instance][3][2];
+		sphereRadius[instance] = modelRadius[world->drawModel[instance]];
+	}
+	viewMatrix = world->camera[currentCamera];
 
-		case UNUMMISSLESILOINDEX:
-			break;
+	// Cull the bounding spheres against the view frustum, only the visible instances are drawn
+	glm::vec4 frustumPlane[FRUSTUM_PLANES];
+	frustumPlanes(projectionMatrix * viewMatrix, frustumPlane);
+	visibleCount = cullSpheres(frustumPlane, sphereX, sphereY, sphereZ, sphereRadius, world->nDrawn, visibleInstance);
+	culledCount = world->nDrawn - visibleCount;
 
-		case DUOMISSLESILOINDEX:
-			break;
+	for (int v = 0; v < visibleCount; v++)
+	{
+		int instance = visibleInstance[v], model = world->drawModel[instance], entity = world->drawEntity[instance];
 
-		case SHIPMISSILEINDEX:
-			object3D[SHIPMISSILEINDEX]->setTranslationMatrix(shipMissile->getTranslationMatrix());
-			object3D[SHIPMISSILEINDEX]->setRotationMatrix(shipMissile->getRotationMatrix());
-			object3D[SHIPMISSILEINDEX]->setOrientationMatrix(shipMissile->getOrientationMatrix());
-			break;
+		// Pick the coarsest level of detail whose error stays under a pixel at the model's distance
+		glm::vec3 viewPosition = glm::vec3(viewMatrix * glm::vec4(sphereX[instance], sphereY[instance], sphereZ[instance], 1.0f));
+		float pixelsPerUnit = modelSize[model] / modelBR[model] * projectionMatrix[1][1] * 0.5f * windowHeight
+			/ glm::max(glm::length(viewPosition), 1.0f);
+		int lod = modelLodLevel[entity] = selectTriLod(&modelLod[model], modelLodLevel[entity], pixelsPerUnit);
 
-		case UNUMMISSILEINDEX:
-			object3D[UNUMMISSILEINDEX]->setTranslationMatrix(unumMissile->getTranslationMatrix());
-			object3D[UNUMMISSILEINDEX]->setRotationMatrix(unumMissile->getRotationMatrix());
-			object3D[UNUMMISSILEINDEX]->setOrientationMatrix(unumMissile->getOrientationMatrix());
-			break;
-		case DUOMISSILEINDEX:
-			object3D[DUOMISSILEINDEX]->setTranslationMatrix(duoMissile->getTranslationMatrix());
-			object3D[DUOMISSILEINDEX]->setRotationMatrix(duoMissile->getRotationMatrix());
-			object3D[DUOMISSILEINDEX]->setOrientationMatrix(duoMissile->getOrientationMatrix());
-			break;
+		// positionScaleMatrix only applies to the packed vertices, not to cameras or collisions
+		meshRegistry->add(modelProgramIndex[model], modelMesh[model], lod, -viewPosition.z,
+			world->modelMatrix[instance] * positionScaleMatrix[model]);
+	}
 
-		default:
-			break;
-		}
+	// List the missile lights in the clusters they reach
+	std::chrono::steady_clock::time_point lightStart = std::chrono::steady_clock::now();
+	lightCount = glm::min(world->nLights, CLUSTER_MAX_LIGHTS);
+	for (int l = 0; l < lightCount; l++)
+	{
+		glm::vec4 eye = viewMatrix * glm::vec4(world->light[l], 1.0f);
+		lightX[l] = eye.x;
+		lightY[l] = eye.y;
+		lightZ[l] = eye.z;
+		lightRadius[l] = missileLightRadius;
+	}
+	clusters.scale = clusterScale(windowWidth, windowHeight, nearDistance, farDistance);
+	lightEntries = assignClusterLights(lightX, lightY, lightZ, lightRadius, lightCount, projectionMatrix[0][0],
+		projectionMatrix[1][1], nearDistance, farDistance, clusters.scale, clusters.cell, clusterLightIndex);
+	perfHud->addSample(hudLights, millisecondsSince(lightStart));
+
+	// Write the camera, lights, clusters, instance matrices and draw commands into this frame's ring region
+	unsigned char * frame = (unsigned char *)frameRing->begin();
+	CameraBlock * camera = (CameraBlock *)frame;
+	camera->viewMatrix = viewMatrix;
+	camera->projectionMatrix = projectionMatrix;
+	camera->lightPosition = world->lightPosition;
+	LightBlock * lights = (LightBlock *)(frame + lightOffset);
+	for (int l = 0; l < lightCount; l++)
+	{
+		lights->sphere[l] = glm::vec4(lightX[l], lightY[l], lightZ[l], lightRadius[l]);
+		lights->color[l] = missileLightColor;
+	}
+	memcpy(frame + clusterOffset, &clusters, sizeof(ClusterBlock));
+	memcpy(frame + lightIndexOffset, clusterLightIndex, (lightEntries + 1) / 2 * sizeof(GLuint));
+	meshRegistry->write((glm::mat4 *)(frame + instanceOffset), (DrawElementsCommand *)(frame + commandOffset));
+	frameRing->flush();
+	GLintptr region = frameRing->getOffset();
+	glBindBufferRange(GL_UNIFORM_BUFFER, cameraBinding, frameRing->getBuffer(), region, sizeof(CameraBlock));
+	glBindBufferRange(GL_UNIFORM_BUFFER, lightBinding, frameRing->getBuffer(), region + lightOffset, sizeof(LightBlock));
+	glBindBufferRange(GL_UNIFORM_BUFFER, clusterBinding, frameRing->getBuffer(), region + clusterOffset, sizeof(ClusterBlock));
+	glBindBufferRange(GL_UNIFORM_BUFFER, lightIndexBinding, frameRing->getBuffer(), region + lightIndexOffset,
+		sizeof(clusterLightIndex));
+
+	// Draw every entity front to back, one command per run of a mesh and level of detail, one multi-draw per program
+	perfHud->beginPass(hudScenePass);
+	glState.setDepthTest(true);
+	glState.setBlend(false);
+	glState.depthFunc(GL_LESS);
+	trianglesDrawn = meshRegistry->draw(frameRing->getBuffer(), frameRing->getOffset() + instanceOffset,
+		frameRing->getOffset() + commandOffset);
+	perfHud->endPass();
+	drawCalls = meshRegistry->getDrawCalls();
+
+	// Draw the sky last at the far plane, so the depth test rejects it wherever a model was drawn
+	if (skyboxTexture != 0)
+	{
+		perfHud->beginPass(hudSkyPass);
+		glState.depthFunc(GL_LEQUAL);
+		glState.useProgram(skyboxProgram);
+		glState.bindTexture(0, GL_TEXTURE_CUBE_MAP, skyboxTexture);
+		glState.bindVertexArray(skyboxVao);
+		glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, BUFFER_OFFSET(0));
+		perfHud->endPass();
+		drawCalls++;
+	}
 
-		viewMatrix = mainCamera;
-		ModelViewProjectionMatrix = projectionMatrix * viewMatrix * object3D[index]->getModelMatrix();
-		glUniformMatrix4fv(MVP, 1, GL_FALSE, glm::value_ptr(ModelViewProjectionMatrix));
-		modelViewMatrix = viewMatrix * object3D[index]->getModelMatrix();
-		normalMatrix = glm::mat3(modelViewMatrix);
-		glUniformMatrix3fv(NormalMatrix, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-		glUniformMatrix4fv(ModelViewMatrix, 1, GL_FALSE, glm::value_ptr(modelViewMatrix));
-/*////////////////////////////////////////////////////////////////
-		if (index == 0) {
-			glUniform1ui(Ruber, true);
-		}
-		else {
-			glUniform1ui(Ruber, false);
+	// Draw the particles over the scene and the sky, depth tested but not hiding each other, in one draw
+	particlesDrawn = world->nParticles;
+	if (particlesDrawn > 0)
+	{
+		perfHud->beginPass(hudParticlePass);
+		glState.useProgram(particleProgram);
+		float pointScale = projectionMatrix[1][1] * 0.5f * windowHeight;
+		if (pointScale != particlePointScaleSet)
+		{
+			glUniform1f(particlePointScale, pointScale);
+			particlePointScaleSet = pointScale;
 		}
-*///////////////////////////////////////////////////////////////////////////////////
-
-		glBindVertexArray(VAO[index]); // set model for its instance. Have to rebind everytime its changed.
-		glDrawArrays(GL_TRIANGLES, 0, nVertices[index]);  // Initializes vertex shader, for contiguous groups of vertices.
-		//not sure about this being correct. 
+		glBindBuffer(GL_ARRAY_BUFFER, particleBuffer);
+		glBufferData(GL_ARRAY_BUFFER, PARTICLE_MAX * sizeof(glm::vec4), NULL, GL_STREAM_DRAW); // orphan last frame's
+		glBufferSubData(GL_ARRAY_BUFFER, 0, particlesDrawn * sizeof(glm::vec4), world->particle);
+		glState.depthFunc(GL_LESS);
+		glState.setDepthMask(false);
+		glState.setBlend(true);
+		glState.blendFunc(GL_SRC_ALPHA, GL_ONE); // additive, the order doesn't matter
+		glState.bindVertexArray(particleVao);
+		glDrawArrays(GL_POINTS, 0, particlesDrawn);
+		glState.setDepthMask(true); // the next glClear() needs it
+		perfHud->endPass();
+		drawCalls++;
 	}
 
-		//indicate texture being drawn
-		glUniform1ui(IsTexture, true);
+	// Draw the HUD over everything
+	perfHud->beginPass(hudHudPass);
+	perfHud->draw(windowWidth, windowHeight);
+	perfHud->endPass();
 
-		for (int i = 0; i < numberOfSquares; i++) {
-			if (i > 1) {
-				squareRotationAmount = PI / 2;
-			}
-			else {
-				squareRotationAmount = 0.0f;
-			}
-			modelViewMatrix = viewMatrix * glm::translate(translateSquare, squareTranslationAmounts[i])
-				* glm::rotate(squareRotation, squareRotationAmount, squareRotationAxis[i]);
-
-			glUniformMatrix4fv(ModelViewMatrix, 1, GL_FALSE, glm::value_ptr(modelViewMatrix));
-			normalMatrix = glm::mat3(modelViewMatrix);
-			glUniformMatrix3fv(NormalMatrix, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-			ModelViewProjectionMatrix = projectionMatrix * modelViewMatrix;
-			glUniformMatrix4fv(MVP, 1, GL_FALSE, glm::value_ptr(ModelViewProjectionMatrix));
-			glBindVertexArray(textVao);
-
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, textIBO);
-			glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, BUFFER_OFFSET(0));
-		}
-
-		glUniform1ui(IsTexture, false);
+	frameRing->end(); // the frame's draws are all issued, fence its region
 
+	// Queue the frame's read back, before the swap leaves the back buffer undefined
+	if (frameCapture.isCapturing())
+	{
+		std::chrono::steady_clock::time_point captureStart = std::chrono::steady_clock::now();
+		frameCapture.capture(windowWidth, windowHeight);
+		perfHud->addSample(hudCapture, millisecondsSince(captureStart));
+	}
+	perfHud->addSample(hudDisplay, millisecondsSince(displayStart));
+	std::chrono::steady_clock::time_point swapStart = std::chrono::steady_clock::now();
 	glutSwapBuffers();
+	perfHud->addSample(hudSwap, millisecondsSince(swapStart));
 
 	frameCount++;
 	// see if a second has passed to set estimated fps information
@@ -696,93 +981,129 @@ void display()
 	if (timeInterval >= 1000)
 	{
 		sprintf(fpsStr, "| F/S %4d ", (int)(frameCount / (timeInterval / 1000.0f)));
+		sprintf(triangleStr, "| Tris %6d in %d draws | Visible %d, culled %d | Particles %d | State changes %d, %d avoided ",
+			trianglesDrawn, drawCalls, visibleCount, culledCount, particlesDrawn, glState.getIssued(), glState.getAvoided());
+		if (frameRing->getStalls() != frameRingStalls)
+		{
+			frameRingStalls = frameRing->getStalls();
+			printf("frame ring: %d frames waited for the GPU\n", frameRingStalls);
+		}
 		lastTime = currentTime;
 		frameCount = 0;
 
-		if(gameState == start)
-			updateTitle();
+		if (world->gameState == start)
+			updateTitle(world);
+	}
+
+	// Show a won or lost game once, and the counts again after a restart
+	if (world->gameState != shownGameState)
+	{
+		shownGameState = world->gameState;
+		if (shownGameState == win)
+			glutSetWindowTitle(winGameStr);
+		else if (shownGameState == lose)
+			glutSetWindowTitle(loseGameStr);
+		else
+			updateTitle(world);
 	}
 }
 
-void collisionCheck()
+/*
+	Collision test of two entities: their exact bounding spheres first (the broad phase),
+	then each entity's sphere against the other's model's triangle BVH (the narrow phase),
+	so a hit needs the geometry itself to touch.
+*/
+bool objectsCollide(int entityA, int entityB)
 {
-	objectPosition = getPosition(warbird->getOrientationMatrix());
+	glm::vec3 centerA = entities->transform[entityA].position, centerB = entities->transform[entityB].position;
+	float radiusA = entities->collider.get(entityA)->radius, radiusB = entities->collider.get(entityB)->radius;
 
-	if (warbird->isAlive())
-	{
-		// Check if the warbird collides with planetary bodies:
-		for (int index = 0; index < 5; index++)
-		{
-			length = distance(objectPosition, getPosition(object3D[index]->getOrientationMatrix()));
+	if (distance(centerA, centerB) > radiusA + radiusB)
+		return false;
 
-			if (length < (modelBR[SHIPINDEX] + 10.0f + modelSize[index]))
-			{
-				// If there is a collision with a planet the warbird gets destroyed
-				// The camera view is set to front camera
-				warbird->destroy();
-				printf("Warbird Hit Planetary Body \n");
-				currentCamera = 0;
-			}
-		}
+	// Each sphere in the other model's coordinates, where that model's scale divides its radius
+	glm::vec3 centerBInA = entities->toModel(entityA, centerB);
+	glm::vec3 centerAInB = entities->toModel(entityB, centerA);
+	return triBvhSphereHit(&modelBvh[entities->shape.get(entityA)->model], centerBInA, radiusB / entities->transform[entityA].scale)
+		&& triBvhSphereHit(&modelBvh[entities->shape.get(entityB)->model], centerAInB, radiusA / entities->transform[entityB].scale);
+}
 
-		// Check if the warbird collides with ship missile:
-		if (shipMissile->isSmart()) // We only check for the collision when the missile becomes smart
-		{
-			length = distance(objectPosition, getPosition(shipMissile->getOrientationMatrix()));
+// A missile hits an entity if they collide or the missile's path since its last update crosses the entity's triangles.
+bool missileCollides(int missile, int entity)
+{
+	if (objectsCollide(missile, entity))
+		return true;
 
-			if (length < (modelBR[SHIPINDEX] + 10.0f + modelBR[SHIPMISSILEINDEX]))
-			{
-				warbird->destroy();
-				shipMissile->destroy();
-				printf("Ship Missile %d hit warbird \n", shipMissiles);
-				currentCamera = 0;
-			}
-		}
+	glm::vec3 start = entities->missile.get(missile)->previousPosition, end = entities->transform[missile].position;
+	if (distance(end, entities->transform[entity].position) > entities->collider.get(entity)->radius + distance(start, end))
+		return false;
 
-		// Check if the warbird collides with Unum missile:
-		if (unumMissile->isSmart()) // We only check for the collision when the missile becomes smart
-		{
-			length = distance(objectPosition, getPosition(unumMissile->getOrientationMatrix()));
+	return triBvhSegmentHit(&modelBvh[entities->shape.get(entity)->model], entities->toModel(entity, start),
+		entities->toModel(entity, end));
+}
 
-			if (length < (modelBR[SHIPINDEX] + 10.0f + modelBR[UNUMMISSILEINDEX]))
-			{
-				warbird->destroy();
-				unumMissile->destroy();
-				printf("Unum Missile %d is gone \n", unumMissiles);
-				currentCamera = 0;
-			}
-		}
+// An explosion and its debris at position, they drift on from there
+void explode(glm::vec3 position)
+{
+	particles.burst(PARTICLE_EXPLOSION, position, glm::vec3(0.0f), explosionParticles, explosionParticles / 3,
+		explosionSpread, explosionDrag, explosionLife);
+	particles.burst(PARTICLE_DEBRIS, position, glm::vec3(0.0f), debrisParticles, debrisParticles / 3,
+		debrisSpread, debrisDrag, debrisLife);
+}
 
-		// Check if the warbird collides with Duo missile:
-		if (duoMissile->isSmart()) // We only check for the collision when the missile becomes smart
-		{
-			length = distance(objectPosition, getPosition(duoMissile->getOrientationMatrix()));
+// Destroys a missile in flight, exploding where it was
+void explodeMissile(int missile)
+{
+	explode(entities->transform[missile].position);
+	missilePool.destroy(missile);
+}
 
-			if (length < (modelBR[SHIPINDEX] + modelBR[DUOMISSILEINDEX] + 10.0f))
+// Destroys the warbird, exploding where it was if it was still alive
+void explodeWarbird()
+{
+	if (warbird->isAlive())
+		explode(warbird->getPosition());
+	warbird->destroy();
+}
+
+// Marks a missile site dead, the missiles homing on it lose it
+void destroySilo(int silo, bool * alive)
+{
+	if (*alive)
+		printf("%s is dead \n", scene.entity[silo].name);
+	*alive = false;
+	entities->retire(silo);
+}
+
+void collisionCheck()
+{
+	if (warbird->isAlive())
+	{
+		// Check if the warbird collides with planetary bodies:
+		for (int index = 0; index < nModels; index++)
+		{
+			if (scene.isBody(index) && objectsCollide(SHIPINDEX, index))
 			{
-				warbird->destroy();
-				duoMissile->destroy();
-				printf("Duo Missile %d is gone \n", duoMissiles);
+				// If there is a collision with a planet the warbird gets destroyed
+				// The camera view is set to front camera
+				explodeWarbird();
+				printf("Warbird Hit Planetary Body \n");
 				currentCamera = 0;
 			}
 		}
 
 		// Check if the warbird collides with Unum Missile Site:
-		length = distance(objectPosition, getPosition(object3D[UNUMMISSLESILOINDEX]->getOrientationMatrix()));
-
-		if (length < (modelBR[SHIPINDEX] + modelBR[UNUMMISSLESILOINDEX] + 10.0f))
+		if (objectsCollide(SHIPINDEX, UNUMMISSLESILOINDEX))
 		{
-			warbird->destroy();
+			explodeWarbird();
 			printf("Warbird Hit Unum Missile Site \n");
 			currentCamera = 0;
 		}
 
 		// Check if the warbird collides with Duo Missile Site:
-		length = distance(objectPosition, getPosition(object3D[DUOMISSLESILOINDEX]->getOrientationMatrix()));
-
-		if (length < (modelBR[SHIPINDEX] + modelBR[DUOMISSLESILOINDEX] + 10.0f))
+		if (objectsCollide(SHIPINDEX, DUOMISSLESILOINDEX))
 		{
-			warbird->destroy();
+			explodeWarbird();
 			printf("Warbird Hit Duo Missile Site \n");
 			currentCamera = 0;
 		}
@@ -792,125 +1113,47 @@ void collisionCheck()
 	// Missiles Collision Detection:
 ////////////////////////////////////////////////////
 
-	objectPosition = getPosition(shipMissile->getOrientationMatrix());
-
-	// Check ship missile for collision:
-	if (shipMissile->isSmart()) // We only check for the collision when the missile becomes smart
-	{
-		// Check if it collides with a missile site:
-
-			// Unum Missile Site:
-		length = distance(objectPosition, getPosition(object3D[UNUMMISSLESILOINDEX]->getOrientationMatrix()));
-
-		if (length < (modelBR[UNUMMISSLESILOINDEX] + modelBR[SHIPMISSILEINDEX] + 10.0f))
-		{
-			shipMissile->destroy();
-			unumMissileSiloAlive = false;
-			printf("Unum Missile Silo is dead \n");
-		}
-
-			// Duo Missile Site:
-		length = distance(objectPosition, getPosition(object3D[DUOMISSLESILOINDEX]->getOrientationMatrix()));
-
-		if (length < (modelBR[DUOMISSLESILOINDEX] + modelBR[SHIPMISSILEINDEX] + 10.0f))
-		{
-			shipMissile->destroy();
-			duoMissileSiloAlive = false;
-			printf("Duo Missile Silo is dead \n");
-		}
-
-		// Check if it collides with a planetary body:
-		for (int index = 0; index < 5; index++)
-		{
-			length = distance(objectPosition, getPosition(object3D[index]->getOrientationMatrix()));
-
-			if (length < (modelBR[index] + modelBR[SHIPMISSILEINDEX] + 10.0f)) {
-
-				// If there is a collision with a planet, the missile is destroyed
-				shipMissile->destroy();
-				printf("Ship Missile %d hit planet \n", shipMissiles);
-			}
-		}
-	}
-
-	objectPosition = getPosition(unumMissile->getOrientationMatrix());
-
-	// Check Unum missile for collision:
-	if (unumMissile->isSmart()) // We only check for the collision when the missile becomes smart
+	// The last first, destroying a missile moves the last one into its slot
+	for (int s = entities->missile.getCount() - 1; s >= 0; s--)
 	{
-		// Check if it collides with Unum missile site:
-		length = distance(objectPosition, getPosition(object3D[UNUMMISSLESILOINDEX]->getOrientationMatrix()));
+		if (!entities->missile.at(s).smart) // We only check for the collision when the missile becomes smart
+			continue;
+		int missile = entities->missile.getEntity(s);
+		const char * launcherName = scene.entity[entities->missile.at(s).launcher].name;
 
-		if (length < (modelBR[UNUMMISSLESILOINDEX] + modelBR[UNUMMISSILEINDEX] + 10.0f))
+		// Check if it collides with the warbird, both are destroyed
+		if (warbird->isAlive() && missileCollides(missile, SHIPINDEX))
 		{
-			unumMissile->destroy();
-			printf("Unum Missile %d is gone \n", unumMissiles);
-			unumMissileSiloAlive = false;
-			printf("Unum Missile Silo is dead \n");
-		}
-
-		// Check if it collides with Duo missile site:
-		length = distance(objectPosition, getPosition(object3D[DUOMISSLESILOINDEX]->getOrientationMatrix()));
-
-		if (length < (modelBR[DUOMISSLESILOINDEX] + modelBR[UNUMMISSILEINDEX] + 10.0f))
-		{
-			unumMissile->destroy();
-			printf("Unum Missile %d is gone \n", unumMissiles);
-			duoMissileSiloAlive = false;
-			printf("Duo Missile Silo is dead \n");
-		}
-
-		// Check if it collides with a planetary body:
-		for (int index = 0; index < 5; index++)
-		{
-			length = distance(objectPosition, getPosition(object3D[index]->getOrientationMatrix()));
-
-			if (length < (modelBR[index] + modelBR[UNUMMISSILEINDEX] + 10.0f)) {
-
-				// If there is a collision with a planet, the missile is destroyed
-				unumMissile->destroy();
-				printf("Unum Missile %d is gone \n", unumMissiles);
-			}
+			explodeWarbird();
+			explodeMissile(missile);
+			printf("%s missile hit warbird \n", launcherName);
+			currentCamera = 0;
+			continue;
 		}
-	}
 
-	objectPosition = getPosition(duoMissile->getOrientationMatrix());
-
-	// Check Duo missile for collision:
-	if (duoMissile->isSmart()) // We only check for the collision when the missile becomes smart
-	{
-		// Check if it collides with Unum missile site:
-		length = distance(objectPosition, getPosition(object3D[UNUMMISSLESILOINDEX]->getOrientationMatrix()));
-
-		if (length < modelBR[UNUMMISSLESILOINDEX] + modelBR[DUOMISSILEINDEX] + 10.0f)
+		// Check if it collides with a missile site:
+		if (missileCollides(missile, UNUMMISSLESILOINDEX))
 		{
-			duoMissile->destroy();
-			printf("Duo Missile %d is gone \n", duoMissiles);
-			unumMissileSiloAlive = false;
-			printf("Unum Missile Silo is dead \n");
+			explodeMissile(missile);
+			destroySilo(UNUMMISSLESILOINDEX, &unumMissileSiloAlive);
+			continue;
 		}
-
-		//// Check if it collides with Duo missile site:
-		length = distance(objectPosition, getPosition(object3D[DUOMISSLESILOINDEX]->getOrientationMatrix()));
-
-		if (length < (modelBR[DUOMISSLESILOINDEX] + modelBR[DUOMISSILEINDEX] + 10.0f))
+		if (missileCollides(missile, DUOMISSLESILOINDEX))
 		{
-			duoMissile->destroy();
-			printf("Duo Missile %d is gone \n", duoMissiles);
-			duoMissileSiloAlive = false;
-			printf("Duo Missile Silo is dead \n");
+			explodeMissile(missile);
+			destroySilo(DUOMISSLESILOINDEX, &duoMissileSiloAlive);
+			continue;
 		}
 
 		// Check if it collides with a planetary body:
-		for (int index = 0; index < 5; index++)
+		for (int index = 0; index < nModels; index++)
 		{
-			length = distance(objectPosition, getPosition(object3D[index]->getOrientationMatrix()));
-
-			if (length < (modelBR[index] + modelBR[DUOMISSILEINDEX] + 10.0f)) {
-
+			if (scene.isBody(index) && missileCollides(missile, index))
+			{
 				// If there is a collision with a planet, the missile is destroyed
-				duoMissile->destroy();
-				printf("Duo Missile %d is gone \n", duoMissiles);
+				explodeMissile(missile);
+				printf("%s missile hit %s \n", launcherName, scene.entity[index].name);
+				break;
 			}
 		}
 	}
@@ -918,197 +1161,113 @@ void collisionCheck()
 
 void handleMissiles()
 {
-	// Check to see the update count of the ship missile before activating smart.
-	if (shipMissile->hasFired())
+	// Reload the launchers, and draw each one's missile on it while it has any left
+	for (int l = 0; l < LAUNCHERS; l++)
 	{
-		if (shipMissile->getUpdateFrameCount() > missileActivationTimer)
-		{
-			shipMissile->activateSmart();
-		}
-	}
-
-	if (unumMissile->hasFired())
-	{
-		if (unumMissile->getUpdateFrameCount() > missileActivationTimer)
-		{
-			unumMissile->activateSmart();
-		}
-	}
-
-	if (duoMissile->hasFired())
-	{
-		if (duoMissile->getUpdateFrameCount() > missileActivationTimer)
-		{
-			duoMissile->activateSmart();
-		}
+		if (launcher[l].cooldown > 0)
+			launcher[l].cooldown--;
+		if (launcher[l].missiles > 0)
+			entities->shape.add(launcher[l].rack)->model = launcher[l].rack;
+		else
+			entities->shape.remove(launcher[l].rack);
 	}
 
-	/* SHIP MISSILE: */
+	/* MISSILE SITES: */
 
-	// If the ship missile has been fired and is smart it needs to find a target
-	if (shipMissile->hasFired())
+	// A site fires a salvo at the warbird whenever it is in the detection radius and the site has reloaded
+	if (warbird->isAlive())
 	{
-		if (shipMissile->isSmart())
+		EntityHandle target = entities->getHandle(SHIPINDEX);
+		for (int l = UNUMLAUNCHER; l <= DUOLAUNCHER; l++)
 		{
-			// If it doesn't have a target we need to find one for it:
-			if (!shipMissile->isTargetLocked())
-			{
-				// Determine the closest target for the warbirds missile
-
-				// Get the distance from Unum
-				missileLocation = shipMissile->getOrientationMatrix();
-				targetLocation = object3D[UNUMMISSLESILOINDEX]->getOrientationMatrix();
-				missilePositionVector = getPosition(missileLocation);
-				targetPositionVector = getPosition(targetLocation);
-				unumLength = distance(missilePositionVector, targetPositionVector);
-
-				// Get the distance from Duo
-				missileLocation = shipMissile->getOrientationMatrix();
-				targetLocation = object3D[DUOMISSLESILOINDEX]->getOrientationMatrix();
-				missilePositionVector = getPosition(missileLocation);
-				targetPositionVector = getPosition(targetLocation);
-				duoLength = distance(missilePositionVector, targetPositionVector);
-
-				// The target will be one of the missile sites, the closest
-				// one to the missile that is within the missiles detection range.
-				if (unumLength <= duoLength)
-				{
-					shipMissileTarget = object3D[UNUMMISSLESILOINDEX];
-					shipMissile->setTargetLocation(shipMissileTarget->getOrientationMatrix());
-					printf("Ship Missile Target is UNUM Missile Site \n");
-				}
-				else if(unumLength > duoLength)
-				{
-					shipMissileTarget = object3D[DUOMISSLESILOINDEX];
-					shipMissile->setTargetLocation(shipMissileTarget->getOrientationMatrix());
-					printf("Ship Missile Target is DUO Missile Site \n");
-				}
-			}
-
-			// Update the missiles knowledge of its targets location.
-			else 
-			{
-				shipMissile->setTargetLocation(shipMissileTarget->getOrientationMatrix());
-			}
+			if (distance(entities->transform[launcher[l].entity].position, warbird->getPosition()) <= detectionRadius)
+				missilePool.fireSalvo(launcher[l], target, salvoSpacing);
 		}
 	}
 
-	else // The ship missile hasn't been fired yet so keep it next to the warbird
-	{
-		shipMissile->setOrientationMatrix(glm::translate(warbird->getOrientationMatrix(), glm::vec3(-33, 0, -30)));
-	}
-
-	/* UNUM MISSILE SITE MISSILE: */
+	/* SHIP MISSILES: */
 
-	if(!unumMissile->hasFired())
+	// A smart ship missile without a target homes on the closest site still standing
+	for (int s = 0; s < entities->missile.getCount(); s++)
 	{
-		// Set position of the missile if it has not been fired to the missile silo
-		unumMissile->setOrientationMatrix(object3D[UNUMMISSLESILOINDEX]->getOrientationMatrix());
-
-		// Check to see if the warbird is in the detection radius by getting the distance between the two objects:
-		missileLocation = unumMissile->getOrientationMatrix();
-		targetLocation = warbird->getOrientationMatrix();
-		missilePositionVector = getPosition(missileLocation);
-		targetPositionVector = getPosition(targetLocation);
-		length = distance(missilePositionVector, targetPositionVector);
-
-		if (length <= detectionRadius && unumMissiles > 0)
+		MissileState & m = entities->missile.at(s);
+		if (m.launcher != SHIPINDEX || !m.smart || entities->isLive(m.target))
+			continue;
+		glm::vec3 missilePosition = entities->transform[entities->missile.getEntity(s)].position;
+		float unumLength = distance(missilePosition, entities->transform[UNUMMISSLESILOINDEX].position);
+		float duoLength = distance(missilePosition, entities->transform[DUOMISSLESILOINDEX].position);
+		int target = -1;
+		if (unumMissileSiloAlive && (!duoMissileSiloAlive || unumLength <= duoLength))
+			target = UNUMMISSLESILOINDEX;
+		else if (duoMissileSiloAlive)
+			target = DUOMISSLESILOINDEX;
+		if (target >= 0)
 		{
-			unumMissile->fireMissile();
-			unumMissile->setTargetLocation(warbird->getOrientationMatrix());
-			unumMissiles--;
-
-			// Update title string for the Unum Missile Site missile count
-			strcpy(unumMissleCount, " | Unum ");
-			strcat(unumMissleCount, std::to_string(unumMissiles).c_str());
+			m.target = entities->getHandle(target);
+			printf("Ship Missile Target is %s \n", scene.entity[target].name);
 		}
+		else
+			m.target = noEntity;
 	}
 
-	// Once the missile becomes smart keep updating it to get the warbird's location.
-	if (unumMissile->isSmart())
-	{
-		unumMissile->setTargetLocation(warbird->getOrientationMatrix());
-	}
-
-	/* DUO MISSILE SITE MISSILE: */
+	// Update all the missiles:
+	missilePool.update();
+}
 
-	if (!duoMissile->hasFired())
+// Keeps an exhaust emitter at the tail of every missile in flight, and stops it once the missile is gone
+void emitExhaust()
+{
+	for (int m = 0; m < MISSILE_POOL; m++)
 	{
-		// Set position of the missile if it has not been fired to the missile silo
-		duoMissile->setOrientationMatrix(object3D[DUOMISSLESILOINDEX]->getOrientationMatrix()); 
-
-		// Check to see if the warbird is in the detection radius by getting the distance between the two objects:
-		missileLocation = duoMissile->getOrientationMatrix();
-		targetLocation = warbird->getOrientationMatrix();
-		missilePositionVector = getPosition(missileLocation);
-		targetPositionVector = getPosition(targetLocation);
-		length = distance(missilePositionVector, targetPositionVector);
-
-		if (length <= detectionRadius && duoMissiles > 0)
+		int missile = missilePool.getEntity(m);
+		if (!missilePool.isFlying(missile))
 		{
-			duoMissile->fireMissile();
-			duoMissile->setTargetLocation(warbird->getOrientationMatrix());
-			duoMissiles--;
-
-			// Update title string for the Duo Missile Site missile count
-			strcpy(duoMissleCount, " | Duo ");
-			strcat(duoMissleCount, std::to_string(duoMissiles).c_str());
+			if (missileEmitter[m] >= 0)
+				particles.stopEmitter(missileEmitter[m]);
+			missileEmitter[m] = -1;
+			continue;
 		}
+		const Transform & t = entities->transform[missile];
+		glm::vec3 forward = getIn(t.rotation);
+		glm::vec3 tail = t.position - forward * (0.5f * modelSize[entities->shape.get(missile)->model]);
+		if (missileEmitter[m] < 0)
+			missileEmitter[m] = particles.attachEmitter(PARTICLE_EXHAUST, tail, exhaustRate, exhaustSpread, exhaustDrag, exhaustLife);
+		if (missileEmitter[m] >= 0)
+			particles.moveEmitter(missileEmitter[m], tail, forward * (-0.5f * entities->missile.get(missile)->speed)); // ejected backwards
 	}
-
-	// Once the missile becomes smart keep updating it to get the warbird's location.
-	if (duoMissile->isSmart())
-	{
-		duoMissile->setTargetLocation(warbird->getOrientationMatrix());
-	}
-
-	// Update all the missiles:
-	shipMissile->update();
-	unumMissile->update();
-	duoMissile->update();
 }
 
-// Animate scene objects by updating their transformation matrices
-// for use with Idle and intervalTimer functions to set rotation
-void update(int i)
+// Animate scene objects by updating their transformation matrices, one simulation tick
+void update()
 {
-	glutTimerFunc(timeQuantum[timeQuantumState], update, 1); // glutTimerFunc(time, fn, arg). This sets fn() to be called after time millisecond with arg as an argument to fn().
-
-	// Update all of the object3D's
-	for (int index = 0; index < nModels; index++)
-	{
-		object3D[index]->update();
-	}
+	std::chrono::steady_clock::time_point updateStart = std::chrono::steady_clock::now();
 
-	// Update the missile silo orientation matrices
-
-		// Update the Unum Missile Silo
-	object3D[UNUMMISSLESILOINDEX]->setTranslationMatrix(object3D[UNUMINDEX]->getTranslationMatrix());
-	object3D[UNUMMISSLESILOINDEX]->setOrientationMatrix(object3D[UNUMINDEX]->getRotationMatrix());
-	object3D[UNUMMISSLESILOINDEX]->setTranslationMatrix(glm::translate(object3D[UNUMINDEX]->getTranslationMatrix(), glm::vec3(0, 135, 0)));
-	transformMatrix[UNUMMISSLESILOINDEX] = glm::translate(object3D[UNUMINDEX]->getOrientationMatrix(), glm::vec3(0, 135, 0));
-	object3D[UNUMMISSLESILOINDEX]->setOrientationMatrix(transformMatrix[UNUMMISSLESILOINDEX]);
-
-		// Update the Duo Missile Silo
-	object3D[DUOMISSLESILOINDEX]->setTranslationMatrix(object3D[DUOINDEX]->getTranslationMatrix());
-	object3D[DUOMISSLESILOINDEX]->setOrientationMatrix(object3D[DUOINDEX]->getRotationMatrix());
-	object3D[DUOMISSLESILOINDEX]->setTranslationMatrix(glm::translate(object3D[DUOINDEX]->getTranslationMatrix(), glm::vec3(0, 400, 0)));
-	transformMatrix[DUOMISSLESILOINDEX] = glm::translate(object3D[DUOINDEX]->getOrientationMatrix(), glm::vec3(0, 400, 0));
-	object3D[DUOMISSLESILOINDEX]->setOrientationMatrix(transformMatrix[DUOMISSLESILOINDEX]);
-
-	// Update the warbird object
-	warbird->update();
+	// Steer the warbird, then turn and move every body, and with them everything they carry
+	Warbird::updateAll(entities);
+	entities->updateKinematics();
+	entities->updateWorld();
 
 	// Update all the missiles
+	std::chrono::steady_clock::time_point phaseStart = std::chrono::steady_clock::now();
 	handleMissiles();
+	entities->updateWorld();
+	missileTime = millisecondsSince(phaseStart);
 
 	// Check for any collisions:
+	phaseStart = std::chrono::steady_clock::now();
 	collisionCheck();
+	collisionTime = millisecondsSince(phaseStart);
+
+	// Move the exhaust emitters with the missiles, then every particle
+	phaseStart = std::chrono::steady_clock::now();
+	emitExhaust();
+	particles.update();
+	particleTime = millisecondsSince(phaseStart);
 
 	// Update Gravity:
 	if (gravityState == true)
 	{
-		glm::vec3 shipPosition = getPosition(warbird->getTranslationMatrix());
+		glm::vec3 shipPosition = warbird->getTranslation();
 
 		//Check distance to Ruber
 		glm::vec3 vectorPointingFromShipToRuber = translatePosition[RUBERINDEX] - shipPosition;
@@ -1117,7 +1276,7 @@ void update(int i)
 		if (distanceToRuber < gravityFieldRuber) {
 			//normalize the vector, this is now gravity
 			glm::vec3 gravity = (vectorPointingFromShipToRuber / distanceToRuber);
-			warbird->setTranslationMatrix(gravity * glm::vec3(0.8f, 0.8f, 0.8f));
+			warbird->move(gravity * glm::vec3(0.8f, 0.8f, 0.8f));
 		}
 	}
 
@@ -1128,67 +1287,71 @@ void update(int i)
 	}
 
 	// Check if the player lost the game:
-	if (warbird->isAlive() == false || (shipMissiles == 0 && (unumMissileSiloAlive == true || duoMissileSiloAlive == true)))
+	if (warbird->isAlive() == false || (launcher[SHIPLAUNCHER].missiles == 0 && (unumMissileSiloAlive == true || duoMissileSiloAlive == true)))
 	{
 		gameLose();
 	}
 
-	glutPostRedisplay();
+	simulationTick++;
+	updateTime = millisecondsSince(updateStart);
 }
 
-// Estimate FPS, use for fixed interval timer driven animation
-void intervalTimer(int i)
+// Copies every drawn entity's model matrix, sets the cameras and publishes the tick for display().
+void publishSnapshot()
 {
-	glutTimerFunc(timeQuantum[timeQuantumState], intervalTimer, 1);
-	if (!idleTimerFlag)
-	{
-		update(1);  // fixed interval timer
-	}
-}
+	WorldSnapshot * world = snapshots.write();
+	world->nLights = 0;
+	world->nParticles = particles.write(world->particle);
 
-void switchCamera(int camera)
-{
-	switch (camera)
+	// Every entity with a Shape is drawn, racks while they have missiles and missiles while they fly
+	world->nDrawn = entities->shape.getCount();
+	for (int s = 0; s < world->nDrawn; s++)
 	{
-	case FRONTCAMERAINDEX:
-		mainCamera = frontCamera;
-		break;
-	case TOPCAMERAINDEX:
-		mainCamera = topCamera;
-		break;
-	case SHIPCAMERAINDEX:
-		mainCamera = shipCamera;
-		break;
-	case UNUMCAMERAINDEX:
-		mainCamera = unumCamera;
-		break;
-	case DUOCAMERAINDEX:
-		mainCamera = duoCamera;
-		break;
-	default:
-		return;
+		int entity = entities->shape.getEntity(s);
+		world->drawEntity[s] = entity;
+		world->drawModel[s] = entities->shape.at(s).model;
+		world->modelMatrix[s] = entities->getModelMatrix(entity);
 	}
-	sprintf(cameraStr, "| View: %s", cameraNames[camera]);
-	printf("Current Camera: %s\n", cameraNames[camera]);
-	display();
+
+	// The star lights the scene, wherever its instance is in the draw list
+	world->lightPosition = glm::vec4(entities->transform[RUBERINDEX].position, 1.0f);
+
+	// Unum and Duo carry cameras.
+	unumCamera = glm::lookAt(entities->toWorld(UNUMINDEX, planetCamEyePosition), entities->transform[UNUMINDEX].position, upVector);
+	duoCamera = glm::lookAt(entities->toWorld(DUOINDEX, planetCamEyePosition), entities->transform[DUOINDEX].position, upVector);
+
+	// Update Ship's Camera:
+	camPosition = entities->toWorld(SHIPINDEX, shipCamEyePosition * entities->transform[SHIPINDEX].scale);
+	shipPosition = warbird->getPosition();
+	shipCamera = glm::lookAt(camPosition, glm::vec3(shipPosition.x, shipPosition.y, shipPosition.z), upVector);
+
+	// A missile in flight is a light
+	for (int s = 0; s < entities->missile.getCount() && world->nLights < CLUSTER_MAX_LIGHTS; s++)
+		world->light[world->nLights++] = entities->transform[entities->missile.getEntity(s)].position;
+
+	world->camera[FRONTCAMERAINDEX] = frontCamera;
+	world->camera[TOPCAMERAINDEX] = topCamera;
+	world->camera[SHIPCAMERAINDEX] = shipCamera;
+	world->camera[UNUMCAMERAINDEX] = unumCamera;
+	world->camera[DUOCAMERAINDEX] = duoCamera;
+	world->gameState = gameState;
+	world->timerIndex = timerIndex;
+	world->shipMissiles = launcher[SHIPLAUNCHER].missiles;
+	world->unumMissiles = launcher[UNUMLAUNCHER].missiles;
+	world->duoMissiles = launcher[DUOLAUNCHER].missiles;
+	world->tick = simulationTick;
+	world->updateTime = updateTime;
+	world->missileTime = missileTime;
+	world->collisionTime = collisionTime;
+	world->particleTime = particleTime;
+	snapshots.publish();
 }
 
-void keyboard(unsigned char key, int x, int y)
+// Keys that change the simulation, applied by simulate() at the start of a tick
+void applyKey(int key)
 {
 	switch (key)
 	{
-	case 'v': case 'V':
-		currentCamera = (currentCamera + 1) % maxCameras;
-		switchCamera(currentCamera);
-		break;
-
-	case 'x': case 'X':
-		if (currentCamera == 0)
-			currentCamera = 5;
-		currentCamera = (currentCamera - 1) % maxCameras;
-		switchCamera(currentCamera);
-		break;
-
 	case 's': case'S':
 		shipSpeedState = (shipSpeedState + 1) % totalSpeeds;
 		warbird->setSpeed(shipSpeed[shipSpeedState]);
@@ -1223,23 +1386,21 @@ void keyboard(unsigned char key, int x, int y)
 		switch (warpit)
 		{
 		case 0:
-			warbird->setTranslationMatrix(glm::translate(identityMatrix, translatePosition[SHIPINDEX]));
-			warbird->setRotationMatrix(glm::rotate(identityMatrix, 0.0f, glm::vec3(0, 1, 0)));
+			warbird->setTranslation(translatePosition[SHIPINDEX]);
+			warbird->setRotation(glm::quat(1.0f, 0.0f, 0.0f, 0.0f));
 			printf("Ship Warped back to original position\n");
 			break;
 
 		case 1:
-			warbird->setTranslationMatrix(glm::translate(identityMatrix, getPosition(glm::translate
-			(transformMatrix[UNUMINDEX], planetCamEyePosition))));
-			warbird->setRotationMatrix(glm::rotate(object3D[UNUMINDEX]->getRotationMatrix(), PI, glm::vec3(0, 1, 0)) );
+			warbird->setTranslation(entities->toWorld(UNUMINDEX, planetCamEyePosition));
+			warbird->setRotation(entities->transform[UNUMINDEX].rotation * glm::angleAxis(PI, glm::vec3(0, 1, 0)));
 
 			printf("Ship Warped to Unum\n");
 			break;
 
 		case 2:
-			warbird->setTranslationMatrix(glm::translate(identityMatrix, getPosition(glm::translate
-			(transformMatrix[DUOINDEX], planetCamEyePosition))));
-			warbird->setRotationMatrix(glm::rotate(object3D[DUOINDEX]->getRotationMatrix(), PI, glm::vec3(0, 1, 0)));
+			warbird->setTranslation(entities->toWorld(DUOINDEX, planetCamEyePosition));
+			warbird->setRotation(entities->transform[DUOINDEX].rotation * glm::angleAxis(PI, glm::vec3(0, 1, 0)));
 
 			printf("Ship Warped to Duo\n");
 			break;
@@ -1248,17 +1409,11 @@ void keyboard(unsigned char key, int x, int y)
 
 	// (added for testing)
 	case 'r': case'R':
-		// Reset Unum Missile Site:
-		unumMissiles = 5;
+		// Reset the missile budgets of the sites and the warbird:
+		resetMissileCounts();
 		unumMissileSiloAlive = true;
-
-		// Reset Duo Missile Site:
-		duoMissiles = 5;
 		duoMissileSiloAlive = true;
 
-		// Reset Warbird:
-		shipMissiles = 9;
-
 		warbird->restart();
 
 		// Reset the game state flag:
@@ -1273,12 +1428,12 @@ void keyboard(unsigned char key, int x, int y)
 	}
 }
 
-void handleSpecialKeypress(int key, int x, int y)
+void applySpecialKey(int key, bool ctrl)
 {
 	switch (key)
 	{
 	case GLUT_KEY_UP:
-		if (glutGetModifiers() == GLUT_ACTIVE_CTRL)
+		if (ctrl)
 		{
 			warbird->setPitch(1);
 		}
@@ -1288,7 +1443,7 @@ void handleSpecialKeypress(int key, int x, int y)
 		}
 		break;
 	case GLUT_KEY_DOWN:
-		if (glutGetModifiers() == GLUT_ACTIVE_CTRL)
+		if (ctrl)
 		{
 			warbird->setPitch(-1);
 		}
@@ -1298,7 +1453,7 @@ void handleSpecialKeypress(int key, int x, int y)
 		}
 		break;
 	case GLUT_KEY_LEFT:
-		if (glutGetModifiers() == GLUT_ACTIVE_CTRL)
+		if (ctrl)
 		{
 			warbird->setRoll(1);
 		}
@@ -1308,7 +1463,7 @@ void handleSpecialKeypress(int key, int x, int y)
 		}
 		break;
 	case GLUT_KEY_RIGHT: 
-		if (glutGetModifiers() == GLUT_ACTIVE_CTRL)
+		if (ctrl)
 		{
 			warbird->setRoll(-1);
 		}
@@ -1318,8 +1473,154 @@ void handleSpecialKeypress(int key, int x, int y)
 		}
 		break;
 	}
+}
+
+/*
+	The simulation thread: applies the queued keys, runs one update() and publishes it,
+	once per time quantum. A late tick doesn't make the following ones hurry to catch up.
+*/
+void simulate()
+{
+	std::vector<KeyEvent> keys;
+	std::chrono::steady_clock::time_point nextTick = std::chrono::steady_clock::now();
+
+	while (simulationRunning)
+	{
+		keyMutex.lock();
+		keys.swap(keyQueue);
+		keyMutex.unlock();
+		for (size_t i = 0; i < keys.size(); i++)
+		{
+			if (keys[i].special)
+				applySpecialKey(keys[i].key, keys[i].ctrl);
+			else
+				applyKey(keys[i].key);
+		}
+		keys.clear();
+
+		update();
+		publishSnapshot();
+
+		nextTick += std::chrono::milliseconds(timeQuantum[timeQuantumState]);
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		if (nextTick < now)
+			nextTick = now;
+		std::this_thread::sleep_until(nextTick);
+	}
+}
+
+// Stops the simulation thread at exit, it finishes its tick first.
+void stopSimulation()
+{
+	if (simulationThread == NULL)
+		return;
+	simulationRunning = false;
+	simulationThread->join();
+	delete simulationThread;
+	simulationThread = NULL;
+}
+
+// Writes the captured frames still queued and closes the file at exit, the window's context may be gone.
+void finishCapture()
+{
+	frameCapture.finish(false);
+}
+
+// Redraws once the simulation has published a new tick, the GLUT thread sleeps in between.
+void idle()
+{
+	if (snapshots.hasNew())
+		glutPostRedisplay();
+	else
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+// Queues a key for the simulation thread's next tick.
+void queueKey(int key, bool special, bool ctrl)
+{
+	KeyEvent event = { key, special, ctrl };
+	keyMutex.lock();
+	keyQueue.push_back(event);
+	keyMutex.unlock();
+}
+
+void switchCamera(int camera)
+{
+	sprintf(cameraStr, "| View: %s", cameraNames[camera]);
+	printf("Current Camera: %s\n", cameraNames[camera]);
+	glutPostRedisplay();
+}
+
+// The cameras are switched right away, every other key waits for the next simulation tick.
+void keyboard(unsigned char key, int x, int y)
+{
+	switch (key)
+	{
+	case 'v': case 'V':
+		currentCamera = (currentCamera + 1) % maxCameras;
+		switchCamera(currentCamera);
+		break;
+
+	case 'x': case 'X':
+		currentCamera = (currentCamera + maxCameras - 1) % maxCameras;
+		switchCamera(currentCamera);
+		break;
+
+	case 'h': case 'H':
+		perfHud->setVisible(!perfHud->isVisible());
+		break;
+
+	default:
+		queueKey(key, false, false);
+		break;
+	}
+}
+
+void handleSpecialKeypress(int key, int x, int y)
+{
+	queueKey(key, true, glutGetModifiers() == GLUT_ACTIVE_CTRL);
 }//handleSpecialKeypress
 
+# ifdef __Headless__
+/*
+	Renders headlessFrames frames into the framebuffer, each after one simulation tick run
+	on this thread, writes the -dump frames and prints the frame time statistics.
+*/
+int runHeadless()
+{
+	double * frameTime = new double[headlessFrames];
+	char fileName[32];
+
+	reshape(headless.width, headless.height);
+	for (int frame = 0; frame < headlessFrames; frame++)
+	{
+		update();
+		publishSnapshot();
+
+		std::chrono::steady_clock::time_point frameStart = std::chrono::steady_clock::now();
+		display(); // glutSwapBuffers() waits for the frame to finish
+		frameTime[frame] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count();
+
+		for (int d = 0; d < nDumpFrames; d++)
+		{
+			if (dumpFrame[d] != frame)
+				continue;
+			sprintf(fileName, "frame%d.ppm", frame);
+			if (writeHeadlessPPM(&headless, fileName))
+				printf("wrote %s\n", fileName);
+		}
+	}
+
+	frameCapture.finish(true); // the last frames' reads, while the context is current
+	printFrameTimes(frameTime, headlessFrames);
+	printf("last frame: %d triangles in %d draws, %d visible, %d culled, %d particles, %d state changes, %d avoided\n",
+		trianglesDrawn, drawCalls, visibleCount, culledCount, particlesDrawn, glState.getIssued(), glState.getAvoided());
+	delete[] frameTime;
+	destroyHeadlessContext(&headless);
+	return EXIT_SUCCESS;
+}
+# endif
+
 /*
 The main() has a number of tasks:
 * Initialize and open a window
@@ -1329,7 +1630,43 @@ The main() has a number of tasks:
 */
 int main(int argc, char* argv[]){
 
+# ifndef __Headless__
 	glutInit(&argc, argv); // Initializes GLUT.
+# endif
+
+	// glutInit removed its own arguments, select the scene and the model vertex format
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-float") == 0)
+			vertexFormat = TRI_VERTEX_FLOAT;
+		else if (strcmp(argv[i], "-quantized") == 0)
+			vertexFormat = TRI_VERTEX_QUANTIZED;
+		else if (strcmp(argv[i], "-nopersistent") == 0)
+			persistentMapping = false;
+		else if (strcmp(argv[i], "-nomdi") == 0)
+			multiDrawIndirect = false;
+		else if (strcmp(argv[i], "-noshadercache") == 0)
+			shaderCacheDirectory = NULL;
+		else if (strcmp(argv[i], "-scene") == 0 && i + 1 < argc)
+			sceneFile = argv[++i];
+		else if (strcmp(argv[i], "-capture") == 0 && i + 1 < argc)
+			captureFile = argv[++i];
+# ifdef __Headless__
+		else if (strcmp(argv[i], "-frames") == 0 && i + 1 < argc)
+			headlessFrames = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-dump") == 0 && i + 1 < argc && nDumpFrames < 16)
+			dumpFrame[nDumpFrames++] = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-hud") == 0)
+			showHud = true;
+# endif
+	}
+
+	if (!loadScene())
+		return EXIT_FAILURE;
+# ifdef __Headless__
+	if (!createHeadlessContext(&headless))
+		return EXIT_FAILURE;
+# else
 # ifdef __Mac__
   // Can't change the version in the GLUT_3_2_CORE_PROFILE
   glutInitDisplayMode(GLUT_RGBA | GLUT_DOUBLE | GLUT_DEPTH | GLUT_3_2_CORE_PROFILE);
@@ -1345,11 +1682,16 @@ int main(int argc, char* argv[]){
   # endif
 
 	glutCreateWindow(titleStr);
+# endif
 
 	// GLEW manages function pointers for OpenGL, so GLEW needs to be initialized before calling OpenGL functions.
 	
 	glewExperimental = GL_TRUE;  // Set true to use more modern techniques for managing OpenGL functionality.
 	GLenum err = glewInit(); // Initialize GLEW
+# ifdef __Headless__
+	if (err == GLEW_ERROR_NO_GLX_DISPLAY) // the GL functions are loaded, see headless465.hpp
+		err = GLEW_OK;
+# endif
 	if (GLEW_OK != err) // Check for any errors. (Must be done after GLUT has been inititalized)
 	{
 		printf("GLEW Error: %s \n", glewGetErrorString(err));
@@ -1361,23 +1703,46 @@ int main(int argc, char* argv[]){
 			glGetString(GL_VERSION),
 			glGetString(GL_SHADING_LANGUAGE_VERSION));
 	}
+# ifdef __Headless__
+	printf("Renderer %s\n", glGetString(GL_RENDERER));
+	if (!createHeadlessFramebuffer(&headless, 800, 600))
+		return EXIT_FAILURE;
+# endif
 
 
-	// initialize scene
+	// initialize scene, and publish its starting positions so display() always has a snapshot to draw
 	init();
-
+	entities->updateWorld();
+	publishSnapshot();
+# ifdef __Headless__
+	bool keepEveryFrame = true; // frames aren't due at any time, the writer sets the pace
+# else
+	bool keepEveryFrame = false; // a frame the writer can't take in time is dropped
+# endif
+	if (captureFile != NULL && !frameCapture.start(captureFile, windowWidth, windowHeight, captureRate, keepEveryFrame))
+		return EXIT_FAILURE;
+
+# ifdef __Headless__
+	return runHeadless();
+# else
 	// set glut callback functions
 	glutDisplayFunc(display); // Continuously called for interacting with the window. 
 	glutReshapeFunc(reshape);
 	glutKeyboardFunc(keyboard);
 	glutSpecialFunc(handleSpecialKeypress);
 
-	glutIdleFunc(NULL); // start with intervalTimer
-	glutTimerFunc(timeQuantum[timeQuantumState], update, 1); // glutTimerFunc(time, fn, arg). This sets fn() to be called after time millisecond with arg as an argument to fn().
+	glutIdleFunc(idle); // redraw whenever the simulation publishes a tick
+
+	// start the simulation thread from the published starting positions
+	simulationRunning = true;
+	simulationThread = new std::thread(simulate);
+	atexit(stopSimulation);
+	atexit(finishCapture);
 
 	glutMainLoop();  // This call passes control to enter GLUT event processing cycle.
 
 	printf("done\n");
 	return 0;
+# endif
 
 }//main
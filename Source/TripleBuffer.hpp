@@ -0,0 +1,74 @@
+/*
+File: TripleBuffer.hpp
+
+Description: Hands the latest value of a T from one writer thread to one
+reader thread without locks, the simulation's world snapshots to the render
+thread. There are three slots: the writer fills its back slot and publish()
+swaps it with the middle slot, the reader's read() swaps its front slot with
+the middle one if a newer value was published since. Neither thread ever
+waits for the other, a slow reader skips values and a slow writer leaves the
+reader drawing the same value again.
+
+The middle slot's index and a fresh flag share one atomic int, so each swap
+is a single exchange. The writer must publish() once before the reader's
+first read(), the slots are only what getSlot() set up until then.
+*/
+
+# include <atomic>
+
+# define TRIPLE_BUFFER_INDEX 3	// mask of the slot index in middle
+# define TRIPLE_BUFFER_FRESH 4	// set in middle while its slot is unread
+
+template <class T>
+class TripleBuffer
+{
+
+protected:
+
+	T slot[3];
+	std::atomic<int> middle;	// slot between the threads, with TRIPLE_BUFFER_FRESH
+	int back;					// slot the writer fills, only the writer uses it
+	int front;					// slot the reader reads, only the reader uses it
+
+public:
+
+	// Constructor, the slots are default constructed
+	TripleBuffer()
+	{
+		back = 0;
+		middle = 1;
+		front = 2;
+	}
+
+	// Returns slot i, to set up the slots before either thread uses them.
+	T * getSlot(int i)
+	{
+		return &slot[i];
+	}
+
+	// Writer: returns the slot to fill before the next publish().
+	T * write()
+	{
+		return &slot[back];
+	}
+
+	// Writer: makes the filled slot the latest value and takes the middle slot as the next one to fill.
+	void publish()
+	{
+		back = middle.exchange(back | TRIPLE_BUFFER_FRESH, std::memory_order_acq_rel) & TRIPLE_BUFFER_INDEX;
+	}
+
+	// Reader: true if a value was published since the last read().
+	bool hasNew()
+	{
+		return (middle.load(std::memory_order_acquire) & TRIPLE_BUFFER_FRESH) != 0;
+	}
+
+	// Reader: returns the latest published value, it stays valid and unchanged until the next read().
+	const T * read()
+	{
+		if (hasNew())
+			front = middle.exchange(front, std::memory_order_acq_rel) & TRIPLE_BUFFER_INDEX;
+		return &slot[front];
+	}
+};
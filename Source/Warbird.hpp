@@ -1,7 +1,10 @@
 /*
 File: Warbird.hpp
 
-Description: Class that handles the initialization and updates of the Warbird.
+Description: Handle on the warbird's entity, its Pilot and Kinematics in
+an EntityStore. The keys set this tick's move and turns, updateAll() flies
+every piloted ship by them. A destroyed ship loses its Kinematics, so
+nothing moves it until restart().
 */
 
 # ifndef __INCLUDES465__
@@ -9,64 +12,63 @@ Description: Class that handles the initialization and updates of the Warbird.
 # define __INCLUDES465__
 # endif
 
-class Warbird : public Object3D
+class Warbird : public Entity
 {
 
 protected:
-	glm::vec3 distance;
-	glm::vec3 pitchVector;
-	glm::vec3 initialPosition;
 
-	float speed;
-
-	int step; // the direction the warbird will be moving: positive or negative
-	int pitch, roll, yaw; // Determines the axis the warbird will orientate on.
-
-	bool alive;
+	Pilot * pilot()
+	{
+		return store->pilot.get(entity);
+	}
 
 public:
-	/* Constructor */
-	Warbird(float modelSize, float modelBoundingRadius, glm::vec3 passedInitialPosition)
-		: Object3D(modelSize, modelBoundingRadius) 
+	/* Constructor, gives passedEntity a Pilot and Kinematics at passedInitialPosition
+	turning passedTurnRate radians a tick while a turn key is held.
+	*/
+	Warbird(EntityStore * passedStore, int passedEntity, glm::vec3 passedInitialPosition, float passedTurnRate)
+		: Entity(passedStore, passedEntity)
 	{
-		initialPosition = passedInitialPosition;
+		Pilot * p = store->pilot.add(entity);
+		p->start = passedInitialPosition;
+		p->turnRate = passedTurnRate;
 
 		// Set the initial speed and the variables that will determine the movement and rotation
-		speed = 10.0f;
-		step = 0;
-		pitch = 0;
-		roll = 0;
-		yaw = 0;
-
-		alive = true;
+		p->speed = 10.0f;
+		p->step = 0;
+		p->pitch = 0;
+		p->roll = 0;
+		p->yaw = 0;
+		restart();
+		place(passedInitialPosition, glm::quat(1.0f, 0.0f, 0.0f, 0.0f));
 	}
 
 	/* Method returns true if the warbird is alive, otherwise false
 	*/
-	bool isAlive() 
+	bool isAlive()
 	{
-		return alive;
+		return pilot()->alive;
 	}
 
 
 	// Change warbird's movement speed.
-	void setSpeed(float newSpeed) 
+	void setSpeed(float newSpeed)
 	{
-		speed = newSpeed;
+		pilot()->speed = newSpeed;
 	}
 
 	float getSpeed()
 	{
-		return speed;
+		return pilot()->speed;
 	}
 
 	/* Changes the step value of the warbird. If positive
 	 the warbird will move forward. If negative the
 	warbird will move backwards.
 	*/
-	void setMove(int value) 
+	void setMove(int value)
 	{
-		step = value;
+		pilot()->step = value;
 	}
 
 	/* Sets the pitch value of the warbird, If the value is a
@@ -74,9 +76,9 @@ public:
 	an upward direction. If the value is a negative 1, the
 	warbird will rotate about the x axis in a downward direction.
 	*/
-	void setPitch(int newPitch) 
+	void setPitch(int newPitch)
 	{
-		pitch = newPitch;
+		pilot()->pitch = newPitch;
 	}
 
 	/* Sets the roll value of the warbird, If the value is a
@@ -84,9 +86,9 @@ public:
 	the right. If the value is a negative 1, the warbird will
 	rotate about the z axis in a to the left.
 	*/
-	void setRoll(int newRoll) 
+	void setRoll(int newRoll)
 	{
-		roll = newRoll;
+		pilot()->roll = newRoll;
 	}
 
 	/* Sets the pitch value of the warbird, If the value is a
@@ -94,18 +96,51 @@ public:
 	to the right. If the value is a negative 1, the warbird
 	will rotate about the y axis to the left.
 	*/
-	void setYaw(int newYaw) 
+	void setYaw(int newYaw)
+	{
+		pilot()->yaw = newYaw;
+	}
+
+	// Returns the translation, the origin while the warbird is destroyed.
+	glm::vec3 getTranslation()
+	{
+		Kinematics * k = store->kinematics.get(entity);
+		return k == NULL ? glm::vec3(0.0f) : k->translation;
+	}
+
+	// Moves the warbird to passedTranslation, if it is alive.
+	void setTranslation(glm::vec3 passedTranslation)
+	{
+		Kinematics * k = store->kinematics.get(entity);
+		if (k != NULL)
+			k->translation = passedTranslation;
+	}
+
+	// Moves the warbird by passedDistance, if it is alive.
+	void move(glm::vec3 passedDistance)
 	{
-		yaw = newYaw;
+		Kinematics * k = store->kinematics.get(entity);
+		if (k != NULL)
+			k->translation += passedDistance;
+	}
+
+	// Turns the warbird to passedRotation, if it is alive.
+	void setRotation(glm::quat passedRotation)
+	{
+		Kinematics * k = store->kinematics.get(entity);
+		if (k != NULL)
+			k->rotation = passedRotation;
 	}
 
 	/* Sets the location of the object in the center of the
 	world and deactivates the warbird.
 	*/
-	void destroy() 
+	void destroy()
 	{
-		orientationMatrix = identity;
-		alive = false;
+		place(glm::vec3(0.0f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f));
+		store->kinematics.remove(entity);
+		store->retire(entity); // missiles homing on it lose it
+		pilot()->alive = false;
 		printf("The warbird is dead. \n");
 	}
 
@@ -113,45 +148,44 @@ public:
 	/* Resets the warbird to its default state at the start
 	of the simulation.
 	*/
-	void restart() 
+	void restart()
 	{
-		alive = true;
-		translationMatrix = glm::translate(identity, initialPosition);
-		rotationMatrix = glm::rotate(identity, 0.0f, glm::vec3(0, 1, 0));
+		Pilot * p = pilot();
+		Kinematics * k = store->kinematics.add(entity);
+		p->alive = true;
+		k->translation = p->start;
+		k->rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+		k->turn = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+		k->orbit = false;
 	}
 
-	/* Updates the location of an object and
-	rotates the object by a given amount in radians if any
-	rotation is set to occur.
+	/* The Pilot system: moves every live piloted ship by its step and sets
+	its turn, which updateKinematics() then applies, for this tick.
 	*/
-	void update() 
+	static void updateAll(EntityStore * store)
 	{
-		if (!alive) 
+		for (int s = 0; s < store->pilot.getCount(); s++)
 		{
-			return;
+			Pilot & p = store->pilot.at(s);
+			int entity = store->pilot.getEntity(s);
+			Kinematics * k = store->kinematics.get(entity);
+			if (p.alive && k != NULL)
+			{
+				// The distance the warbird will travel
+				// if step is 0, there will be no translation of the warbird.
+				glm::vec3 distance = getIn(store->transform[entity].rotation) * (-p.step * p.speed);
+
+				// If any of pitch, yaw or roll have been set to a value that is not 0,
+				// then the warbird will rotate about that axis a set amount of radians.
+				if ((p.pitch != 0) || (p.yaw != 0) || (p.roll != 0))
+					k->turn = glm::angleAxis(p.turnRate, glm::normalize(glm::vec3(p.pitch, p.yaw, p.roll)));
+				else
+					k->turn = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+				k->translation += distance;
+			}
+
+			// Reset the values back to their default
+			p.step = p.pitch = p.yaw = p.roll = 0;
 		}
-
-		// The distance the warbird will travel
-		// if step is 0, there will be no translation of the warbird.
-		distance = getIn(orientationMatrix) * (-step * speed);
-
-		// Determine the rotation axis of the warbird
-		rotationAxis = glm::vec3(pitch, yaw, roll);
-
-		// If any of these values have been set to a value that is not
-		// 0, then the warbird will rotate about an axis a set amount of
-		// radians.
-		if ((pitch != 0) || (yaw != 0) || (roll != 0))
-		{
-			rotationMatrix = glm::rotate(rotationMatrix, rotationAmount, rotationAxis);
-		}
-
-		setTranslationMatrix(distance);
-
-		// Update the overall location of the object
-		orientationMatrix = translationMatrix * rotationMatrix;
-
-		// Reset the values back to their default
-		step = pitch = yaw = roll = 0;
 	}
-};
\ No newline at end of file
+};
@@ -0,0 +1,49 @@
+/*
+File: scene2bin.cpp
+
+Description: Offline compiler from the text form of a scene to its binary
+form (see Scene.hpp). The scene is validated, the triangles of every model
+without a "triangles" count are counted from its *.tri file, and the
+entities are written in the record layout the simulator reads with one
+fread. The compiled scene is printed so scenario variants can be checked
+before they are run.
+
+Usage:
+	scene2bin scene.txt scene.bin
+
+The *.tri files are looked up relative to the current directory, like the
+simulator does.
+*/
+
+# define __Mac__
+using namespace std;
+
+# include <stdio.h>
+# include <stdlib.h>
+# include <string.h>
+# include "../includes465/include465.hpp"
+# include "Scene.hpp"
+
+int main(int argc, char* argv[])
+{
+	Scene scene;
+
+	if (argc != 3)
+	{
+		printf("usage: scene2bin scene.txt scene.bin\n");
+		return EXIT_FAILURE;
+	}
+
+	if (!scene.load(argv[1]) || !scene.countTriangles())
+		return EXIT_FAILURE;
+
+	if (!scene.writeBinary(argv[2]))
+	{
+		printf("scene2bin error: can't write %s\n", argv[2]);
+		return EXIT_FAILURE;
+	}
+
+	scene.print();
+	printf("wrote %d entities to %s\n", scene.nEntities, argv[2]);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,183 @@
+/*
+File: tri2bin.cpp
+
+Description: Offline compiler that packs AC3D *.tri models into one binary
+model archive (see includes465/triArchive465.hpp). Each model is parsed once
+with loadTriModel(), indexed with indexTriModel() and simplified with
+buildTriLodChain(), so the archive holds the same vertices, colors, normals,
+levels of detail and bounding radius the simulator would compute at startup,
+packed in one interleaved vertex format. The vertex
+cache miss ratio (ACMR) of each model before and after reordering is printed.
+
+Usage:
+	tri2bin [-float | -quantized] archive.bin model1.tri model2.tri ...
+
+-quantized (the default) stores 16 byte TriVertexQuantized vertices, -float
+stores 20 byte TriVertexFloat vertices. The simulator only uses archive
+entries in the vertex format it was started with.
+
+Duplicate model files on the command line are only stored once. Each entry
+records its file's size and modification time, so the simulator parses a
+model that was edited after the archive was built.
+*/
+
+# define __Mac__
+using namespace std;
+
+# include <stdio.h>
+# include <stdlib.h>
+# include <string.h>
+# include "../includes465/include465.hpp"
+
+// Writes zero bytes until the file position reaches offset.
+void padTo(FILE * fileOut, unsigned long long offset)
+{
+	static const unsigned char zero[TRI_ARCHIVE_ALIGN] = { 0 };
+	unsigned long long position = ftell(fileOut);
+
+	if (position < offset)
+		fwrite(zero, 1, (size_t)(offset - position), fileOut);
+}
+
+int main(int argc, char* argv[])
+{
+	int vertexFormat = TRI_VERTEX_QUANTIZED;
+	int firstArg = 1;
+
+	if (argc > 1 && strcmp(argv[1], "-float") == 0)
+	{
+		vertexFormat = TRI_VERTEX_FLOAT;
+		firstArg++;
+	}
+	else if (argc > 1 && strcmp(argv[1], "-quantized") == 0)
+		firstArg++;
+
+	if (argc < firstArg + 2)
+	{
+		printf("usage: tri2bin [-float | -quantized] archive.bin model1.tri model2.tri ...\n");
+		return EXIT_FAILURE;
+	}
+
+	char * archiveFile = argv[firstArg];
+	char ** modelFiles = argv + firstArg + 1;
+	int nFiles = argc - firstArg - 1;
+
+	TriArchiveHeader header;
+	TriArchiveEntry * entries = (TriArchiveEntry *)calloc(nFiles, sizeof(TriArchiveEntry));
+	int * source = (int *)calloc(nFiles, sizeof(int)); // command line index of each entry
+	unsigned int nModels = 0;
+
+	// Build the directory, skipping repeated files
+	for (int i = 0; i < nFiles; i++)
+	{
+		bool repeated = false;
+		for (unsigned int j = 0; j < nModels; j++)
+			if (strcmp(entries[j].name, modelFiles[i]) == 0)
+				repeated = true;
+		if (repeated)
+			continue;
+
+		if (strlen(modelFiles[i]) >= TRI_ARCHIVE_NAME_SIZE)
+		{
+			printf("tri2bin error: model file name %s is longer than %d characters\n",
+				modelFiles[i], TRI_ARCHIVE_NAME_SIZE - 1);
+			return EXIT_FAILURE;
+		}
+
+		int nTriangles = countTriModel(modelFiles[i]);
+		if (nTriangles <= 0)
+			return EXIT_FAILURE;
+
+		strncpy(entries[nModels].name, modelFiles[i], TRI_ARCHIVE_NAME_SIZE);
+		if (!triArchiveSourceStat(modelFiles[i], &entries[nModels].sourceSize, &entries[nModels].sourceTime))
+		{
+			printf("tri2bin error: can't stat %s\n", modelFiles[i]);
+			return EXIT_FAILURE;
+		}
+		entries[nModels].nIndices = nTriangles * 3;
+		source[nModels] = i;
+		nModels++;
+	}
+
+	// Parse, weld and vertex cache order every model
+	unsigned char ** data = (unsigned char **)calloc(nModels, sizeof(unsigned char *));
+	for (unsigned int i = 0; i < nModels; i++)
+	{
+		int nIndices = entries[i].nIndices;
+		glm::vec4 * vertex = (glm::vec4 *)calloc(nIndices, sizeof(glm::vec4));
+		glm::vec4 * color = (glm::vec4 *)calloc(nIndices, sizeof(glm::vec4));
+		glm::vec3 * normal = (glm::vec3 *)calloc(nIndices, sizeof(glm::vec3));
+		unsigned int * index = (unsigned int *)calloc(TRI_MAX_LODS * nIndices, sizeof(unsigned int));
+
+		entries[i].boundingRadius = loadTriModel(modelFiles[source[i]], nIndices, vertex, color, normal);
+		if (entries[i].boundingRadius == -1.0f)
+			return EXIT_FAILURE;
+
+		int nVertices = indexTriModel(nIndices, vertex, color, normal, index,
+			&entries[i].acmrWelded, &entries[i].acmrOptimized);
+		int nLodIndices = buildTriLodChain(index, nIndices, nVertices, vertex, color, normal, &entries[i].lod);
+		entries[i].nVertices = nVertices;
+		entries[i].vertexFormat = vertexFormat;
+		entries[i].size = triArchiveModelSize(vertexFormat, nVertices, nLodIndices);
+
+		// Pack the model in its archive layout
+		data[i] = (unsigned char *)malloc((size_t)entries[i].size);
+		entries[i].positionScale = packTriModel(vertexFormat, nVertices, vertex, color, normal, data[i]);
+		memcpy(data[i] + triArchiveVertexSize(vertexFormat, nVertices), index, nLodIndices * sizeof(unsigned int));
+
+		free(vertex);
+		free(color);
+		free(normal);
+		free(index);
+	}
+
+	// Lay out the model data after the directory
+	unsigned long long offset = triArchiveAlign(sizeof(TriArchiveHeader) + nModels * sizeof(TriArchiveEntry));
+	for (unsigned int i = 0; i < nModels; i++)
+	{
+		entries[i].offset = offset;
+		offset = triArchiveAlign(offset + entries[i].size);
+	}
+
+	FILE * fileOut = fopen(archiveFile, "wb");
+	if (fileOut == NULL)
+	{
+		printf("tri2bin error: can't create %s\n", archiveFile);
+		return EXIT_FAILURE;
+	}
+
+	memset(&header, 0, sizeof(header));
+	strcpy(header.magic, TRI_ARCHIVE_MAGIC);
+	header.version = TRI_ARCHIVE_VERSION;
+	header.nModels = nModels;
+	fwrite(&header, sizeof(header), 1, fileOut);
+	fwrite(entries, sizeof(TriArchiveEntry), nModels, fileOut);
+
+	printf("%-24s %8s %8s %8s %14s  %s\n", "model", "indices", "vertices", "radius", "ACMR", "LOD triangles (error)");
+	for (unsigned int i = 0; i < nModels; i++)
+	{
+		padTo(fileOut, entries[i].offset);
+		fwrite(data[i], 1, (size_t)entries[i].size, fileOut);
+		free(data[i]);
+
+		printf("%-24s %8d %8d %8.2f %6.3f > %5.3f ", entries[i].name, entries[i].nIndices,
+			entries[i].nVertices, entries[i].boundingRadius, entries[i].acmrWelded, entries[i].acmrOptimized);
+		for (unsigned int l = 0; l < entries[i].lod.nLods; l++)
+			printf(" %d (%.2f)", entries[i].lod.count[l] / 3, entries[i].lod.error[l]);
+		printf("\n");
+	}
+
+	if (ferror(fileOut) || fclose(fileOut) != 0)
+	{
+		printf("tri2bin error: failed writing %s\n", archiveFile);
+		remove(archiveFile);
+		return EXIT_FAILURE;
+	}
+
+	printf("wrote %s: %d models, %s vertices, %llu bytes\n", archiveFile, nModels,
+		vertexFormat == TRI_VERTEX_QUANTIZED ? "quantized" : "float", offset);
+	free(entries);
+	free(source);
+	free(data);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,147 @@
+/*
+File: triBench.cpp
+
+Description: Measures how fast loadTriModel() parses *.tri models, in MB/s,
+next to a reference parse of the same files with per-token fscanf() (the way
+loadTriModel() used to read them). Every model is parsed repeatedly from the
+page cache, so the numbers are parser throughput rather than disk speed.
+
+Usage:
+	triBench [iterations] model1.tri model2.tri ...
+
+With no model files the bundled models are measured.
+*/
+
+# define __Mac__
+using namespace std;
+
+# include <stdio.h>
+# include <stdlib.h>
+# include <chrono>
+# include "../includes465/include465.hpp"
+
+char * bundledModels[] = {
+	"ruber.tri", "unum.tri", "MountainPlanet.tri", "primus.tri", "secundus.tri", "duo.tri",
+	"warbird.tri", "spaceShip-bs100.tri", "MissileSite.tri", "Missile.tri", "axes-r100.tri"
+};
+
+// Reference parser: per-token fscanf, returns the number of triangles read.
+int fscanfTriModel(char * fileName, glm::vec4 vertex[], glm::vec4 color[])
+{
+	FILE * fileIn = fopen(fileName, "r");
+	float coord[3];
+	unsigned int triangleColor;
+	int count = 0;
+
+	if (fileIn == NULL)
+		return -1;
+
+	while (fscanf(fileIn, "%f %f %f", &coord[0], &coord[1], &coord[2]) == 3)
+	{
+		vertex[count * 3] = glm::vec4(coord[0], coord[1], coord[2], 1.0f);
+		for (int i = 1; i < 3; i++)
+		{
+			fscanf(fileIn, "%f %f %f", &coord[0], &coord[1], &coord[2]);
+			vertex[count * 3 + i] = glm::vec4(coord[0], coord[1], coord[2], 1.0f);
+		}
+		fscanf(fileIn, "%x", &triangleColor);
+		color[count * 3] = glm::vec4(triangleColor >> 16, (triangleColor >> 8) & 0xFF, triangleColor & 0xFF, 255.0f) / 255.0f;
+		count++;
+	}
+	fclose(fileIn);
+	return count;
+}
+
+// Counts a model's triangles and returns its size in bytes.
+long sizeTriModel(char * fileName, int * nTriangles)
+{
+	FILE * fileIn = fopen(fileName, "r");
+	char token[64];
+	int tokens = 0;
+
+	if (fileIn == NULL)
+		return -1;
+	while (fscanf(fileIn, "%63s", token) == 1)
+		tokens++;
+	long size = ftell(fileIn);
+	fclose(fileIn);
+
+	*nTriangles = tokens / 10;
+	return size;
+}
+
+double secondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char* argv[])
+{
+	int iterations = 50;
+	char ** modelFiles = bundledModels;
+	int nFiles = sizeof(bundledModels) / sizeof(bundledModels[0]);
+
+	if (argc > 1)
+	{
+		iterations = atoi(argv[1]);
+		if (iterations < 1)
+			iterations = 1;
+	}
+	if (argc > 2)
+	{
+		modelFiles = argv + 2;
+		nFiles = argc - 2;
+	}
+
+	double totalBytes = 0.0, totalTime = 0.0, totalReferenceTime = 0.0;
+
+	printf("%-24s %9s %9s %12s %12s %8s\n", "model", "triangles", "KB", "loadTri MB/s", "fscanf MB/s", "speedup");
+	for (int f = 0; f < nFiles; f++)
+	{
+		int nTriangles;
+		long size = sizeTriModel(modelFiles[f], &nTriangles);
+		if (size <= 0)
+		{
+			printf("triBench error: can't read %s\n", modelFiles[f]);
+			continue;
+		}
+
+		int nVertices = nTriangles * 3;
+		glm::vec4 * vertex = (glm::vec4 *)calloc(nVertices, sizeof(glm::vec4));
+		glm::vec4 * color = (glm::vec4 *)calloc(nVertices, sizeof(glm::vec4));
+		glm::vec3 * normal = (glm::vec3 *)calloc(nVertices, sizeof(glm::vec3));
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (int i = 0; i < iterations; i++)
+		{
+			if (loadTriModel(modelFiles[f], nVertices, vertex, color, normal) == -1.0f)
+			{
+				printf("triBench error: loadTriModel failed on %s\n", modelFiles[f]);
+				return EXIT_FAILURE;
+			}
+		}
+		double time = secondsSince(start);
+
+		start = std::chrono::steady_clock::now();
+		for (int i = 0; i < iterations; i++)
+			fscanfTriModel(modelFiles[f], vertex, color);
+		double referenceTime = secondsSince(start);
+
+		double megabytes = (double)size * iterations / (1024.0 * 1024.0);
+		printf("%-24s %9d %9.1f %12.1f %12.1f %7.1fx\n", modelFiles[f], nTriangles, size / 1024.0,
+			megabytes / time, megabytes / referenceTime, referenceTime / time);
+
+		totalBytes += megabytes;
+		totalTime += time;
+		totalReferenceTime += referenceTime;
+
+		free(vertex);
+		free(color);
+		free(normal);
+	}
+
+	if (totalTime > 0.0)
+		printf("%-24s %9s %9s %12.1f %12.1f %7.1fx\n", "total", "", "", totalBytes / totalTime,
+			totalBytes / totalReferenceTime, totalReferenceTime / totalTime);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,163 @@
+/*
+cluster465.hpp
+
+Clustered light assignment for forward shading:  clusterScale(...) and
+assignClusterLights(...)
+
+The view frustum is split into CLUSTER_X x CLUSTER_Y screen tiles and
+CLUSTER_Z depth slices.  The slices are exponential in view depth, so a
+cluster's depth grows with its distance like its width does.  Every point
+light is listed in each cluster its sphere of influence may reach, and a
+fragment only loops over the lights of its own cluster.
+
+assignClusterLights(...) bounds each light's view space sphere by a box,
+projects the box to a range of tiles and its depth to a range of slices.
+With SSE the tile ranges of 4 lights are computed at once.  The ranges are
+conservative, a light may be listed in a corner cluster it misses, but it is
+never left out of one it reaches.  A counting pass then packs the lists of
+all the clusters into one index array.
+
+The arrays match the Clusters and LightIndices uniform blocks of
+SimpleFragment.glsl in std140 layout:  cell[i] is cluster i's first entry
+<< 16 | its number of entries, 4 cells to a uvec4;  the entries are 16 bit
+light numbers, 2 to an unsigned int and 8 to a uvec4.  Cluster i is tile x,
+y of slice z with i = (z * CLUSTER_Y + y) * CLUSTER_X + x, x and y counting
+from the lower left of the window.
+*/
+
+# ifdef __SSE2__
+# include <emmintrin.h>
+# endif
+
+# define CLUSTER_X 16
+# define CLUSTER_Y 8
+# define CLUSTER_Z 16
+# define CLUSTER_COUNT (CLUSTER_X * CLUSTER_Y * CLUSTER_Z)
+# define CLUSTER_MAX_LIGHTS 256
+# define CLUSTER_MAX_INDICES 8192  // list entries of all the clusters together, a 16 KB uniform block
+
+/* the grid's constants for a width x height window and the projection's near and far distances:
+tiles per pixel in x and y, slices per unit of log depth and the log of the near distance
+*/
+glm::vec4 clusterScale(int width, int height, float nearZ, float farZ) {
+  return glm::vec4((float) CLUSTER_X / width, (float) CLUSTER_Y / height,
+    CLUSTER_Z / logf(farZ / nearZ), logf(nearZ));
+  }
+
+// slice of view depth, clamped to the grid
+int clusterSlice(float depth, const glm::vec4 & scale) {
+  int slice = (int) ((logf(depth) - scale.w) * scale.z);
+  return slice < 0 ? 0 : (slice >= CLUSTER_Z ? CLUSTER_Z - 1 : slice);
+  }
+
+// tile of ndc in [-1, 1] across tiles tiles, clamped to the grid
+int clusterTile(float ndc, int tiles) {
+  int tile = (int) ((ndc + 1.0f) * 0.5f * tiles);
+  return tile < 0 ? 0 : (tile >= tiles ? tiles - 1 : tile);
+  }
+
+/* A light's box from its view space center x, y, z and radius, false if it misses the frustum.
+The box's nearest and farthest depths bound its projection:  a side left of (or below) the
+axis is farthest out at the nearest depth, a side right of (or above) it at the farthest.
+*/
+bool clusterLightBox(float x, float y, float z, float radius, float projX, float projY,
+  float nearZ, float farZ, float box[6])
+  {
+  float zMin = glm::max(-z - radius, nearZ), zMax = glm::min(-z + radius, farZ);
+  float xMin = x - radius, xMax = x + radius, yMin = y - radius, yMax = y + radius;
+  box[0] = projX * xMin / (xMin < 0.0f ? zMin : zMax);
+  box[1] = projX * xMax / (xMax > 0.0f ? zMin : zMax);
+  box[2] = projY * yMin / (yMin < 0.0f ? zMin : zMax);
+  box[3] = projY * yMax / (yMax > 0.0f ? zMin : zMax);
+  box[4] = zMin;
+  box[5] = zMax;
+  return zMin <= zMax && box[1] >= -1.0f && box[0] <= 1.0f && box[3] >= -1.0f && box[2] <= 1.0f;
+  }
+
+/* List each of the n view space light spheres (center x, y, z and radius) in the clusters it
+may reach, for a projection with [0][0] projX and [1][1] projY, nearZ, farZ and the
+clusterScale(...) scale.  Writes cell[CLUSTER_COUNT] and index[CLUSTER_MAX_INDICES / 2], see
+above.  Returns the number of entries.  The clusters are filled nearest slice first, if all
+their entries don't fit in CLUSTER_MAX_INDICES the farthest clusters lose theirs.
+*/
+int assignClusterLights(const float x[], const float y[], const float z[], const float radius[], int n,
+  float projX, float projY, float nearZ, float farZ, const glm::vec4 & scale,
+  GLuint cell[CLUSTER_COUNT], GLuint index[CLUSTER_MAX_INDICES / 2])
+  {
+  static float box[6][CLUSTER_MAX_LIGHTS];  // ndc x min, x max, y min, y max, depth min, max of each light
+  static unsigned char range[6][CLUSTER_MAX_LIGHTS];  // first and last tile x, y and slice
+  static int fill[CLUSTER_COUNT];
+  unsigned short * entry = (unsigned short *) index;
+  int visible[CLUSTER_MAX_LIGHTS], nVisible = 0, i = 0, nEntries = 0;
+  if (n > CLUSTER_MAX_LIGHTS) n = CLUSTER_MAX_LIGHTS;
+
+# ifdef __SSE2__
+  const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f), minusOne = _mm_set1_ps(-1.0f);
+  const __m128 px = _mm_set1_ps(projX), py = _mm_set1_ps(projY);
+  const __m128 near4 = _mm_set1_ps(nearZ), far4 = _mm_set1_ps(farZ);
+  for (; i + 4 <= n; i += 4) {
+    __m128 cx = _mm_loadu_ps(x + i), cy = _mm_loadu_ps(y + i), r = _mm_loadu_ps(radius + i);
+    __m128 depth = _mm_sub_ps(zero, _mm_loadu_ps(z + i));
+    __m128 zMin = _mm_max_ps(_mm_sub_ps(depth, r), near4), zMax = _mm_min_ps(_mm_add_ps(depth, r), far4);
+    __m128 side[4] = { _mm_sub_ps(cx, r), _mm_add_ps(cx, r), _mm_sub_ps(cy, r), _mm_add_ps(cy, r) };
+    for (int s = 0; s < 4; s++) {
+      // minimum sides divide by zMin where negative, maximum sides where positive
+      __m128 nearSide = (s & 1) ? _mm_cmpgt_ps(side[s], zero) : _mm_cmplt_ps(side[s], zero);
+      __m128 divisor = _mm_or_ps(_mm_and_ps(nearSide, zMin), _mm_andnot_ps(nearSide, zMax));
+      _mm_storeu_ps(box[s] + i, _mm_div_ps(_mm_mul_ps(s < 2 ? px : py, side[s]), divisor));
+      }
+    _mm_storeu_ps(box[4] + i, zMin);
+    _mm_storeu_ps(box[5] + i, zMax);
+    __m128 inside = _mm_and_ps(_mm_cmple_ps(zMin, zMax),
+      _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(_mm_loadu_ps(box[1] + i), minusOne), _mm_cmple_ps(_mm_loadu_ps(box[0] + i), one)),
+        _mm_and_ps(_mm_cmpge_ps(_mm_loadu_ps(box[3] + i), minusOne), _mm_cmple_ps(_mm_loadu_ps(box[2] + i), one))));
+    int mask = _mm_movemask_ps(inside);
+    while (mask != 0) {
+      visible[nVisible++] = i + __builtin_ctz(mask);
+      mask &= mask - 1;
+      }
+    }
+# endif
+  for (; i < n; i++) {
+    float b[6];
+    if (clusterLightBox(x[i], y[i], z[i], radius[i], projX, projY, nearZ, farZ, b)) visible[nVisible++] = i;
+    for (int s = 0; s < 6; s++) box[s][i] = b[s];
+    }
+
+  // the box's tile and slice ranges, then each cluster's number of lights
+  memset(cell, 0, CLUSTER_COUNT * sizeof(GLuint));
+  for (int v = 0; v < nVisible; v++) {
+    int l = visible[v];
+    range[0][l] = clusterTile(box[0][l], CLUSTER_X);
+    range[1][l] = clusterTile(box[1][l], CLUSTER_X);
+    range[2][l] = clusterTile(box[2][l], CLUSTER_Y);
+    range[3][l] = clusterTile(box[3][l], CLUSTER_Y);
+    range[4][l] = clusterSlice(box[4][l], scale);
+    range[5][l] = clusterSlice(box[5][l], scale);
+    for (int cz = range[4][l]; cz <= range[5][l]; cz++)
+      for (int cy = range[2][l]; cy <= range[3][l]; cy++)
+        for (int cx = range[0][l]; cx <= range[1][l]; cx++)
+          cell[(cz * CLUSTER_Y + cy) * CLUSTER_X + cx]++;
+    }
+
+  // each cluster's first entry, the counts are cut where the entries run out
+  for (int c = 0; c < CLUSTER_COUNT; c++) {
+    int count = glm::min((int) cell[c], CLUSTER_MAX_INDICES - nEntries);
+    fill[c] = nEntries;
+    cell[c] = (GLuint) nEntries << 16 | count;
+    nEntries += count;
+    }
+
+  // and the entries, in light order within each cluster
+  for (int v = 0; v < nVisible; v++) {
+    int l = visible[v];
+    for (int cz = range[4][l]; cz <= range[5][l]; cz++)
+      for (int cy = range[2][l]; cy <= range[3][l]; cy++)
+        for (int cx = range[0][l]; cx <= range[1][l]; cx++) {
+          int c = (cz * CLUSTER_Y + cy) * CLUSTER_X + cx;
+          if (fill[c] < (int) (cell[c] >> 16) + (int) (cell[c] & 0xFFFF))
+            entry[fill[c]++] = (unsigned short) l;
+          }
+    }
+  return nEntries;
+  }
@@ -0,0 +1,78 @@
+/*
+frustum465.hpp
+
+View frustum culling of bounding spheres:  frustumPlanes(...) and
+cullSpheres(...)
+
+frustumPlanes(...) extracts the 6 planes of a projection * view matrix
+(Gribb and Hartmann) with their normals pointing into the frustum and
+normalized, so a plane's value at a point is its signed distance.
+
+cullSpheres(...) tests a batch of spheres stored structure of arrays
+(center x, y, z and radius arrays) against the 6 planes.  A sphere is
+visible unless it lies entirely behind one plane.  With SSE 4 spheres are
+tested at once against each plane;  the test is conservative near the
+frustum's edges and corners, which only costs drawing a few objects that
+turn out to be off screen.
+*/
+
+# ifdef __SSE2__
+# include <emmintrin.h>
+# endif
+
+# define FRUSTUM_PLANES 6
+
+// plane i is (a, b, c, d) with a x + b y + c z + d >= 0 inside:  left, right, bottom, top, near, far
+void frustumPlanes(const glm::mat4 & viewProjection, glm::vec4 plane[FRUSTUM_PLANES]) {
+  // glm is column major:  row r is (m[0][r], m[1][r], m[2][r], m[3][r])
+  glm::vec4 row[4];
+  for (int r = 0; r < 4; r++)
+    row[r] = glm::vec4(viewProjection[0][r], viewProjection[1][r], viewProjection[2][r], viewProjection[3][r]);
+  for (int i = 0; i < 3; i++) {
+    plane[2 * i] = row[3] + row[i];
+    plane[2 * i + 1] = row[3] - row[i];
+    }
+  for (int i = 0; i < FRUSTUM_PLANES; i++)
+    plane[i] = plane[i] * (1.0f / glm::length(glm::vec3(plane[i])));
+  }
+
+// true if the sphere is at least partly inside all the planes
+bool sphereInFrustum(const glm::vec4 plane[FRUSTUM_PLANES], float x, float y, float z, float radius) {
+  for (int p = 0; p < FRUSTUM_PLANES; p++)
+    if (plane[p].x * x + plane[p].y * y + plane[p].z * z + plane[p].w < -radius) return false;
+  return true;
+  }
+
+// writes the index of every visible sphere of the n to visible[], returns how many there are
+int cullSpheres(const glm::vec4 plane[FRUSTUM_PLANES], const float x[], const float y[], const float z[],
+  const float radius[], int n, int visible[])
+  {
+  int nVisible = 0, i = 0;
+# ifdef __SSE2__
+  __m128 px[FRUSTUM_PLANES], py[FRUSTUM_PLANES], pz[FRUSTUM_PLANES], pw[FRUSTUM_PLANES];
+  for (int p = 0; p < FRUSTUM_PLANES; p++) {
+    px[p] = _mm_set1_ps(plane[p].x);
+    py[p] = _mm_set1_ps(plane[p].y);
+    pz[p] = _mm_set1_ps(plane[p].z);
+    pw[p] = _mm_set1_ps(plane[p].w);
+    }
+  for (; i + 4 <= n; i += 4) {
+    __m128 cx = _mm_loadu_ps(x + i), cy = _mm_loadu_ps(y + i), cz = _mm_loadu_ps(z + i);
+    __m128 negativeRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(radius + i));
+    __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    for (int p = 0; p < FRUSTUM_PLANES; p++) {
+      __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px[p], cx), _mm_mul_ps(py[p], cy)),
+        _mm_add_ps(_mm_mul_ps(pz[p], cz), pw[p]));
+      inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negativeRadius));
+      }
+    int mask = _mm_movemask_ps(inside);
+    while (mask != 0) {
+      visible[nVisible++] = i + __builtin_ctz(mask);
+      mask &= mask - 1;
+      }
+    }
+# endif
+  for (; i < n; i++)
+    if (sphereInFrustum(plane, x[i], y[i], z[i], radius[i])) visible[nVisible++] = i;
+  return nVisible;
+  }
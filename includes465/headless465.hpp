@@ -0,0 +1,155 @@
+/*
+headless465.hpp
+
+Rendering without a window or a GPU, for benchmark machines:  an OpenGL 3.3
+core context from EGL on a surfaceless display (Mesa's llvmpipe renders it
+on the CPU), a framebuffer object standing in for the window, PPM dumps of
+rendered frames and frame time statistics.  Included by include465.hpp when
+__Headless__ is defined instead of an OS.
+
+createHeadlessContext(...) makes the context current, call it where GLUT
+would create the window and before glewInit().  A GLEW built for GLX loads
+the GL functions before it looks for an X display, so glewInit() returning
+GLEW_ERROR_NO_GLX_DISPLAY is expected and harmless.  Then
+createHeadlessFramebuffer(...) binds the framebuffer everything is drawn
+into.
+
+The few GLUT calls a display() makes have stand-ins below:  the elapsed
+time, a swap that finishes the frame so it can be timed, and no-ops for the
+title and redisplay requests.
+*/
+
+# include <EGL/egl.h>
+# include <EGL/eglext.h>
+# include <chrono>
+# include <algorithm>
+
+// GLUT stand-ins
+# define GLUT_ELAPSED_TIME 0x02BC
+# define GLUT_ACTIVE_CTRL 0x0002
+# define GLUT_KEY_LEFT 0x0064
+# define GLUT_KEY_UP 0x0065
+# define GLUT_KEY_RIGHT 0x0066
+# define GLUT_KEY_DOWN 0x0067
+
+typedef struct {
+  EGLDisplay display;
+  EGLContext context;
+  GLuint framebuffer, colorBuffer, depthBuffer;
+  int width, height;
+  } HeadlessTarget;
+
+static std::chrono::steady_clock::time_point headlessStart = std::chrono::steady_clock::now();
+
+// milliseconds since the program started, the only glutGet(...) a display() needs
+int glutGet(GLenum state) {
+  if (state != GLUT_ELAPSED_TIME) return 0;
+  return (int) std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - headlessStart).count();
+  }
+
+// the frame is done when the GL has finished it, so a timed frame includes the rendering
+void glutSwapBuffers() { glFinish(); }
+void glutPostRedisplay() {}
+void glutSetWindowTitle(const char * title) {}
+int glutGetModifiers() { return 0; }
+
+// make an OpenGL 3.3 core context current without a window, returns false with a message on error
+bool createHeadlessContext(HeadlessTarget * target) {
+  EGLint major, minor, nConfigs;
+  EGLConfig config = NULL;
+  const EGLint configAttributes[] = { EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+  const EGLint contextAttributes[] = {
+    EGL_CONTEXT_MAJOR_VERSION, 3, EGL_CONTEXT_MINOR_VERSION, 3,
+    EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT, EGL_NONE };
+
+  // prefer Mesa's surfaceless platform, it needs neither X nor a DRM device
+  PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+    (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+  target->display = EGL_NO_DISPLAY;
+  if (getPlatformDisplay != NULL)
+    target->display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+  if (target->display == EGL_NO_DISPLAY)
+    target->display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+  if (target->display == EGL_NO_DISPLAY || !eglInitialize(target->display, &major, &minor)) {
+    printf("createHeadlessContext:  no EGL display, error 0x%x\n", eglGetError());
+    return false; }
+  printf("EGL %d.%d %s\n", major, minor, eglQueryString(target->display, EGL_VENDOR));
+
+  // without a config the context can still render to a framebuffer object
+  if (!eglChooseConfig(target->display, configAttributes, &config, 1, &nConfigs) || nConfigs == 0)
+    config = NULL;  // EGL_NO_CONFIG_KHR
+  if (!eglBindAPI(EGL_OPENGL_API)) {
+    printf("createHeadlessContext:  EGL has no desktop OpenGL\n");
+    return false; }
+  target->context = eglCreateContext(target->display, config, EGL_NO_CONTEXT, contextAttributes);
+  if (target->context == EGL_NO_CONTEXT) {
+    printf("createHeadlessContext:  no OpenGL 3.3 core context, error 0x%x\n", eglGetError());
+    return false; }
+  if (!eglMakeCurrent(target->display, EGL_NO_SURFACE, EGL_NO_SURFACE, target->context)) {
+    printf("createHeadlessContext:  surfaceless contexts aren't supported, error 0x%x\n", eglGetError());
+    return false; }
+  return true;
+  }
+
+// create and bind a width x height RGBA8 and depth framebuffer to render into, call after glewInit()
+bool createHeadlessFramebuffer(HeadlessTarget * target, int width, int height) {
+  target->width = width;
+  target->height = height;
+  glGenRenderbuffers(1, &target->colorBuffer);
+  glBindRenderbuffer(GL_RENDERBUFFER, target->colorBuffer);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+  glGenRenderbuffers(1, &target->depthBuffer);
+  glBindRenderbuffer(GL_RENDERBUFFER, target->depthBuffer);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+  glGenFramebuffers(1, &target->framebuffer);
+  glBindFramebuffer(GL_FRAMEBUFFER, target->framebuffer);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, target->colorBuffer);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, target->depthBuffer);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    printf("createHeadlessFramebuffer:  %d x %d framebuffer is incomplete\n", width, height);
+    return false; }
+  glDrawBuffer(GL_COLOR_ATTACHMENT0);
+  glReadBuffer(GL_COLOR_ATTACHMENT0);
+  return true;
+  }
+
+void destroyHeadlessContext(HeadlessTarget * target) {
+  glDeleteFramebuffers(1, &target->framebuffer);
+  glDeleteRenderbuffers(1, &target->colorBuffer);
+  glDeleteRenderbuffers(1, &target->depthBuffer);
+  eglMakeCurrent(target->display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+  eglDestroyContext(target->display, target->context);
+  eglTerminate(target->display);
+  }
+
+// write the framebuffer to a binary (P6) PPM file, top row first, returns false on error
+bool writeHeadlessPPM(HeadlessTarget * target, const char * fileName) {
+  int rowSize = 3 * target->width;
+  unsigned char * pixels = (unsigned char *) malloc(rowSize * target->height);
+  FILE * fileOut = fopen(fileName, "wb");
+  bool written;
+
+  if (fileOut == NULL) {
+    printf("writeHeadlessPPM:  can't create %s\n", fileName);
+    free(pixels);
+    return false; }
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(0, 0, target->width, target->height, GL_RGB, GL_UNSIGNED_BYTE, pixels);
+  written = fprintf(fileOut, "P6\n%d %d\n255\n", target->width, target->height) > 0;
+  for (int row = target->height - 1; written && row >= 0; row--)  // GL rows start at the bottom
+    written = fwrite(pixels + row * rowSize, rowSize, 1, fileOut) == 1;
+  fclose(fileOut);
+  free(pixels);
+  return written;
+  }
+
+// print the minimum, mean, percentiles and maximum of n frame times in milliseconds, sorts frameTime
+void printFrameTimes(double * frameTime, int n) {
+  double total = 0.0;
+  if (n <= 0) return;
+  std::sort(frameTime, frameTime + n);
+  for (int i = 0; i < n; i++) total += frameTime[i];
+  printf("%d frames:  min %.3f  mean %.3f  median %.3f  p95 %.3f  p99 %.3f  max %.3f ms,  %.1f frames/s\n",
+    n, frameTime[0], total / n, frameTime[n / 2], frameTime[(int) (0.95 * (n - 1))],
+    frameTime[(int) (0.99 * (n - 1))], frameTime[n - 1], 1000.0 * n / total);
+  }
@@ -14,6 +14,7 @@ __Linux__      // Ubuntu or other distro
 __Mac__        // Mac OSX 
 __MinGW__      // Windows, Minimalist Gnu for Windows
 __Windows__    // Windows, Visual Studio 201?)
+__Headless__   // Linux without a window or GPU, EGL and Mesa llvmpipe
 
 Includes utility functions to load glsl shaders and 
 AC3D *.tri models.
@@ -54,6 +55,11 @@ Mike Barnes
 # include <GL/freeglut.h>
 # endif
 
+# ifdef __Headless__
+# include <GL/glew.h>
+# include "../includes465/headless465.hpp"  // EGL context, framebuffer and GLUT stand-ins
+# endif
+
 // include the glm shader-like math library
 # define GLM_FORCE_RADIANS  // use radians not angles
 # define GLM_MESSAGES   // compiler messages
@@ -64,6 +70,12 @@ Mike Barnes
 # include "../includes465/glmUtils465.hpp"  // print matrices and vectors, ... 
 # include "../includes465/shader465.hpp"    // load vertex and fragment shaders
 # include "../includes465/triModel465.hpp"  // load AC3D *.tri model 
+# include "../includes465/triMesh465.hpp"    // weld and vertex cache order *.tri models
+# include "../includes465/triLod465.hpp"     // simplified levels of detail for indexed models
+# include "../includes465/triBvh465.hpp"     // bounds and triangle BVH for exact collisions
+# include "../includes465/frustum465.hpp"    // view frustum culling of bounding spheres
+# include "../includes465/cluster465.hpp"    // clustered light assignment
+# include "../includes465/triArchive465.hpp" // load *.tri models from a tri2bin archive
 #include "../includes465/texture.hpp"
 // PI to 10 digits
 const float PI = 3.14159265358f;  
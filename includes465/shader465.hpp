@@ -8,17 +8,21 @@ Mike Barnes
 8/17/2013
 */
 
+# include <string.h>  // strncmp, strchr and strlen of the shader variants
+
 // Load shader from disk into a null-terminated string
 GLchar * readShaderSource(const char *fileName) {
    GLchar *shaderText = NULL;
    GLint shaderLength = 0;
    FILE *fp;
-   fp = fopen(fileName, "r");
+   fp = fopen(fileName, "rb");
    if (fp != NULL) {
-      while (fgetc(fp) != EOF) shaderLength++;     
+      // size the file once instead of counting it a character at a time
+      fseek(fp, 0, SEEK_END);
+      shaderLength = ftell(fp);
       rewind(fp);
       shaderText = (GLchar *) malloc(shaderLength+1);
-      if (shaderText != NULL) fread(shaderText, 1, shaderLength, fp);      
+      if (shaderText != NULL) shaderLength = fread(shaderText, 1, shaderLength, fp);
       shaderText[shaderLength] = '\0';  // NULL termination
       fclose(fp);
       }
@@ -119,3 +123,203 @@ GLuint loadShaders(const GLchar* vShaderFile, const GLchar* fShaderFile) {
     return shaderProgram;
     }
 
+
+/*
+Shader variants and the program binary cache
+
+A variant is a vertex and fragment shader pair compiled with #define lines
+inserted after its # version line, so a feature is switched on or off when
+the program is compiled instead of by a uniform branch in every fragment.
+loadShaderVariants(...) creates a batch of them:
+
+  A linked program is saved with glGetProgramBinary(...) in cacheDirectory,
+  named by a 64 bit FNV-1a hash of its defines, both sources and the GL
+  vendor, renderer and version, and later runs load it with glProgramBinary(...)
+  instead of compiling.  An edited shader or a new driver hashes to a new
+  name, a binary the driver rejects anyway is compiled again.
+
+  Every compile and link of the batch is issued before any status is asked
+  for, a driver with KHR or ARB_parallel_shader_compile works on all of them
+  at once on its own threads.
+
+Program binaries need GL 4.1 or ARB_get_program_binary and at least one
+binary format, without them (or with a NULL cacheDirectory) every variant is
+compiled.
+*/
+
+# ifdef __Windows__
+# include <direct.h>  // _mkdir
+# endif
+
+# define SHADER_BINARY_MAGIC 0x39343650  // "P649", first word of a cache file
+
+typedef struct {
+  const char * vertexFile, * fragmentFile;
+  const char * defines;  // "#define NAME\n" lines, "" for none
+  GLuint program;  // set by loadShaderVariants(...)
+  bool cached;  // program was loaded from the cache
+  } ShaderVariant;
+
+typedef struct {
+  GLuint magic;
+  GLenum format;
+  GLint length;  // bytes of binary following the header
+  } ShaderBinaryHeader;
+
+// 64 bit FNV-1a of a null-terminated string, continued from hash
+unsigned long long hashShaderString(unsigned long long hash, const char * text) {
+  for (; *text != '\0'; text++) {
+    hash ^= (unsigned char) *text;
+    hash *= 0x100000001b3ULL;
+    }
+  return hash * 0x100000001b3ULL;  // so "ab" + "c" and "a" + "bc" differ
+  }
+
+// offset just past the "# version" line of source, where #defines may go, 0 if it has none
+int shaderVersionEnd(const GLchar * source) {
+  for (const GLchar * line = source; *line != '\0'; ) {
+    const GLchar * c = line;
+    while (*c == ' ' || *c == '\t') c++;
+    if (*c == '#') {
+      c++;
+      while (*c == ' ' || *c == '\t') c++;
+      if (strncmp(c, "version", 7) == 0) {
+        const GLchar * end = strchr(c, '\n');
+        return end == NULL ? (int) strlen(source) : (int) (end + 1 - source);
+        }
+      }
+    const GLchar * next = strchr(line, '\n');
+    if (next == NULL) break;
+    line = next + 1;
+    }
+  return 0;
+  }
+
+// create a shader of type from source with defines after its # version line and start compiling it
+GLuint compileShaderVariant(GLenum type, const GLchar * source, const char * defines) {
+  GLuint shader = glCreateShader(type);
+  int split = shaderVersionEnd(source);
+  const GLchar * part[3] = { source, defines, source + split };
+  GLint length[3] = { split, (GLint) strlen(defines), (GLint) strlen(source + split) };
+  glShaderSource(shader, 3, part, length);
+  glCompileShader(shader);
+  return shader;
+  }
+
+// true if linked programs can be saved and loaded as binaries
+bool programBinariesSupported() {
+  GLint formats = 0;
+  if (!GLEW_VERSION_4_1 && !GLEW_ARB_get_program_binary) return false;
+  glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+  return formats > 0;
+  }
+
+// load the cache file into program, false if there's none or the driver rejects it
+bool loadProgramBinary(GLuint program, const char * fileName) {
+  ShaderBinaryHeader header;
+  GLint status = 0;
+  FILE * fileIn = fopen(fileName, "rb");
+  if (fileIn == NULL) return false;
+  if (fread(&header, sizeof(header), 1, fileIn) == 1 && header.magic == SHADER_BINARY_MAGIC && header.length > 0) {
+    void * binary = malloc(header.length);
+    if (fread(binary, header.length, 1, fileIn) == 1) {
+      glProgramBinary(program, header.format, binary, header.length);
+      glGetProgramiv(program, GL_LINK_STATUS, &status);
+      }
+    free(binary);
+    }
+  fclose(fileIn);
+  if (!status) printf("shader cache:  %s is stale, compiling\n", fileName);
+  return status != 0;
+  }
+
+// save program's binary as fileName in cacheDirectory, creating the directory if needed
+void saveProgramBinary(GLuint program, const char * cacheDirectory, const char * fileName) {
+  ShaderBinaryHeader header;
+  FILE * fileOut;
+  header.magic = SHADER_BINARY_MAGIC;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &header.length);
+  if (header.length <= 0) return;
+  void * binary = malloc(header.length);
+  glGetProgramBinary(program, header.length, NULL, &header.format, binary);
+# ifdef __Windows__
+  _mkdir(cacheDirectory);
+# else
+  mkdir(cacheDirectory, 0755);
+# endif
+  fileOut = fopen(fileName, "wb");
+  if (fileOut == NULL) printf("shader cache:  can't create %s\n", fileName);
+  else {
+    if (fwrite(&header, sizeof(header), 1, fileOut) != 1 || fwrite(binary, header.length, 1, fileOut) != 1)
+      printf("shader cache:  can't write %s\n", fileName);
+    fclose(fileOut);
+    }
+  free(binary);
+  }
+
+/* Create the n variants' programs, from cacheDirectory where they were saved before
+or else compiled and then saved there.  Exits on compile or link errors like loadShaders(...).
+*/
+void loadShaderVariants(ShaderVariant * variant, int n, const char * cacheDirectory) {
+  bool binaries = cacheDirectory != NULL && programBinariesSupported();
+  GLuint * vShader = (GLuint *) calloc(n, sizeof(GLuint));
+  GLuint * fShader = (GLuint *) calloc(n, sizeof(GLuint));
+  char (* fileName)[256] = (char (*)[256]) calloc(n, 256);
+  char msg[256];
+  unsigned long long driver = 0xcbf29ce484222325ULL;
+  GLint status = 0;
+  int nCached = 0;
+
+  // let the driver compile on as many threads as it likes
+  if (GLEW_KHR_parallel_shader_compile) glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+  else if (GLEW_ARB_parallel_shader_compile) glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+  driver = hashShaderString(driver, (const char *) glGetString(GL_VENDOR));
+  driver = hashShaderString(driver, (const char *) glGetString(GL_RENDERER));
+  driver = hashShaderString(driver, (const char *) glGetString(GL_VERSION));
+
+  // load the cached binaries and issue every other compile and link without waiting for them
+  for (int i = 0; i < n; i++) {
+    GLchar * vSource = readShaderSource(variant[i].vertexFile);
+    GLchar * fSource = readShaderSource(variant[i].fragmentFile);
+    unsigned long long key = hashShaderString(driver, variant[i].defines);
+    key = hashShaderString(key, vSource);
+    key = hashShaderString(key, fSource);
+    if (binaries) snprintf(fileName[i], 256, "%s/%016llx.bin", cacheDirectory, key);
+    variant[i].program = glCreateProgram();
+    variant[i].cached = binaries && loadProgramBinary(variant[i].program, fileName[i]);
+    if (variant[i].cached) nCached++;
+    else {
+      vShader[i] = compileShaderVariant(GL_VERTEX_SHADER, vSource, variant[i].defines);
+      fShader[i] = compileShaderVariant(GL_FRAGMENT_SHADER, fSource, variant[i].defines);
+      glAttachShader(variant[i].program, vShader[i]);
+      glAttachShader(variant[i].program, fShader[i]);
+      if (binaries) glProgramParameteri(variant[i].program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+      glLinkProgram(variant[i].program);
+      }
+    free(vSource);
+    free(fSource);
+    }
+
+  // then wait for each compiled variant in turn and save it
+  for (int i = 0; i < n; i++) {
+    if (variant[i].cached) continue;
+    glGetShaderiv(vShader[i], GL_COMPILE_STATUS, &status);
+    snprintf(msg, sizeof(msg), "%s compile", variant[i].vertexFile);
+    checkShaderStatus(vShader[i], status, msg);
+    glGetShaderiv(fShader[i], GL_COMPILE_STATUS, &status);
+    snprintf(msg, sizeof(msg), "%s compile", variant[i].fragmentFile);
+    checkShaderStatus(fShader[i], status, msg);
+    glGetProgramiv(variant[i].program, GL_LINK_STATUS, &status);
+    snprintf(msg, sizeof(msg), "%s + %s link", variant[i].vertexFile, variant[i].fragmentFile);
+    checkProgramStatus(variant[i].program, status, msg);
+    glDetachShader(variant[i].program, vShader[i]);
+    glDetachShader(variant[i].program, fShader[i]);
+    glDeleteShader(vShader[i]);
+    glDeleteShader(fShader[i]);
+    if (binaries) saveProgramBinary(variant[i].program, cacheDirectory, fileName[i]);
+    }
+  printf("shader variants:  %d of %d loaded from %s\n", nCached, n, binaries ? cacheDirectory : "no cache");
+  free(vShader);
+  free(fShader);
+  free(fileName);
+  }
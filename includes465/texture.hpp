@@ -5,6 +5,10 @@ file: texture.hpp
 
 The freeTexture(...) method deletes texture resource
 
+The loadRawCubeMap(...) method loads 6 square *.raw faces (24bpp) into a
+cube map texture with a full mipmap chain and trilinear filtering, for a
+skybox sampled by direction.
+
 The loadRawTexture(...) method expects 3 bytes per pixel (24bpp).
 The program loads the texture top-left (1,0) to bottom-right(1,0).
 Your image may appear upside down depending on how you saved the *.raw
@@ -54,3 +58,44 @@ GLuint loadRawTexture( GLuint texture, const char * filename, int width, int hei
   free( data ); //free the texture
   return texture; //return whether it was successfull
 }
+
+// faces are in GL_TEXTURE_CUBE_MAP_POSITIVE_X + i order:  +x, -x, +y, -y, +z, -z
+// each face is size x size texels, returns the texture or 0 if a face can't be read
+GLuint loadRawCubeMap( const char * filename[6], int size) {
+  GLuint texture;
+  unsigned char * data;
+  FILE * file;
+  int readResult;
+
+  data = (unsigned char *) malloc( size * size * 3 );
+  glGenTextures( 1, &texture );
+  glBindTexture( GL_TEXTURE_CUBE_MAP, texture );
+  glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );  // rows of 3 byte texels aren't 4 byte aligned
+  for (int i = 0; i < 6; i++) {
+    file = fopen( filename[i], "rb" );
+    if ( file == NULL ) {
+      printf("File %s can't be opened\n", filename[i]);
+      free( data );
+      glDeleteTextures( 1, &texture );
+      return 0; }
+    readResult = fread( data, size * size * 3, 1, file );
+    fclose( file );
+    if (readResult != 1) {
+      printf("File %s was not read correctly\n", filename[i]);
+      free( data );
+      glDeleteTextures( 1, &texture );
+      return 0; }
+    glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB8, size, size, 0,
+      GL_RGB, GL_UNSIGNED_BYTE, data);
+    }
+  free( data );
+  glPixelStorei( GL_UNPACK_ALIGNMENT, 4 );
+  glTexParameteri( GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR );
+  glTexParameteri( GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+  glTexParameteri( GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+  glTexParameteri( GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+  glTexParameteri( GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE );
+  glGenerateMipmap( GL_TEXTURE_CUBE_MAP );
+  glEnable( GL_TEXTURE_CUBE_MAP_SEAMLESS );  // filter across face edges, core since GL 3.2
+  return texture;
+}
@@ -0,0 +1,216 @@
+/*
+triArchive465.hpp
+
+Binary model archive for *.tri models:  openTriArchive(...),
+findTriArchiveModel(...) and closeTriArchive(...)
+
+The archive is written offline by tri2bin (Source/tri2bin.cpp) from the
+same AC3D *.tri files loadTriModel(...) reads, already welded and vertex
+cache ordered by indexTriModel(...), with its levels of detail built by
+buildTriLodChain(...), and packed by packTriModel(...).  Every model is
+stored in the exact layout of its vbo followed by its ibo:
+
+  TriVertexFloat or TriVertexQuantized vertex[nVertices]
+  unsigned int index[nLodIndices]   every level's indices, full detail first
+
+so AssetLoader (Source/AssetLoader.hpp) can mmap the archive and copy each
+model's bytes straight into its buffers without parsing or an intermediate
+calloc.
+
+Archive layout (little endian, every model's data 16 byte aligned):
+
+  TriArchiveHeader     magic "TRI465A", version, number of models
+  TriArchiveEntry[n]   file name, size and modification time of the file,
+                       vertex and index counts, bounding radius,
+                       ACMR, vertex format and position scale, level of
+                       detail ranges, data offset
+  model data ...
+
+Bump TRI_ARCHIVE_VERSION whenever the layout changes;  openTriArchive(...)
+rejects archives with another version so stale archives are rebuilt instead
+of misread.  findTriArchiveModel(...) rejects an entry whose *.tri file no
+longer has the size and modification time it was packed from, so an edited
+model is parsed again instead of loaded from the old archive.
+
+Functions print error messages and return false or NULL on error so the
+caller can fall back to parsing the *.tri file.
+*/
+
+# ifdef __Windows__
+// Windows.h is included by include465.hpp
+# else
+# include <sys/mman.h>
+# include <fcntl.h>
+# include <unistd.h>
+# endif
+# include <string.h>
+# include <sys/types.h>
+# include <sys/stat.h>
+
+# define TRI_ARCHIVE_MAGIC "TRI465A"
+# define TRI_ARCHIVE_VERSION 4
+# define TRI_ARCHIVE_NAME_SIZE 32
+# define TRI_ARCHIVE_ALIGN 16
+
+struct TriArchiveHeader {
+  char magic[8];           // TRI_ARCHIVE_MAGIC, null terminated
+  unsigned int version;    // TRI_ARCHIVE_VERSION
+  unsigned int nModels;    // number of TriArchiveEntry records after the header
+  };
+
+struct TriArchiveEntry {
+  char name[TRI_ARCHIVE_NAME_SIZE];  // *.tri file name the model was built from
+  unsigned long long sourceSize;     // bytes of the *.tri file when it was packed
+  long long sourceTime;              // its modification time then, seconds since the epoch
+  unsigned int nVertices;            // unique vertices after welding
+  unsigned int nIndices;             // 3 * number of triangles at full detail
+  float boundingRadius;              // as returned by loadTriModel(...)
+  float acmrWelded;                  // vertex cache miss ratio in file order
+  float acmrOptimized;               // vertex cache miss ratio after reordering
+  unsigned int vertexFormat;         // TRI_VERTEX_FLOAT or TRI_VERTEX_QUANTIZED
+  float positionScale;               // as returned by packTriModel(...)
+  TriLodChain lod;                   // index range of each level, lod.start[0] = 0
+  unsigned long long offset;         // byte offset of vertex[0] from start of archive
+  unsigned long long size;           // bytes of vertex and index data
+  };
+
+struct TriArchive {
+  const unsigned char * base;      // start of the mapped archive, NULL if not open
+  unsigned long long size;         // bytes mapped
+  const TriArchiveHeader * header;
+  const TriArchiveEntry * entry;   // header->nModels entries
+# ifdef __Windows__
+  HANDLE file, mapping;
+# endif
+  };
+
+// bytes of vertex data for nVertices packed in vertexFormat
+unsigned long long triArchiveVertexSize(int vertexFormat, unsigned int nVertices) {
+  return (unsigned long long) nVertices * triVertexStride(vertexFormat);
+  }
+
+// bytes of model data, vertex data followed by nIndices indices of all levels
+unsigned long long triArchiveModelSize(int vertexFormat, unsigned int nVertices, unsigned int nIndices) {
+  return triArchiveVertexSize(vertexFormat, nVertices) + (unsigned long long) nIndices * sizeof(unsigned int);
+  }
+
+// round offset up to the archive's model data alignment
+unsigned long long triArchiveAlign(unsigned long long offset) {
+  return (offset + TRI_ARCHIVE_ALIGN - 1) & ~((unsigned long long) TRI_ARCHIVE_ALIGN - 1);
+  }
+
+// size and modification time of modelFile, returns false if it can't be read
+bool triArchiveSourceStat(const char * modelFile, unsigned long long * size, long long * time) {
+  struct stat fileStat;
+  if (stat(modelFile, &fileStat) != 0) return false;
+  *size = (unsigned long long) fileStat.st_size;
+  *time = (long long) fileStat.st_mtime;
+  return true;
+  }
+
+void closeTriArchive(TriArchive * archive) {
+  if (archive->base == NULL) return;
+# ifdef __Windows__
+  UnmapViewOfFile(archive->base);
+  CloseHandle(archive->mapping);
+  CloseHandle(archive->file);
+# else
+  munmap((void *) archive->base, archive->size);
+# endif
+  archive->base = NULL;
+  archive->header = NULL;
+  archive->entry = NULL;
+  archive->size = 0;
+  }
+
+// map fileName read only and validate its header and directory
+// returns false (and leaves archive closed) if the archive is missing or stale
+bool openTriArchive(const char * fileName, TriArchive * archive) {
+  archive->base = NULL;
+  archive->size = 0;
+  archive->header = NULL;
+  archive->entry = NULL;
+# ifdef __Windows__
+  LARGE_INTEGER fileSize;
+  archive->file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, NULL,
+    OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (archive->file == INVALID_HANDLE_VALUE) {
+    printf("openTriArchive:  can't open %s\n", fileName);
+    return false; }
+  GetFileSizeEx(archive->file, &fileSize);
+  archive->mapping = CreateFileMappingA(archive->file, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (archive->mapping == NULL) {
+    printf("openTriArchive error:  can't map %s\n", fileName);
+    CloseHandle(archive->file);
+    return false; }
+  archive->base = (const unsigned char *) MapViewOfFile(archive->mapping, FILE_MAP_READ, 0, 0, 0);
+  if (archive->base == NULL) {
+    printf("openTriArchive error:  can't map %s\n", fileName);
+    CloseHandle(archive->mapping);
+    CloseHandle(archive->file);
+    return false; }
+  archive->size = fileSize.QuadPart;
+# else
+  struct stat fileStat;
+  int fd = open(fileName, O_RDONLY);
+  if (fd < 0) {
+    printf("openTriArchive:  can't open %s\n", fileName);
+    return false; }
+  if (fstat(fd, &fileStat) != 0 || fileStat.st_size < (off_t) sizeof(TriArchiveHeader)) {
+    printf("openTriArchive error:  %s is too small to be an archive\n", fileName);
+    close(fd);
+    return false; }
+  void * mapping = mmap(NULL, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);  // the mapping keeps its own reference to the file
+  if (mapping == MAP_FAILED) {
+    printf("openTriArchive error:  can't map %s\n", fileName);
+    return false; }
+  archive->base = (const unsigned char *) mapping;
+  archive->size = fileStat.st_size;
+# endif
+  archive->header = (const TriArchiveHeader *) archive->base;
+  archive->entry = (const TriArchiveEntry *) (archive->base + sizeof(TriArchiveHeader));
+  if (strncmp(archive->header->magic, TRI_ARCHIVE_MAGIC, sizeof(archive->header->magic)) != 0) {
+    printf("openTriArchive error:  %s is not a model archive\n", fileName);
+    closeTriArchive(archive);
+    return false; }
+  if (archive->header->version != TRI_ARCHIVE_VERSION) {
+    printf("openTriArchive error:  %s is version %d, expected %d, rebuild it with tri2bin\n",
+      fileName, archive->header->version, TRI_ARCHIVE_VERSION);
+    closeTriArchive(archive);
+    return false; }
+  if (sizeof(TriArchiveHeader) + archive->header->nModels * sizeof(TriArchiveEntry) > archive->size) {
+    printf("openTriArchive error:  %s directory is truncated\n", fileName);
+    closeTriArchive(archive);
+    return false; }
+  for (unsigned int i = 0; i < archive->header->nModels; i++) {
+    const TriArchiveEntry * entry = &archive->entry[i];
+    if ((entry->vertexFormat != TRI_VERTEX_FLOAT && entry->vertexFormat != TRI_VERTEX_QUANTIZED) ||
+      entry->lod.nLods < 1 || entry->lod.nLods > TRI_MAX_LODS || entry->lod.count[0] != entry->nIndices ||
+      entry->size != triArchiveModelSize(entry->vertexFormat, entry->nVertices, triLodChainIndices(&entry->lod)) ||
+      entry->offset % TRI_ARCHIVE_ALIGN != 0 || entry->offset + entry->size > archive->size) {
+      printf("openTriArchive error:  %s model %d (%.*s) is corrupt\n", fileName, i,
+        TRI_ARCHIVE_NAME_SIZE, entry->name);
+      closeTriArchive(archive);
+      return false; }
+    }
+  printf("opened model archive %s with %d models\n", fileName, archive->header->nModels);
+  return true;
+  }
+
+// returns the archive entry built from modelFile, NULL if the archive doesn't have it
+// or modelFile changed since it was packed;  a missing modelFile keeps its entry
+const TriArchiveEntry * findTriArchiveModel(const TriArchive * archive, const char * modelFile) {
+  unsigned long long size;
+  long long time;
+  if (archive->base == NULL) return NULL;
+  for (unsigned int i = 0; i < archive->header->nModels; i++)
+    if (strncmp(archive->entry[i].name, modelFile, TRI_ARCHIVE_NAME_SIZE) == 0) {
+      if (triArchiveSourceStat(modelFile, &size, &time) &&
+        (size != archive->entry[i].sourceSize || time != archive->entry[i].sourceTime)) {
+        printf("findTriArchiveModel:  %s changed since the archive was built, parsing it\n", modelFile);
+        return NULL; }
+      return &archive->entry[i];
+      }
+  return NULL;
+  }
@@ -0,0 +1,379 @@
+/*
+triBvh465.hpp
+
+Bounds and a bounding volume hierarchy over a model's triangles for exact
+collision tests:  buildTriBvh(...), triBvhSphereHit(...) and
+triBvhSegmentHit(...)
+
+buildTriBvh(...) records the model's axis aligned bounding box and exact
+bounding sphere about the model's origin (the point objects are placed and
+collided by), then builds a binned surface area heuristic (SAH) hierarchy.
+Every leaf holds TriBvhPacks of up to 4 triangles stored structure of
+arrays, so a leaf is tested against 4 triangles at once with SSE.
+Unused lanes of a pack repeat the leaf's first triangle.  A leaf has one
+pack, except at depth TRI_BVH_STACK - 1 where the hierarchy stops and the
+leaf keeps every triangle left, so traversal never outgrows its stack.
+
+Nodes are stored depth first:  an interior node's left child follows it,
+its right child is node[offset].  A leaf's triangles are pack[offset].
+
+Tests are in model coordinates;  transform a sphere's center or a segment
+by the inverse of the model matrix and divide a radius by the model's scale.
+*/
+
+# include <math.h>
+# include <float.h>
+# include <vector>
+# include <algorithm>
+# ifdef __SSE2__
+# include <emmintrin.h>
+# endif
+
+# define TRI_BVH_BINS 12
+# define TRI_BVH_PACK 4
+# define TRI_BVH_STACK 64
+# define TRI_BVH_TRAVERSAL_COST 1.0f
+
+struct TriBvhNode {
+  float min[3];
+  unsigned int offset;   // right child of an interior node, first pack of a leaf
+  float max[3];
+  unsigned int count;    // triangles in a leaf, 0 for an interior node
+  };
+
+// 4 triangles:  vertex a, edges ab and ac and unnormalized normal ab x ac
+struct TriBvhPack {
+  float ax[TRI_BVH_PACK], ay[TRI_BVH_PACK], az[TRI_BVH_PACK];
+  float abx[TRI_BVH_PACK], aby[TRI_BVH_PACK], abz[TRI_BVH_PACK];
+  float acx[TRI_BVH_PACK], acy[TRI_BVH_PACK], acz[TRI_BVH_PACK];
+  float nx[TRI_BVH_PACK], ny[TRI_BVH_PACK], nz[TRI_BVH_PACK];
+  };
+
+struct TriBvh {
+  std::vector<TriBvhNode> node;
+  std::vector<TriBvhPack> pack;
+  glm::vec3 aabbMin, aabbMax;  // model's axis aligned bounding box
+  float radius;                // exact bounding sphere radius about the model's origin
+  };
+
+// triangle bounds and centroid used while building
+struct TriBvhTriangle {
+  glm::vec3 min, max, centroid;
+  unsigned int index;  // first of the triangle's 3 indices
+  };
+
+float triBvhArea(const glm::vec3 & min, const glm::vec3 & max) {
+  glm::vec3 size = max - min;
+  if (size.x < 0.0f) return 0.0f;
+  return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+  }
+
+// SIMD leaf cost:  a pack tests 4 triangles for the price of 1
+float triBvhPackCost(int count) {
+  return (float) ((count + TRI_BVH_PACK - 1) / TRI_BVH_PACK);
+  }
+
+// builds node n at depth over triangle[first ... first + count - 1], returns nothing, appends children
+void buildTriBvhNode(TriBvh * bvh, std::vector<TriBvhTriangle> & triangle, int n, int depth, int first, int count,
+  const glm::vec4 vertex[], const unsigned int index[])
+  {
+  glm::vec3 min(FLT_MAX), max(-FLT_MAX), centroidMin(FLT_MAX), centroidMax(-FLT_MAX);
+  for (int i = first; i < first + count; i++) {
+    min = glm::min(min, triangle[i].min);
+    max = glm::max(max, triangle[i].max);
+    centroidMin = glm::min(centroidMin, triangle[i].centroid);
+    centroidMax = glm::max(centroidMax, triangle[i].centroid); }
+  for (int k = 0; k < 3; k++) {
+    bvh->node[n].min[k] = min[k];
+    bvh->node[n].max[k] = max[k]; }
+
+  // binned SAH split along the widest centroid axis
+  int axis = 0;
+  glm::vec3 extent = centroidMax - centroidMin;
+  if (extent.y > extent[axis]) axis = 1;
+  if (extent.z > extent[axis]) axis = 2;
+  int bestSplit = -1;
+  float bestCost = FLT_MAX;
+  if (extent[axis] > 0.0f) {
+    glm::vec3 binMin[TRI_BVH_BINS], binMax[TRI_BVH_BINS];
+    int binCount[TRI_BVH_BINS] = { 0 };
+    float binScale = TRI_BVH_BINS / extent[axis] * 0.9999f;
+    for (int b = 0; b < TRI_BVH_BINS; b++) {
+      binMin[b] = glm::vec3(FLT_MAX);
+      binMax[b] = glm::vec3(-FLT_MAX); }
+    for (int i = first; i < first + count; i++) {
+      int b = (int) ((triangle[i].centroid[axis] - centroidMin[axis]) * binScale);
+      binCount[b]++;
+      binMin[b] = glm::min(binMin[b], triangle[i].min);
+      binMax[b] = glm::max(binMax[b], triangle[i].max); }
+    // sweep from the right for the right side's areas, then from the left for the cost
+    float rightArea[TRI_BVH_BINS];
+    int rightCount[TRI_BVH_BINS];
+    glm::vec3 sweepMin(FLT_MAX), sweepMax(-FLT_MAX);
+    int sweepCount = 0;
+    for (int b = TRI_BVH_BINS - 1; b > 0; b--) {
+      sweepMin = glm::min(sweepMin, binMin[b]);
+      sweepMax = glm::max(sweepMax, binMax[b]);
+      sweepCount += binCount[b];
+      rightArea[b] = triBvhArea(sweepMin, sweepMax);
+      rightCount[b] = sweepCount; }
+    sweepMin = glm::vec3(FLT_MAX);
+    sweepMax = glm::vec3(-FLT_MAX);
+    sweepCount = 0;
+    for (int b = 0; b < TRI_BVH_BINS - 1; b++) {
+      sweepMin = glm::min(sweepMin, binMin[b]);
+      sweepMax = glm::max(sweepMax, binMax[b]);
+      sweepCount += binCount[b];
+      if (sweepCount == 0 || rightCount[b + 1] == 0) continue;
+      float cost = triBvhArea(sweepMin, sweepMax) * triBvhPackCost(sweepCount)
+        + rightArea[b + 1] * triBvhPackCost(rightCount[b + 1]);
+      if (cost < bestCost) {
+        bestCost = cost;
+        bestSplit = b; }
+      }
+    float area = triBvhArea(min, max);
+    bestCost = TRI_BVH_TRAVERSAL_COST + (area > 0.0f ? bestCost / area : 0.0f);
+    }
+
+  // a leaf if it fits one pack and splitting doesn't pay, or at the deepest level the stack allows
+  if ((count <= TRI_BVH_PACK && (bestSplit < 0 || triBvhPackCost(count) <= bestCost)) ||
+    depth >= TRI_BVH_STACK - 1) {
+    bvh->node[n].offset = (unsigned int) bvh->pack.size();
+    bvh->node[n].count = count;
+    for (int base = 0; base < count; base += TRI_BVH_PACK) {
+      TriBvhPack pack;
+      for (int lane = 0; lane < TRI_BVH_PACK; lane++) {
+        const unsigned int * corner = &index[triangle[first + (base + lane < count ? base + lane : 0)].index];
+        glm::vec3 a(vertex[corner[0]]), b(vertex[corner[1]]), c(vertex[corner[2]]);
+        glm::vec3 ab = b - a, ac = c - a, normal = glm::cross(ab, ac);
+        pack.ax[lane] = a.x;  pack.ay[lane] = a.y;  pack.az[lane] = a.z;
+        pack.abx[lane] = ab.x;  pack.aby[lane] = ab.y;  pack.abz[lane] = ab.z;
+        pack.acx[lane] = ac.x;  pack.acy[lane] = ac.y;  pack.acz[lane] = ac.z;
+        pack.nx[lane] = normal.x;  pack.ny[lane] = normal.y;  pack.nz[lane] = normal.z; }
+      bvh->pack.push_back(pack); }
+    return; }
+
+  // partition, falling back to a median split when the SAH found none
+  int middle;
+  if (bestSplit >= 0) {
+    float binScale = TRI_BVH_BINS / extent[axis] * 0.9999f;
+    TriBvhTriangle * begin = &triangle[first], * end = begin + count;
+    TriBvhTriangle * split = std::partition(begin, end, [&](const TriBvhTriangle & t) {
+      return (int) ((t.centroid[axis] - centroidMin[axis]) * binScale) <= bestSplit; });
+    middle = first + (int) (split - begin); }
+  else {
+    middle = first + count / 2;
+    std::nth_element(&triangle[first], &triangle[middle], &triangle[first] + count,
+      [&](const TriBvhTriangle & s, const TriBvhTriangle & t) { return s.centroid[axis] < t.centroid[axis]; }); }
+
+  int left = (int) bvh->node.size();
+  bvh->node.resize(left + 1);
+  buildTriBvhNode(bvh, triangle, left, depth + 1, first, middle - first, vertex, index);
+  int right = (int) bvh->node.size();
+  bvh->node.resize(right + 1);
+  buildTriBvhNode(bvh, triangle, right, depth + 1, middle, first + count - middle, vertex, index);
+  bvh->node[n].offset = right;
+  bvh->node[n].count = 0;
+  }
+
+// builds bvh over the triangles of index[nIndices] into vertex[nVertices]
+void buildTriBvh(TriBvh * bvh, const glm::vec4 vertex[], int nVertices, const unsigned int index[], int nIndices) {
+  bvh->node.clear();
+  bvh->pack.clear();
+  bvh->aabbMin = glm::vec3(FLT_MAX);
+  bvh->aabbMax = glm::vec3(-FLT_MAX);
+  bvh->radius = 0.0f;
+  for (int v = 0; v < nVertices; v++) {
+    glm::vec3 p(vertex[v]);
+    bvh->aabbMin = glm::min(bvh->aabbMin, p);
+    bvh->aabbMax = glm::max(bvh->aabbMax, p);
+    if (bvh->radius < glm::length(p)) bvh->radius = glm::length(p); }
+  if (nIndices < 3) return;
+
+  std::vector<TriBvhTriangle> triangle(nIndices / 3);
+  for (int t = 0; t < nIndices / 3; t++) {
+    glm::vec3 a(vertex[index[3 * t]]), b(vertex[index[3 * t + 1]]), c(vertex[index[3 * t + 2]]);
+    triangle[t].min = glm::min(a, glm::min(b, c));
+    triangle[t].max = glm::max(a, glm::max(b, c));
+    triangle[t].centroid = (a + b + c) / 3.0f;
+    triangle[t].index = 3 * t; }
+  bvh->node.reserve(2 * triangle.size() / TRI_BVH_PACK + 1);
+  bvh->node.resize(1);
+  buildTriBvhNode(bvh, triangle, 0, 0, 0, (int) triangle.size(), vertex, index);
+  }
+
+// squared distance from center to node's box, 0 inside
+float triBvhNodeDistance2(const TriBvhNode & node, const glm::vec3 & center) {
+  float distance2 = 0.0f;
+  for (int k = 0; k < 3; k++) {
+    float d = std::max(std::max(node.min[k] - center[k], center[k] - node.max[k]), 0.0f);
+    distance2 += d * d; }
+  return distance2;
+  }
+
+// true if the segment origin + t * direction, t in [0, 1], crosses node's box
+bool triBvhNodeSegment(const TriBvhNode & node, const glm::vec3 & origin, const glm::vec3 & inverseDirection) {
+  float tMin = 0.0f, tMax = 1.0f;
+  for (int k = 0; k < 3; k++) {
+    float t0 = (node.min[k] - origin[k]) * inverseDirection[k];
+    float t1 = (node.max[k] - origin[k]) * inverseDirection[k];
+    if (t0 > t1) std::swap(t0, t1);
+    // NaN from 0 * infinity (segment in the slab's plane) leaves the range unchanged
+    if (t0 > tMin) tMin = t0;
+    if (t1 < tMax) tMax = t1;
+    if (tMin > tMax) return false; }
+  return true;
+  }
+
+// true if any triangle of pack is within sqrt(radius2) of center
+bool triPackSphereHit(const TriBvhPack & pack, const glm::vec3 & center, float radius2) {
+# ifdef __SSE2__
+  __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f), tiny = _mm_set1_ps(FLT_MIN);
+  __m128 abx = _mm_loadu_ps(pack.abx), aby = _mm_loadu_ps(pack.aby), abz = _mm_loadu_ps(pack.abz);
+  __m128 acx = _mm_loadu_ps(pack.acx), acy = _mm_loadu_ps(pack.acy), acz = _mm_loadu_ps(pack.acz);
+  __m128 nx = _mm_loadu_ps(pack.nx), ny = _mm_loadu_ps(pack.ny), nz = _mm_loadu_ps(pack.nz);
+  // ap = center - a
+  __m128 apx = _mm_sub_ps(_mm_set1_ps(center.x), _mm_loadu_ps(pack.ax));
+  __m128 apy = _mm_sub_ps(_mm_set1_ps(center.y), _mm_loadu_ps(pack.ay));
+  __m128 apz = _mm_sub_ps(_mm_set1_ps(center.z), _mm_loadu_ps(pack.az));
+# define TRI_DOT(ux, uy, uz, vx, vy, vz) \
+  _mm_add_ps(_mm_add_ps(_mm_mul_ps(ux, vx), _mm_mul_ps(uy, vy)), _mm_mul_ps(uz, vz))
+  // dot(cross(u, v), n)
+# define TRI_TRIPLE(ux, uy, uz, vx, vy, vz) \
+  TRI_DOT(_mm_sub_ps(_mm_mul_ps(uy, vz), _mm_mul_ps(uz, vy)), \
+    _mm_sub_ps(_mm_mul_ps(uz, vx), _mm_mul_ps(ux, vz)), \
+    _mm_sub_ps(_mm_mul_ps(ux, vy), _mm_mul_ps(uy, vx)), nx, ny, nz)
+  // squared distance from p to the segment starting at the edge's origin along e
+# define TRI_EDGE_DISTANCE2(px, py, pz, ex, ey, ez, result) { \
+  __m128 t = _mm_div_ps(TRI_DOT(px, py, pz, ex, ey, ez), _mm_max_ps(TRI_DOT(ex, ey, ez, ex, ey, ez), tiny)); \
+  t = _mm_min_ps(_mm_max_ps(t, zero), one); \
+  __m128 dx = _mm_sub_ps(px, _mm_mul_ps(t, ex)), dy = _mm_sub_ps(py, _mm_mul_ps(t, ey)), dz = _mm_sub_ps(pz, _mm_mul_ps(t, ez)); \
+  result = TRI_DOT(dx, dy, dz, dx, dy, dz); }
+
+  __m128 bcx = _mm_sub_ps(acx, abx), bcy = _mm_sub_ps(acy, aby), bcz = _mm_sub_ps(acz, abz);
+  __m128 bpx = _mm_sub_ps(apx, abx), bpy = _mm_sub_ps(apy, aby), bpz = _mm_sub_ps(apz, abz);
+  __m128 cax = _mm_sub_ps(zero, acx), cay = _mm_sub_ps(zero, acy), caz = _mm_sub_ps(zero, acz);
+  __m128 cpx = _mm_sub_ps(apx, acx), cpy = _mm_sub_ps(apy, acy), cpz = _mm_sub_ps(apz, acz);
+  __m128 nn = TRI_DOT(nx, ny, nz, nx, ny, nz);
+
+  // center projects inside the triangle:  its plane distance, otherwise the nearest edge
+  __m128 inside = _mm_and_ps(_mm_cmpgt_ps(nn, zero), _mm_and_ps(
+    _mm_cmpge_ps(TRI_TRIPLE(abx, aby, abz, apx, apy, apz), zero),
+    _mm_and_ps(_mm_cmpge_ps(TRI_TRIPLE(bcx, bcy, bcz, bpx, bpy, bpz), zero),
+      _mm_cmpge_ps(TRI_TRIPLE(cax, cay, caz, cpx, cpy, cpz), zero))));
+  __m128 planeDistance = TRI_DOT(apx, apy, apz, nx, ny, nz);
+  __m128 plane2 = _mm_div_ps(_mm_mul_ps(planeDistance, planeDistance), _mm_max_ps(nn, tiny));
+  __m128 edgeAB, edgeBC, edgeCA;
+  TRI_EDGE_DISTANCE2(apx, apy, apz, abx, aby, abz, edgeAB);
+  TRI_EDGE_DISTANCE2(bpx, bpy, bpz, bcx, bcy, bcz, edgeBC);
+  TRI_EDGE_DISTANCE2(cpx, cpy, cpz, cax, cay, caz, edgeCA);
+  __m128 edge2 = _mm_min_ps(edgeAB, _mm_min_ps(edgeBC, edgeCA));
+  __m128 distance2 = _mm_or_ps(_mm_and_ps(inside, plane2), _mm_andnot_ps(inside, edge2));
+# undef TRI_DOT
+# undef TRI_TRIPLE
+# undef TRI_EDGE_DISTANCE2
+  return _mm_movemask_ps(_mm_cmple_ps(distance2, _mm_set1_ps(radius2))) != 0;
+# else
+  for (int lane = 0; lane < TRI_BVH_PACK; lane++) {
+    glm::vec3 ab(pack.abx[lane], pack.aby[lane], pack.abz[lane]), ac(pack.acx[lane], pack.acy[lane], pack.acz[lane]);
+    glm::vec3 n(pack.nx[lane], pack.ny[lane], pack.nz[lane]);
+    glm::vec3 ap = center - glm::vec3(pack.ax[lane], pack.ay[lane], pack.az[lane]);
+    glm::vec3 bc = ac - ab, bp = ap - ab, ca = -ac, cp = ap - ac;
+    float nn = glm::dot(n, n), distance2;
+    if (nn > 0.0f && glm::dot(glm::cross(ab, ap), n) >= 0.0f && glm::dot(glm::cross(bc, bp), n) >= 0.0f &&
+      glm::dot(glm::cross(ca, cp), n) >= 0.0f)
+      distance2 = glm::dot(ap, n) * glm::dot(ap, n) / nn;
+    else {
+      glm::vec3 p[3] = { ap, bp, cp }, e[3] = { ab, bc, ca };
+      distance2 = FLT_MAX;
+      for (int k = 0; k < 3; k++) {
+        float t = glm::clamp(glm::dot(p[k], e[k]) / std::max(glm::dot(e[k], e[k]), FLT_MIN), 0.0f, 1.0f);
+        glm::vec3 d = p[k] - t * e[k];
+        distance2 = std::min(distance2, glm::dot(d, d)); }
+      }
+    if (distance2 <= radius2) return true; }
+  return false;
+# endif
+  }
+
+// true if any triangle of pack is crossed by origin + t * direction, t in [0, 1] (Moller Trumbore)
+bool triPackSegmentHit(const TriBvhPack & pack, const glm::vec3 & origin, const glm::vec3 & direction) {
+# ifdef __SSE2__
+  __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+  __m128 abx = _mm_loadu_ps(pack.abx), aby = _mm_loadu_ps(pack.aby), abz = _mm_loadu_ps(pack.abz);
+  __m128 acx = _mm_loadu_ps(pack.acx), acy = _mm_loadu_ps(pack.acy), acz = _mm_loadu_ps(pack.acz);
+  __m128 dx = _mm_set1_ps(direction.x), dy = _mm_set1_ps(direction.y), dz = _mm_set1_ps(direction.z);
+  __m128 sx = _mm_sub_ps(_mm_set1_ps(origin.x), _mm_loadu_ps(pack.ax));
+  __m128 sy = _mm_sub_ps(_mm_set1_ps(origin.y), _mm_loadu_ps(pack.ay));
+  __m128 sz = _mm_sub_ps(_mm_set1_ps(origin.z), _mm_loadu_ps(pack.az));
+  // p = direction x ac, q = s x ab
+  __m128 px = _mm_sub_ps(_mm_mul_ps(dy, acz), _mm_mul_ps(dz, acy));
+  __m128 py = _mm_sub_ps(_mm_mul_ps(dz, acx), _mm_mul_ps(dx, acz));
+  __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, acy), _mm_mul_ps(dy, acx));
+  __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, abz), _mm_mul_ps(sz, aby));
+  __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, abx), _mm_mul_ps(sx, abz));
+  __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, aby), _mm_mul_ps(sy, abx));
+  __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(abx, px), _mm_mul_ps(aby, py)), _mm_mul_ps(abz, pz));
+  __m128 valid = _mm_cmpneq_ps(det, zero);
+  __m128 inverseDet = _mm_div_ps(one, _mm_or_ps(_mm_and_ps(valid, det), _mm_andnot_ps(valid, one)));
+  __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), inverseDet);
+  __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), inverseDet);
+  __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(acx, qx), _mm_mul_ps(acy, qy)), _mm_mul_ps(acz, qz)), inverseDet);
+  __m128 hit = _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmpge_ps(v, zero)));
+  hit = _mm_and_ps(hit, _mm_and_ps(_mm_cmple_ps(_mm_add_ps(u, v), one),
+    _mm_and_ps(_mm_cmpge_ps(t, zero), _mm_cmple_ps(t, one))));
+  return _mm_movemask_ps(hit) != 0;
+# else
+  for (int lane = 0; lane < TRI_BVH_PACK; lane++) {
+    glm::vec3 ab(pack.abx[lane], pack.aby[lane], pack.abz[lane]), ac(pack.acx[lane], pack.acy[lane], pack.acz[lane]);
+    glm::vec3 s = origin - glm::vec3(pack.ax[lane], pack.ay[lane], pack.az[lane]);
+    glm::vec3 p = glm::cross(direction, ac), q = glm::cross(s, ab);
+    float det = glm::dot(ab, p);
+    if (det == 0.0f) continue;
+    float u = glm::dot(s, p) / det, v = glm::dot(direction, q) / det, t = glm::dot(ac, q) / det;
+    if (u >= 0.0f && v >= 0.0f && u + v <= 1.0f && t >= 0.0f && t <= 1.0f) return true; }
+  return false;
+# endif
+  }
+
+// every node on the stack is a sibling of one of the current node's ancestors, or its own
+// child, so a hierarchy at most TRI_BVH_STACK - 1 deep never needs more than TRI_BVH_STACK
+
+// true if a sphere in model coordinates touches one of the model's triangles
+bool triBvhSphereHit(const TriBvh * bvh, const glm::vec3 & center, float radius) {
+  int stack[TRI_BVH_STACK], top = 0;
+  float radius2 = radius * radius;
+  if (bvh->node.empty()) return false;
+  stack[top++] = 0;
+  while (top > 0) {
+    const TriBvhNode & node = bvh->node[stack[--top]];
+    if (triBvhNodeDistance2(node, center) > radius2) continue;
+    if (node.count > 0) {
+      for (unsigned int p = 0; p < node.count; p += TRI_BVH_PACK)
+        if (triPackSphereHit(bvh->pack[node.offset + p / TRI_BVH_PACK], center, radius2)) return true; }
+    else {
+      stack[top++] = node.offset;
+      stack[top++] = (int) (&node - &bvh->node[0]) + 1; }
+    }
+  return false;
+  }
+
+// true if the segment from start to end in model coordinates crosses one of the model's triangles
+bool triBvhSegmentHit(const TriBvh * bvh, const glm::vec3 & start, const glm::vec3 & end) {
+  int stack[TRI_BVH_STACK], top = 0;
+  glm::vec3 direction = end - start;
+  glm::vec3 inverseDirection(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+  if (bvh->node.empty()) return false;
+  stack[top++] = 0;
+  while (top > 0) {
+    const TriBvhNode & node = bvh->node[stack[--top]];
+    if (!triBvhNodeSegment(node, start, inverseDirection)) continue;
+    if (node.count > 0) {
+      for (unsigned int p = 0; p < node.count; p += TRI_BVH_PACK)
+        if (triPackSegmentHit(bvh->pack[node.offset + p / TRI_BVH_PACK], start, direction)) return true; }
+    else {
+      stack[top++] = node.offset;
+      stack[top++] = (int) (&node - &bvh->node[0]) + 1; }
+    }
+  return false;
+  }
@@ -0,0 +1,302 @@
+/*
+triLod465.hpp
+
+Level of detail chains for models indexed by indexTriModel(...):
+
+simplifyTriModel(...) reduces an index buffer with quadric error metric
+edge collapses (Garland and Heckbert, "Surface Simplification Using Quadric
+Error Metrics").  Collapses are half edge collapses onto existing vertices,
+so every level indexes the same vertices and all levels share one vbo.
+Collapses work on welded positions:  a corner whose position collapsed
+takes the vertex at the target position with the same color and closest
+normal, so the flat shaded seams of *.tri models don't block simplification.
+
+buildTriLodChain(...) appends up to TRI_MAX_LODS - 1 coarser levels after
+a model's full detail indices, each vertex cache ordered, and records each
+level's index range and geometric error.  Draw level l with
+glDrawElements(GL_TRIANGLES, count[l], GL_UNSIGNED_INT, BUFFER_OFFSET(start[l] * 4)).
+
+selectTriLod(...) picks the coarsest level whose recorded error projects to
+at most TRI_LOD_PIXEL_ERROR pixels at the model's distance, with hysteresis:
+a model goes to a finer level as soon as its level's error grows past
+TRI_LOD_PIXEL_ERROR, but only to a coarser level once that level's error is
+below TRI_LOD_HYSTERESIS * TRI_LOD_PIXEL_ERROR, so levels don't flicker at a
+boundary.
+*/
+
+# include <math.h>
+# include <vector>
+# include <algorithm>
+# include <unordered_map>
+
+# define TRI_MAX_LODS 4
+# define TRI_LOD_MIN_TRIANGLES 16
+# define TRI_LOD_BORDER_WEIGHT 10.0
+# define TRI_LOD_HYSTERESIS 0.8f
+# define TRI_LOD_PIXEL_ERROR 1.0f  // projected error a level may have, in pixels
+
+// fraction of the full detail triangles kept by each level
+const float triLodRatio[TRI_MAX_LODS] = { 1.0f, 0.3f, 0.1f, 0.03f };
+
+struct TriLodChain {
+  unsigned int nLods;
+  unsigned int start[TRI_MAX_LODS];  // first index of each level
+  unsigned int count[TRI_MAX_LODS];  // indices in each level
+  float error[TRI_MAX_LODS];         // approximate distance from full detail, model units
+  };
+
+// total indices of every level in a chain
+unsigned int triLodChainIndices(const TriLodChain * chain) {
+  return chain->start[chain->nLods - 1] + chain->count[chain->nLods - 1];
+  }
+
+// symmetric 4x4 quadric, sum of squared distances to planes, and the planes' total weight
+struct TriQuadric {
+  double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+  double weight;
+  };
+
+void addTriPlaneQuadric(TriQuadric * q, double a, double b, double c, double d, double weight) {
+  q->a2 += weight * a * a;  q->ab += weight * a * b;  q->ac += weight * a * c;  q->ad += weight * a * d;
+  q->b2 += weight * b * b;  q->bc += weight * b * c;  q->bd += weight * b * d;
+  q->c2 += weight * c * c;  q->cd += weight * c * d;
+  q->d2 += weight * d * d;
+  q->weight += weight;
+  }
+
+void addTriQuadric(TriQuadric * q, const TriQuadric & other) {
+  q->a2 += other.a2;  q->ab += other.ab;  q->ac += other.ac;  q->ad += other.ad;
+  q->b2 += other.b2;  q->bc += other.bc;  q->bd += other.bd;
+  q->c2 += other.c2;  q->cd += other.cd;
+  q->d2 += other.d2;
+  q->weight += other.weight;
+  }
+
+double evalTriQuadric(const TriQuadric & q, const glm::vec3 & p) {
+  double x = p.x, y = p.y, z = p.z;
+  double error = q.a2 * x * x + 2 * q.ab * x * y + 2 * q.ac * x * z + 2 * q.ad * x
+    + q.b2 * y * y + 2 * q.bc * y * z + 2 * q.bd * y
+    + q.c2 * z * z + 2 * q.cd * z + q.d2;
+  return error > 0.0 ? error : 0.0;
+  }
+
+// union find root of position p, compressing the path
+int findTriPosition(std::vector<int> & parent, int p) {
+  while (parent[p] != p) {
+    parent[p] = parent[parent[p]];
+    p = parent[p]; }
+  return p;
+  }
+
+struct TriCollapse {
+  double cost;   // quadric error, orders the collapses
+  double error;  // root mean square distance to the quadric's planes
+  int from, to;
+  bool operator<(const TriCollapse & other) const { return cost < other.cost; }
+  };
+
+// simplifies index[nIndices] over vertex[nVertices] towards targetIndices
+// writes the result to out (at most nIndices) and returns its number of indices,
+// *error is the largest collapse's root mean square distance to its planes in model units
+int simplifyTriModel(const unsigned int index[], int nIndices, int nVertices,
+  const glm::vec4 vertex[], const glm::vec4 color[], const glm::vec3 normal[],
+  int targetIndices, unsigned int out[], float * error)
+  {
+  *error = 0.0f;
+
+  // weld positions, vertices of each position in positionVertex[positionStart[p] ...]
+  std::unordered_map<TriWeldKey, int, TriWeldKeyHash> unique;
+  std::vector<int> positionOf(nVertices);
+  std::vector<glm::vec3> position;
+  for (int v = 0; v < nVertices; v++) {
+    TriWeldKey key;
+    memset(&key, 0, sizeof(key));
+    key.x = vertex[v].x;  key.y = vertex[v].y;  key.z = vertex[v].z;
+    std::pair<std::unordered_map<TriWeldKey, int, TriWeldKeyHash>::iterator, bool> found =
+      unique.insert(std::make_pair(key, (int) position.size()));
+    if (found.second) position.push_back(glm::vec3(vertex[v]));
+    positionOf[v] = found.first->second;
+    }
+  int nPositions = (int) position.size();
+  std::vector<int> positionStart(nPositions + 1, 0), positionVertex(nVertices);
+  for (int v = 0; v < nVertices; v++) positionStart[positionOf[v] + 1]++;
+  for (int p = 0; p < nPositions; p++) positionStart[p + 1] += positionStart[p];
+  std::vector<int> fill(positionStart.begin(), positionStart.end() - 1);
+  for (int v = 0; v < nVertices; v++) positionVertex[fill[positionOf[v]]++] = v;
+
+  // plane quadrics of every triangle, border edges get a perpendicular plane so borders stay put
+  std::vector<TriQuadric> quadric(nPositions);
+  std::unordered_map<unsigned long long, int> edgeUse;
+  memset(&quadric[0], 0, nPositions * sizeof(TriQuadric));
+  for (int i = 0; i < nIndices; i += 3)
+    for (int k = 0; k < 3; k++) {
+      unsigned long long a = positionOf[index[i + k]], b = positionOf[index[i + (k + 1) % 3]];
+      edgeUse[a < b ? a << 32 | b : b << 32 | a]++; }
+  for (int i = 0; i < nIndices; i += 3) {
+    int p[3] = { positionOf[index[i]], positionOf[index[i + 1]], positionOf[index[i + 2]] };
+    glm::vec3 faceNormal = glm::cross(position[p[1]] - position[p[0]], position[p[2]] - position[p[0]]);
+    float length = glm::length(faceNormal);
+    if (length == 0.0f) continue;
+    faceNormal /= length;
+    for (int k = 0; k < 3; k++)
+      addTriPlaneQuadric(&quadric[p[k]], faceNormal.x, faceNormal.y, faceNormal.z,
+        -glm::dot(faceNormal, position[p[0]]), 1.0);
+    for (int k = 0; k < 3; k++) {
+      unsigned long long a = p[k], b = p[(k + 1) % 3];
+      if (edgeUse[a < b ? a << 32 | b : b << 32 | a] != 1) continue;
+      glm::vec3 edge = position[b] - position[a];
+      glm::vec3 borderNormal = glm::cross(edge, faceNormal);
+      if (glm::length(borderNormal) == 0.0f) continue;
+      borderNormal = glm::normalize(borderNormal);
+      double d = -glm::dot(borderNormal, position[a]);
+      addTriPlaneQuadric(&quadric[a], borderNormal.x, borderNormal.y, borderNormal.z, d, TRI_LOD_BORDER_WEIGHT);
+      addTriPlaneQuadric(&quadric[b], borderNormal.x, borderNormal.y, borderNormal.z, d, TRI_LOD_BORDER_WEIGHT);
+      }
+    }
+
+  std::vector<unsigned int> triangle(index, index + nIndices);
+  std::vector<int> parent(nPositions);
+  for (int p = 0; p < nPositions; p++) parent[p] = p;
+  double maxError = 0.0;
+
+  // passes of independent collapses, cheapest first, until the target is reached or nothing collapses
+  for (;;) {
+    int nTriangles = (int) triangle.size() / 3;
+    if (nTriangles * 3 <= targetIndices) break;
+
+    // position to triangle adjacency
+    std::vector<int> adjacentStart(nPositions + 1, 0), adjacent(triangle.size());
+    for (size_t i = 0; i < triangle.size(); i++) adjacentStart[findTriPosition(parent, positionOf[triangle[i]]) + 1]++;
+    for (int p = 0; p < nPositions; p++) adjacentStart[p + 1] += adjacentStart[p];
+    std::vector<int> next(adjacentStart.begin(), adjacentStart.end() - 1);
+    for (size_t i = 0; i < triangle.size(); i++) adjacent[next[findTriPosition(parent, positionOf[triangle[i]])]++] = (int) i / 3;
+
+    std::vector<TriCollapse> collapse;
+    collapse.reserve(triangle.size());
+    for (size_t i = 0; i < triangle.size(); i += 3)
+      for (int k = 0; k < 3; k++) {
+        int a = findTriPosition(parent, positionOf[triangle[i + k]]);
+        int b = findTriPosition(parent, positionOf[triangle[i + (k + 1) % 3]]);
+        TriQuadric q = quadric[a];
+        addTriQuadric(&q, quadric[b]);
+        double costAB = evalTriQuadric(q, position[b]), costBA = evalTriQuadric(q, position[a]);
+        double weight = q.weight > 0.0 ? q.weight : 1.0;
+        TriCollapse ab = { costAB, sqrt(costAB / weight), a, b }, ba = { costBA, sqrt(costBA / weight), b, a };
+        collapse.push_back(ab.cost <= ba.cost ? ab : ba);
+        }
+    std::sort(collapse.begin(), collapse.end());
+
+    std::vector<char> locked(nPositions, 0);
+    int removed = 0, collapsed = 0;
+    for (size_t c = 0; c < collapse.size() && (nTriangles - removed) * 3 > targetIndices; c++) {
+      int from = collapse[c].from, to = collapse[c].to;
+      if (locked[from] || locked[to]) continue;
+
+      // reject collapses that flip or fold a triangle
+      bool flips = false;
+      int dropped = 0;
+      for (int j = adjacentStart[from]; j < adjacentStart[from + 1] && !flips; j++) {
+        int t = adjacent[j];
+        int p[3];
+        for (int k = 0; k < 3; k++) p[k] = findTriPosition(parent, positionOf[triangle[3 * t + k]]);
+        if (p[0] == to || p[1] == to || p[2] == to) {
+          dropped++;
+          continue; }
+        glm::vec3 before = glm::cross(position[p[1]] - position[p[0]], position[p[2]] - position[p[0]]);
+        for (int k = 0; k < 3; k++) if (p[k] == from) p[k] = to;
+        glm::vec3 after = glm::cross(position[p[1]] - position[p[0]], position[p[2]] - position[p[0]]);
+        float lengths = glm::length(before) * glm::length(after);
+        if (lengths == 0.0f || glm::dot(before, after) < 0.25f * lengths) flips = true;
+        }
+      if (flips) continue;
+
+      parent[from] = to;
+      addTriQuadric(&quadric[to], quadric[from]);
+      if (collapse[c].error > maxError) maxError = collapse[c].error;
+      // triangles around from changed, lock them for the rest of the pass
+      for (int j = adjacentStart[from]; j < adjacentStart[from + 1]; j++)
+        for (int k = 0; k < 3; k++) locked[findTriPosition(parent, positionOf[triangle[3 * adjacent[j] + k]])] = 1;
+      locked[from] = locked[to] = 1;
+      removed += dropped;
+      collapsed++;
+      }
+    if (collapsed == 0) break;
+
+    // drop the triangles that collapsed to a line
+    size_t kept = 0;
+    for (size_t i = 0; i < triangle.size(); i += 3) {
+      int p0 = findTriPosition(parent, positionOf[triangle[i]]);
+      int p1 = findTriPosition(parent, positionOf[triangle[i + 1]]);
+      int p2 = findTriPosition(parent, positionOf[triangle[i + 2]]);
+      if (p0 == p1 || p1 == p2 || p2 == p0) continue;
+      for (int k = 0; k < 3; k++) triangle[kept + k] = triangle[i + k];
+      kept += 3; }
+    triangle.resize(kept);
+    }
+
+  // corners of collapsed positions take the best matching vertex at their new position
+  for (size_t i = 0; i < triangle.size(); i++) {
+    int v = triangle[i], p = findTriPosition(parent, positionOf[v]);
+    if (p != positionOf[v]) {
+      float bestScore = -10.0f;
+      for (int j = positionStart[p]; j < positionStart[p + 1]; j++) {
+        int u = positionVertex[j];
+        float score = glm::dot(normal[u], normal[v]) + (color[u] == color[v] ? 2.0f : 0.0f);
+        if (score > bestScore) {
+          bestScore = score;
+          triangle[i] = u; }
+        }
+      }
+    out[i] = triangle[i];
+    }
+  *error = (float) maxError;
+  return (int) triangle.size();
+  }
+
+// appends the coarser levels of a model after its full detail index[nIndices]
+// index needs room for TRI_MAX_LODS * nIndices indices
+// returns the total number of indices of all levels
+int buildTriLodChain(unsigned int index[], int nIndices, int nVertices,
+  const glm::vec4 vertex[], const glm::vec4 color[], const glm::vec3 normal[], TriLodChain * chain)
+  {
+  chain->nLods = 1;
+  chain->start[0] = 0;
+  chain->count[0] = nIndices;
+  chain->error[0] = 0.0f;
+  for (int l = 1; l < TRI_MAX_LODS; l++) {
+    unsigned int previous = chain->nLods - 1;
+    int target = 3 * (int) (triLodRatio[l] * nIndices / 3);
+    if (target < 3 * TRI_LOD_MIN_TRIANGLES) target = 3 * TRI_LOD_MIN_TRIANGLES;
+    if (target >= (int) chain->count[previous]) break;
+    unsigned int start = chain->start[previous] + chain->count[previous];
+    float error;
+    int count = simplifyTriModel(index + chain->start[previous], chain->count[previous], nVertices,
+      vertex, color, normal, target, index + start, &error);
+    // stop when the mesh can't get meaningfully simpler
+    if (count == 0 || count > 0.8f * chain->count[previous]) break;
+    optimizeVertexCache(index + start, count, nVertices);
+    chain->start[l] = start;
+    chain->count[l] = count;
+    chain->error[l] = std::max(error, chain->error[previous]);
+    chain->nLods++;
+    }
+  return triLodChainIndices(chain);
+  }
+
+// returns the coarsest level whose error is at most maxError pixels, the levels' errors only grow
+int coarsestTriLod(const TriLodChain * chain, float pixelsPerUnit, float maxError) {
+  int l = 0;
+  while (l + 1 < (int) chain->nLods && chain->error[l + 1] * pixelsPerUnit <= maxError) l++;
+  return l;
+  }
+
+// returns the level to draw a model at given the pixels a model unit projects to and its current level
+int selectTriLod(const TriLodChain * chain, int currentLod, float pixelsPerUnit) {
+  int finer = coarsestTriLod(chain, pixelsPerUnit, TRI_LOD_PIXEL_ERROR);
+  int coarser = coarsestTriLod(chain, pixelsPerUnit, TRI_LOD_HYSTERESIS * TRI_LOD_PIXEL_ERROR);
+  int last = chain->nLods - 1;
+  if (currentLod > last) currentLod = last;
+  if (finer < currentLod) return finer;
+  if (coarser > currentLod) return coarser;
+  return currentLod;
+  }
@@ -0,0 +1,346 @@
+/*
+triMesh465.hpp
+
+Indexed mesh utilities for models read by loadTriModel(...):
+
+indexTriModel(...) welds identical vertex, color, normal tuples into an
+index buffer, reorders the triangles for the GPU's post-transform vertex
+cache and then reorders the vertices into first use order for fetch
+locality.  Draw the result with glDrawElements(...).
+
+vertexCacheACMR(...) simulates a FIFO post-transform cache and returns the
+average cache miss ratio:  transformed vertices per triangle.  An unindexed
+model is always 3.0, a well ordered closed mesh approaches 0.5 - 0.7.
+
+Triangle order uses Tom Forsyth's "Linear-Speed Vertex Cache Optimisation"
+scoring (LRU cache of 32).  ACMR is reported for a 16 entry FIFO, the
+smaller and more pessimistic cache most GPUs behave like.
+
+loadTriModel(...) computes flat normals per corner so corners of one face
+differ in the last bits;  normals closer than TRI_WELD_NORMAL_EPSILON per
+component weld together.
+*/
+
+# include <math.h>
+# include <string.h>
+# include <vector>
+# include <unordered_map>
+
+# define TRI_WELD_NORMAL_EPSILON (1.0f / 4096.0f)
+# define TRI_FORSYTH_CACHE_SIZE 32
+# define TRI_ACMR_CACHE_SIZE 16
+
+// key for welding, positions and colors compare exactly, normals quantized
+struct TriWeldKey {
+  float x, y, z;
+  float r, g, b;
+  int nx, ny, nz;
+  bool operator==(const TriWeldKey & other) const {
+    return memcmp(this, &other, sizeof(TriWeldKey)) == 0; }
+  };
+
+struct TriWeldKeyHash {
+  size_t operator()(const TriWeldKey & key) const {
+    // FNV-1a over the key's bytes
+    const unsigned char * byte = (const unsigned char *) &key;
+    size_t hash = 2166136261u;
+    for (size_t i = 0; i < sizeof(TriWeldKey); i++) hash = (hash ^ byte[i]) * 16777619u;
+    return hash; }
+  };
+
+// returns the average cache miss ratio of index[nIndices] for a FIFO cache of cacheSize
+float vertexCacheACMR(const unsigned int index[], int nIndices, int nVertices, int cacheSize) {
+  std::vector<unsigned int> timestamp(nVertices, 0);  // when each vertex entered the cache
+  unsigned int time = cacheSize + 1;
+  int misses = 0;
+  if (nIndices < 3) return 0.0f;
+  for (int i = 0; i < nIndices; i++) {
+    unsigned int v = index[i];
+    // a vertex is cached if it entered within the last cacheSize misses
+    if (time - timestamp[v] > (unsigned int) cacheSize) {
+      timestamp[v] = time++;
+      misses++; }
+    }
+  return (float) misses / (nIndices / 3);
+  }
+
+// Forsyth vertex score from its position in the LRU cache and remaining triangles
+float forsythVertexScore(int cachePosition, int remainingTriangles) {
+  const float cacheDecayPower = 1.5f, lastTriangleScore = 0.75f;
+  const float valenceBoostScale = 2.0f, valenceBoostPower = 0.5f;
+  float score = 0.0f;
+  if (remainingTriangles == 0) return -1.0f;  // no triangles left, never picked
+  if (cachePosition >= 0) {
+    if (cachePosition < 3) score = lastTriangleScore;  // used by the last triangle
+    else {
+      float scaler = 1.0f / (TRI_FORSYTH_CACHE_SIZE - 3);
+      score = powf(1.0f - (cachePosition - 3) * scaler, cacheDecayPower); }
+    }
+  // favour vertices with few triangles left so they leave the cache for good
+  score += valenceBoostScale * powf((float) remainingTriangles, -valenceBoostPower);
+  return score;
+  }
+
+// reorders the triangles of index[nIndices] in place for vertex cache locality
+void optimizeVertexCache(unsigned int index[], int nIndices, int nVertices) {
+  int nTriangles = nIndices / 3;
+  std::vector<int> triangleStart(nVertices + 1, 0), triangleList(nIndices), remaining(nVertices, 0);
+  std::vector<int> cachePosition(nVertices, -1);
+  std::vector<float> vertexScore(nVertices), triangleScore(nTriangles);
+  std::vector<bool> added(nTriangles, false);
+  std::vector<unsigned int> output(nIndices);
+  int cache[TRI_FORSYTH_CACHE_SIZE + 3], cacheCount = 0;
+
+  // vertex to triangle adjacency
+  for (int i = 0; i < nIndices; i++) triangleStart[index[i] + 1]++;
+  for (int v = 0; v < nVertices; v++) {
+    remaining[v] = triangleStart[v + 1];
+    triangleStart[v + 1] += triangleStart[v]; }
+  std::vector<int> fill(triangleStart.begin(), triangleStart.end() - 1);
+  for (int i = 0; i < nIndices; i++) triangleList[fill[index[i]]++] = i / 3;
+
+  for (int v = 0; v < nVertices; v++) vertexScore[v] = forsythVertexScore(-1, remaining[v]);
+  for (int t = 0; t < nTriangles; t++)
+    triangleScore[t] = vertexScore[index[3 * t]] + vertexScore[index[3 * t + 1]] + vertexScore[index[3 * t + 2]];
+
+  int bestTriangle = -1, scanFrom = 0;
+  for (int out = 0; out < nTriangles; out++) {
+    if (bestTriangle < 0) {  // nothing in the cache scored, take the best remaining triangle
+      float bestScore = -1.0f;
+      while (scanFrom < nTriangles && added[scanFrom]) scanFrom++;
+      for (int t = scanFrom; t < nTriangles; t++)
+        if (!added[t] && triangleScore[t] > bestScore) {
+          bestScore = triangleScore[t];
+          bestTriangle = t; }
+      }
+    int t = bestTriangle;
+    added[t] = true;
+    for (int k = 0; k < 3; k++) output[3 * out + k] = index[3 * t + k];
+
+    // remove the triangle from its vertices' remaining lists
+    for (int k = 0; k < 3; k++) {
+      int v = index[3 * t + k];
+      int * list = &triangleList[triangleStart[v]];
+      for (int j = 0; j < remaining[v]; j++)
+        if (list[j] == t) {
+          list[j] = list[remaining[v] - 1];
+          break; }
+      remaining[v]--; }
+
+    // the triangle's vertices move to the front of the LRU cache
+    int newCache[TRI_FORSYTH_CACHE_SIZE + 3], newCount = 0;
+    for (int k = 0; k < 3; k++) newCache[newCount++] = index[3 * t + k];
+    for (int c = 0; c < cacheCount; c++) {
+      int v = cache[c];
+      if (v != (int) index[3 * t] && v != (int) index[3 * t + 1] && v != (int) index[3 * t + 2])
+        newCache[newCount++] = v; }
+    for (int c = 0; c < newCount; c++) {
+      int v = newCache[c];
+      cachePosition[v] = c < TRI_FORSYTH_CACHE_SIZE ? c : -1;
+      vertexScore[v] = forsythVertexScore(cachePosition[v], remaining[v]); }
+    cacheCount = newCount < TRI_FORSYTH_CACHE_SIZE ? newCount : TRI_FORSYTH_CACHE_SIZE;
+    memcpy(cache, newCache, cacheCount * sizeof(int));
+
+    // rescore the triangles touching the updated vertices and pick the best for next time
+    float bestScore = -1.0f;
+    bestTriangle = -1;
+    for (int c = 0; c < newCount; c++) {
+      int v = newCache[c];
+      for (int j = 0; j < remaining[v]; j++) {
+        int u = triangleList[triangleStart[v] + j];
+        triangleScore[u] = vertexScore[index[3 * u]] + vertexScore[index[3 * u + 1]] + vertexScore[index[3 * u + 2]];
+        if (triangleScore[u] > bestScore) {
+          bestScore = triangleScore[u];
+          bestTriangle = u; }
+        }
+      }
+    }
+  memcpy(index, &output[0], nIndices * sizeof(unsigned int));
+  }
+
+// welds and reorders a loadTriModel(...) model in place
+// on return vertex, color and normal hold the unique vertices in first use order,
+// index[nVertices] indexes them and acmrWelded / acmrOptimized hold the model's
+// ACMR before and after the triangle reorder
+// returns the number of unique vertices
+int indexTriModel(int nVertices, glm::vec4 vertex[], glm::vec4 color[], glm::vec3 normal[],
+  unsigned int index[], float * acmrWelded, float * acmrOptimized)
+  {
+  std::unordered_map<TriWeldKey, unsigned int, TriWeldKeyHash> unique;
+  int nUnique = 0;
+  unique.reserve(nVertices);
+
+  // weld:  compact the unique vertices in place, input i is always >= output nUnique
+  for (int i = 0; i < nVertices; i++) {
+    TriWeldKey key;
+    memset(&key, 0, sizeof(key));
+    key.x = vertex[i].x;  key.y = vertex[i].y;  key.z = vertex[i].z;
+    key.r = color[i].x;  key.g = color[i].y;  key.b = color[i].z;
+    key.nx = (int) floorf(normal[i].x / TRI_WELD_NORMAL_EPSILON + 0.5f);
+    key.ny = (int) floorf(normal[i].y / TRI_WELD_NORMAL_EPSILON + 0.5f);
+    key.nz = (int) floorf(normal[i].z / TRI_WELD_NORMAL_EPSILON + 0.5f);
+    std::pair<std::unordered_map<TriWeldKey, unsigned int, TriWeldKeyHash>::iterator, bool> found =
+      unique.insert(std::make_pair(key, (unsigned int) nUnique));
+    if (found.second) {
+      vertex[nUnique] = vertex[i];
+      color[nUnique] = color[i];
+      normal[nUnique] = normal[i];
+      nUnique++; }
+    index[i] = found.first->second;
+    }
+  *acmrWelded = vertexCacheACMR(index, nVertices, nUnique, TRI_ACMR_CACHE_SIZE);
+
+  optimizeVertexCache(index, nVertices, nUnique);
+  *acmrOptimized = vertexCacheACMR(index, nVertices, nUnique, TRI_ACMR_CACHE_SIZE);
+
+  // renumber the vertices in the order the triangles first use them
+  std::vector<int> remap(nUnique, -1);
+  std::vector<glm::vec4> oldVertex(vertex, vertex + nUnique), oldColor(color, color + nUnique);
+  std::vector<glm::vec3> oldNormal(normal, normal + nUnique);
+  int next = 0;
+  for (int i = 0; i < nVertices; i++) {
+    unsigned int v = index[i];
+    if (remap[v] < 0) {
+      remap[v] = next;
+      vertex[next] = oldVertex[v];
+      color[next] = oldColor[v];
+      normal[next] = oldNormal[v];
+      next++; }
+    index[i] = remap[v];
+    }
+  return nUnique;
+  }
+
+/*
+Packed, interleaved vertex formats for indexed models.  A loadTriModel(...)
+vertex is 44 bytes (vec4 position with w = 1, vec4 color, vec3 normal), the
+packed formats are:
+
+TRI_VERTEX_FLOAT      20 bytes:  float3 position, RGBA8 color, octahedral normal
+TRI_VERTEX_QUANTIZED  16 bytes:  snorm16 position, RGBA8 color, octahedral normal
+
+Quantized positions are stored divided by the model's largest absolute
+coordinate;  scale the model matrix by the positionScale packTriModel(...)
+returns.  Normals are octahedral encoded into 2 snorm16 components.
+Attributes of 3 components read with w = 1, so vPosition stays a vec4.
+*/
+
+# define TRI_VERTEX_FLOAT 0
+# define TRI_VERTEX_QUANTIZED 1
+
+struct TriVertexFloat {
+  float position[3];
+  unsigned char color[4];
+  short normal[2];
+  };
+
+struct TriVertexQuantized {
+  short position[4];      // position[3] is padding
+  unsigned char color[4];
+  short normal[2];
+  };
+
+// bytes per vertex of format
+int triVertexStride(int format) {
+  return format == TRI_VERTEX_QUANTIZED ? sizeof(TriVertexQuantized) : sizeof(TriVertexFloat);
+  }
+
+// float in -1..1 to snorm16
+short packSnorm16(float value) {
+  if (value > 1.0f) value = 1.0f;
+  if (value < -1.0f) value = -1.0f;
+  return (short) roundf(value * 32767.0f);
+  }
+
+// float color 0..1 to unorm8
+unsigned char packUnorm8(float value) {
+  if (value > 1.0f) value = 1.0f;
+  if (value < 0.0f) value = 0.0f;
+  return (unsigned char) (value * 255.0f + 0.5f);
+  }
+
+// unit normal to octahedral snorm16 x 2
+void packOctahedral(const glm::vec3 & normal, short packed[2]) {
+  float sum = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+  float x = sum > 0.0f ? normal.x / sum : 0.0f;
+  float y = sum > 0.0f ? normal.y / sum : 0.0f;
+  if (normal.z < 0.0f) {  // fold the lower hemisphere over the diagonals
+    float foldX = (1.0f - std::abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+    float foldY = (1.0f - std::abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+    x = foldX;
+    y = foldY; }
+  packed[0] = packSnorm16(x);
+  packed[1] = packSnorm16(y);
+  }
+
+// packs nVertices planar vertex, color, normal values into out (nVertices * triVertexStride(format) bytes)
+// returns the positionScale to apply to the model matrix, 1.0f for TRI_VERTEX_FLOAT
+float packTriModel(int format, int nVertices, const glm::vec4 vertex[], const glm::vec4 color[],
+  const glm::vec3 normal[], void * out)
+  {
+  float positionScale = 1.0f;
+  if (format == TRI_VERTEX_QUANTIZED) {
+    float maxCoordinate = 0.0f;
+    for (int i = 0; i < nVertices; i++)
+      for (int j = 0; j < 3; j++)
+        if (maxCoordinate < std::abs(vertex[i][j])) maxCoordinate = std::abs(vertex[i][j]);
+    if (maxCoordinate > 0.0f) positionScale = maxCoordinate;
+    TriVertexQuantized * packed = (TriVertexQuantized *) out;
+    for (int i = 0; i < nVertices; i++) {
+      for (int j = 0; j < 3; j++) packed[i].position[j] = packSnorm16(vertex[i][j] / positionScale);
+      packed[i].position[3] = 0;
+      for (int j = 0; j < 4; j++) packed[i].color[j] = packUnorm8(color[i][j]);
+      packOctahedral(normal[i], packed[i].normal);
+      }
+    }
+  else {
+    TriVertexFloat * packed = (TriVertexFloat *) out;
+    for (int i = 0; i < nVertices; i++) {
+      for (int j = 0; j < 3; j++) packed[i].position[j] = vertex[i][j];
+      for (int j = 0; j < 4; j++) packed[i].color[j] = packUnorm8(color[i][j]);
+      packOctahedral(normal[i], packed[i].normal);
+      }
+    }
+  return positionScale;
+  }
+
+// unpacks the positions of nVertices packed vertices of format, positionScale as returned by packTriModel(...)
+void unpackTriPositions(int format, int nVertices, const void * packed, float positionScale, glm::vec4 vertex[]) {
+  for (int i = 0; i < nVertices; i++)
+    if (format == TRI_VERTEX_QUANTIZED) {
+      const TriVertexQuantized * v = (const TriVertexQuantized *) packed + i;
+      // snorm16 to float as GL 4.2+ defines it, GL 3.3 differs by less than 1 / 65535
+      for (int j = 0; j < 3; j++) vertex[i][j] = std::max(v->position[j] / 32767.0f, -1.0f) * positionScale;
+      vertex[i].w = 1.0f; }
+    else {
+      const TriVertexFloat * v = (const TriVertexFloat *) packed + i;
+      vertex[i] = glm::vec4(v->position[0], v->position[1], v->position[2], 1.0f); }
+  }
+
+// sets a vao's vertex, color, normal attributes for a packed vbo of format,
+// an ibo other than 0 becomes the vao's element buffer
+// the vertex shader's normal input is a vec2 to decode with octahedral decoding
+void setPackedModelAttributes(int format, GLuint vao, GLuint vbo, GLuint ibo, GLuint shaderProgram,
+  GLuint vPosition, GLuint vColor, GLuint vNormal,
+  char * shaderVertex, char * shaderColor, char * shaderNormal)
+  {
+  int stride = triVertexStride(format);
+  bool quantized = format == TRI_VERTEX_QUANTIZED;
+  glBindVertexArray(vao);
+  glBindBuffer( GL_ARRAY_BUFFER, vbo);
+  if (ibo != 0) glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, ibo);
+  vPosition = glGetAttribLocation( shaderProgram, shaderVertex );
+  glEnableVertexAttribArray( vPosition );
+  if (quantized)
+    glVertexAttribPointer( vPosition, 3, GL_SHORT, GL_TRUE, stride, BUFFER_OFFSET(offsetof(TriVertexQuantized, position)) );
+  else
+    glVertexAttribPointer( vPosition, 3, GL_FLOAT, GL_FALSE, stride, BUFFER_OFFSET(offsetof(TriVertexFloat, position)) );
+  vColor = glGetAttribLocation( shaderProgram, shaderColor );
+  glEnableVertexAttribArray( vColor );
+  glVertexAttribPointer( vColor, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride,
+    BUFFER_OFFSET(quantized ? offsetof(TriVertexQuantized, color) : offsetof(TriVertexFloat, color)) );
+  vNormal = glGetAttribLocation( shaderProgram, shaderNormal );
+  glEnableVertexAttribArray( vNormal );
+  glVertexAttribPointer( vNormal, 2, GL_SHORT, GL_TRUE, stride,
+    BUFFER_OFFSET(quantized ? offsetof(TriVertexQuantized, normal) : offsetof(TriVertexFloat, normal)) );
+  }
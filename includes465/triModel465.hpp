@@ -1,7 +1,7 @@
 /*
 triModel465.hpp
 
-Two utility functions:  loadTriModel(...) and loadModelBuffer(...)
+Utility functions:  loadTriModel(...), countTriModel(...) and loadModelBuffer(...)
 
 Using loadModelBuffer(...) in your OpenGL core application will call
 loadTriModel(...) to read the model's file data.
@@ -22,6 +22,10 @@ Function's 4 assumptions:
 
 Use loadModelBuffer(...) to set *.tri model data into vao's vbo buffer.
 
+loadTriModel(...) reads the file in a single pass through a TriTokenizer:
+a fixed 64KB buffer scanned for delimiters 16 bytes at a time (SSE2) with
+numbers converted in place by std::from_chars.  Build with -std=c++17.
+
 Functions prints various error messages, with error returns -1.0f
 Functions returns the bounding radius of the model with valid model file.
 
@@ -36,66 +40,163 @@ Mike Barnes
 10/11/2013
 */
 
+# include <string.h>
+# include <charconv>
+# ifdef __SSE2__
+# include <emmintrin.h>
+# endif
+
+// TriTokenizer reads a *.tri file through a fixed buffer and returns one
+// whitespace separated token at a time, without allocating or copying.
+// Tokens never span a refill:  a partial token at the end of the buffer
+// is moved to the front before the rest of the buffer is refilled.
+# define TRI_BUFFER_SIZE (64 * 1024)
+# define TRI_BUFFER_PAD 16  // the delimiter scan may read up to 15 bytes past the data
+
+struct TriTokenizer {
+  FILE * fileIn;
+  char buffer[TRI_BUFFER_SIZE + TRI_BUFFER_PAD];
+  char * next;      // first unread byte
+  char * end;       // one past the last byte read, *end is always a '\0' sentinel
+  bool eof;         // no more data after end
+  };
+
+// read more of the file into the buffer, keeping bytes from keep to end
+// returns false if nothing more could be read
+bool refillTriTokenizer(TriTokenizer * tokenizer, char * keep) {
+  if (tokenizer->eof) return false;
+  size_t kept = tokenizer->end - keep;
+  memmove(tokenizer->buffer, keep, kept);
+  size_t nRead = fread(tokenizer->buffer + kept, 1, TRI_BUFFER_SIZE - kept, tokenizer->fileIn);
+  if (nRead < TRI_BUFFER_SIZE - kept) tokenizer->eof = true;
+  tokenizer->next = tokenizer->buffer;
+  tokenizer->end = tokenizer->buffer + kept + nRead;
+  memset(tokenizer->end, 0, TRI_BUFFER_PAD);
+  return nRead > 0;
+  }
+
+// returns the first byte at or after p that is a delimiter (<= ' '), the sentinel stops the scan
+const char * scanTriDelimiter(const char * p) {
+# ifdef __SSE2__
+  const __m128i space = _mm_set1_epi8(' ');
+  for (;;) {
+    __m128i chunk = _mm_loadu_si128((const __m128i *) p);
+    // bytes <= ' ' (unsigned) are delimiters
+    int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(chunk, space), space));
+    if (mask != 0) return p + __builtin_ctz(mask);
+    p += 16;
+    }
+# else
+  while ((unsigned char) *p > ' ') p++;
+  return p;
+# endif
+  }
+
+// sets [begin, end) to the next token, returns false at end of file
+bool nextTriToken(TriTokenizer * tokenizer, const char ** begin, const char ** end) {
+  for (;;) {
+    while (tokenizer->next < tokenizer->end && (unsigned char) *tokenizer->next <= ' ') tokenizer->next++;
+    if (tokenizer->next < tokenizer->end) break;
+    if (!refillTriTokenizer(tokenizer, tokenizer->end)) return false;
+    }
+  const char * tokenEnd = scanTriDelimiter(tokenizer->next);
+  if (tokenEnd == tokenizer->end && !tokenizer->eof) {
+    // the token may continue past the buffer
+    refillTriTokenizer(tokenizer, tokenizer->next);
+    tokenEnd = scanTriDelimiter(tokenizer->next);
+    }
+  *begin = tokenizer->next;
+  *end = tokenEnd;
+  tokenizer->next = (char *) tokenEnd;
+  return true;
+  }
+
+// parse a float token, returns false if the token isn't entirely a number
+bool parseTriFloat(const char * begin, const char * end, float * value) {
+  if (begin < end && *begin == '+') begin++;  // from_chars doesn't accept a leading '+'
+# if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+  std::from_chars_result result = std::from_chars(begin, end, *value);
+  return result.ec == std::errc() && result.ptr == end;
+# else
+  // no floating point from_chars in this library, the token is '\0' or whitespace terminated
+  char * parsed;
+  *value = strtof(begin, &parsed);
+  return parsed == end;
+# endif
+  }
+
+// parse a hex color token with or without a 0x prefix
+bool parseTriHex(const char * begin, const char * end, unsigned int * value) {
+  if (end - begin > 2 && begin[0] == '0' && (begin[1] == 'x' || begin[1] == 'X')) begin += 2;
+  std::from_chars_result result = std::from_chars(begin, end, *value, 16);
+  return result.ec == std::errc() && result.ptr == end;
+  }
+
 float loadTriModel(char * fileName, int nVertices, glm::vec4 vertex[], glm::vec4 color[], glm::vec3 normal[]) {
   const int X = 0, Y = 1, Z = 2;
-  FILE * fileIn;
+  TriTokenizer tokenizer;
+  const char * begin, * end;
   glm::vec3 point[3];   // 3 vertices of a triangle
   glm::vec4 surfaceColor; 
-  bool done;
   float coord[3][3];  // triangle's 3 vertice's x, y, z values
   float maxAxes[3] = {-1000.0f, -1000.0f, -1000.0f}; // maximum lenght of x, y, and z from center
   unsigned int triangleColor;		// triangle's 3 coordinates have same hex color code
   unsigned int red, green, blue;  // triangleColor's component colors
-  int count = 0, vertexCount = 0, normalCount = 0, colorCount = 0;
-
-  // printf("loadTriModel sizes: nVertices %d, vertex %d, color %d, normal %d\n", nVertices, sizeof(vertex), sizeof(color), sizeof(normal));
-  fileIn = fopen(fileName, "r");
-  if (fileIn != NULL) {
-    while (!feof(fileIn)) {
-        done = false;
-        for(int i = 0; i < 3; i++)
-          for(int j = 0; j < 3; j++) {
-            coord[i][j] = -99999.9f;
-            if ( fscanf(fileIn, "%f", &coord[i][j]) == EOF) { // at EOF
-              done = true;
-              break; }
-          }
-        if(!done) {  
-          // create vertices and normals
-          // std::abs(....) is used instead of abs(...) because g++ does not provide float abs(float)
-          for(int i = 0; i < 3; i++) {  // get triangle's points
-            point[i] = glm::vec3(coord[i][X], coord[i][Y], coord[i][Z]); 
-            vertex[vertexCount] = glm::vec4(point[i].x, point[i].y, point[i].z, 1.0f);
-            // update maxAxes for model's bounding sphere
-            if (maxAxes[X] < std::abs(coord[i][X])) maxAxes[X] = std::abs(coord[i][X]);
-            if (maxAxes[Y] < std::abs(coord[i][Y])) maxAxes[Y] = std::abs(coord[i][Y]);
-            if (maxAxes[Z] < std::abs(coord[i][X])) maxAxes[Z] = std::abs(coord[i][Z]);
-            vertexCount++;  }
-        // compute normals  for counter-clockwise vertex winding
-        normal[normalCount++] = glm::normalize(glm::cross(point[1] - point[0], point[2] - point[0]));
-        normal[normalCount++] = glm::normalize(glm::cross(point[2] - point[1], point[0] - point[1]));
-        normal[normalCount++] = glm::normalize(glm::cross(point[0] - point[2], point[1] - point[2]));
-        fscanf(fileIn, "%x", &triangleColor);
-        red = triangleColor;
-        green = triangleColor;
-        blue = triangleColor;
-        red = red >> 16;
-        green = green << 16;
-        green = green >> 24;   
-        blue = blue << 24;
-        blue = blue >> 24;
-        // make surfaceColor float r,g,b values 0..1
-        surfaceColor = glm::vec4(red / 255.0f, green / 255.0f,  blue / 255.0f, 1.0f);
-        for(int i = 0; i < 3; i++) color[colorCount++] = surfaceColor;
-        count++;
-        }  // ! done
-        // create vertexs, normal, color 
-      } // while ! eof
-    } // if
-  else { // file is null
-      printf("loadTriModel error:  can't open %s\n", fileName);
-      return -1.0f;  // just to satisfy the compiler
+  int count = 0, vertexCount = 0;
+
+  tokenizer.fileIn = fopen(fileName, "rb");
+  if (tokenizer.fileIn == NULL) {
+    printf("loadTriModel error:  can't open %s\n", fileName);
+    return -1.0f; }
+  tokenizer.eof = false;
+  tokenizer.next = tokenizer.end = tokenizer.buffer;
+  refillTriTokenizer(&tokenizer, tokenizer.end);
+
+  // one pass:  each triangle is 9 coordinates and a hex color
+  while (nextTriToken(&tokenizer, &begin, &end)) {
+    for(int i = 0; i < 3; i++)
+      for(int j = 0; j < 3; j++) {
+        if ((i > 0 || j > 0) && !nextTriToken(&tokenizer, &begin, &end)) {
+          printf("loadTriModel error:  %s ends inside triangle %d\n", fileName, count);
+          fclose(tokenizer.fileIn);
+          return -1.0f; }
+        if (!parseTriFloat(begin, end, &coord[i][j])) {
+          printf("loadTriModel error:  %s triangle %d has bad coordinate %.*s\n", fileName, count, (int) (end - begin), begin);
+          fclose(tokenizer.fileIn);
+          return -1.0f; }
+        }
+    if (!nextTriToken(&tokenizer, &begin, &end) || !parseTriHex(begin, end, &triangleColor)) {
+      printf("loadTriModel error:  %s triangle %d has no hex color\n", fileName, count);
+      fclose(tokenizer.fileIn);
+      return -1.0f; }
+    if (vertexCount + 3 > nVertices) {  // don't write past the caller's arrays
+      count++;
+      vertexCount += 3;
+      continue; }
+    // create vertices and normals
+    // std::abs(....) is used instead of abs(...) because g++ does not provide float abs(float)
+    for(int i = 0; i < 3; i++) {  // get triangle's points
+      point[i] = glm::vec3(coord[i][X], coord[i][Y], coord[i][Z]); 
+      vertex[vertexCount + i] = glm::vec4(point[i].x, point[i].y, point[i].z, 1.0f);
+      // update maxAxes for model's bounding sphere
+      if (maxAxes[X] < std::abs(coord[i][X])) maxAxes[X] = std::abs(coord[i][X]);
+      if (maxAxes[Y] < std::abs(coord[i][Y])) maxAxes[Y] = std::abs(coord[i][Y]);
+      if (maxAxes[Z] < std::abs(coord[i][Z])) maxAxes[Z] = std::abs(coord[i][Z]);
       }
+    // compute normals  for counter-clockwise vertex winding
+    normal[vertexCount]     = glm::normalize(glm::cross(point[1] - point[0], point[2] - point[0]));
+    normal[vertexCount + 1] = glm::normalize(glm::cross(point[2] - point[1], point[0] - point[1]));
+    normal[vertexCount + 2] = glm::normalize(glm::cross(point[0] - point[2], point[1] - point[2]));
+    red = triangleColor >> 16;
+    green = (triangleColor >> 8) & 0xFF;
+    blue = triangleColor & 0xFF;
+    // make surfaceColor float r,g,b values 0..1
+    surfaceColor = glm::vec4(red / 255.0f, green / 255.0f,  blue / 255.0f, 1.0f);
+    for(int i = 0; i < 3; i++) color[vertexCount + i] = surfaceColor;
+    vertexCount += 3;
+    count++;
+    }
+  fclose(tokenizer.fileIn);
   if (count != nVertices/3) {
     printf("loadTriModel error:  count of surfaces != numberVertex:  count %4d != nVertices/3 %4d\n",
       count, nVertices/3);
@@ -112,6 +213,51 @@ float loadTriModel(char * fileName, int nVertices, glm::vec4 vertex[], glm::vec4
   return -1.0f;
   }
 
+// counts the triangles in a *.tri file without parsing them:  every triangle is 9 floats and 1 hex color
+// returns the number of triangles, nVertices for loadTriModel(...) is 3 times that, or -1
+int countTriModel(const char * fileName) {
+  TriTokenizer tokenizer;
+  const char * begin, * end;
+  int tokens = 0;
+
+  tokenizer.fileIn = fopen(fileName, "rb");
+  if (tokenizer.fileIn == NULL) {
+    printf("countTriModel error:  can't open %s\n", fileName);
+    return -1; }
+  tokenizer.eof = false;
+  tokenizer.next = tokenizer.end = tokenizer.buffer;
+  refillTriTokenizer(&tokenizer, tokenizer.end);
+  while (nextTriToken(&tokenizer, &begin, &end)) tokens++;
+  fclose(tokenizer.fileIn);
+  if (tokens % 10 != 0) {
+    printf("countTriModel error:  %s has %d values, not a multiple of 10\n", fileName, tokens);
+    return -1; }
+  return tokens / 10;
+  }
+
+// sets a vao's vertex, color, normal attributes to the vbo layout loadModelBuffer(...) fills:
+// vec4 vertex[nVertices], vec4 color[nVertices], vec3 normal[nVertices]
+// an ibo other than 0 becomes the vao's element buffer for glDrawElements(...)
+void setModelAttributes(GLuint nVertices, GLuint vao, GLuint vbo, GLuint ibo, GLuint shaderProgram,
+  GLuint vPosition, GLuint vColor, GLuint vNormal,
+  char * shaderVertex, char * shaderColor, char * shaderNormal)
+  {
+  int vec4Size = nVertices * sizeof(glm::vec4);
+  glBindVertexArray(vao);
+  glBindBuffer( GL_ARRAY_BUFFER, vbo);
+  if (ibo != 0) glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, ibo);
+  // set vertex shader variable handles
+  vPosition = glGetAttribLocation( shaderProgram, shaderVertex );
+  glEnableVertexAttribArray( vPosition );
+  glVertexAttribPointer( vPosition, 4, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(0) );
+  vColor = glGetAttribLocation( shaderProgram, shaderColor );
+  glEnableVertexAttribArray( vColor);
+  glVertexAttribPointer( vColor, 4, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(vec4Size) );
+  vNormal = glGetAttribLocation( shaderProgram, shaderNormal );
+  glEnableVertexAttribArray( vNormal);
+  glVertexAttribPointer( vNormal, 3, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(2 * vec4Size) );
+  }
+
 // loads data from *.tri model file into a vao's vbo buffer for vertex, color, normal values
 // returns bounding radius of model
 float loadModelBuffer(char modelFile[25], GLuint nVertices, 
@@ -143,18 +289,8 @@ float loadModelBuffer(char modelFile[25], GLuint nVertices,
   glBufferSubData( GL_ARRAY_BUFFER, 0, vec4Size, vertex );
   glBufferSubData( GL_ARRAY_BUFFER, vec4Size, vec4Size, color );
   glBufferSubData( GL_ARRAY_BUFFER, 2 * vec4Size, vec3Size, normal );
-  // set vertex shader variable handles
-  vPosition = glGetAttribLocation( shaderProgram, shaderVertex );
-  glEnableVertexAttribArray( vPosition );
-  glVertexAttribPointer( vPosition, 4, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(0) );
-  vColor = glGetAttribLocation( shaderProgram, shaderColor );
-  glEnableVertexAttribArray( vColor);
-  glVertexAttribPointer( vColor, 4, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(vec4Size) );
-  vNormal = glGetAttribLocation( shaderProgram, shaderNormal );
-  glEnableVertexAttribArray( vNormal);
-  glVertexAttribPointer( vNormal, 3, GL_FLOAT, GL_FALSE, 0, BUFFER_OFFSET(2 * vec4Size) );
-
-  printf("vPosition %d, vColor %d, vNormal %d \n", vPosition, vColor, vNormal);
+  setModelAttributes(nVertices, vao, vbo, 0, shaderProgram, vPosition, vColor, vNormal,
+    shaderVertex, shaderColor, shaderNormal);
   // reclaim dynamically allocated memory
   free(vertex);
   free(color);